@@ -8,10 +8,10 @@ security_src="sad"
 servo_src="linreg ntpshm nullf pi refclock_sock servo"
 transp_src="sk raw transport udp udp6 uds"
 ptp4l_src="bmc clock clockadj clockcheck config designated_fsm \
- e2e_tc fault fsm hash interface monitor msg phc \
+ e2e_tc evlog fault fsm hash holdover interface metrics monitor msg phc \
  pmc_common port port_signaling pqueue print ptp4l p2p_tc rtnl \
- stats tc telecom tlv tsproc \
- unicast_client unicast_fsm unicast_service util version"
+ shm_status stats tc telecom tlv tsproc \
+ unicast_client unicast_fsm unicast_service util version warmstart"
 
 mkdir -p src/filters;
 for f in $filters_src
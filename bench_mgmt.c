@@ -0,0 +1,285 @@
+/**
+ * @file bench_mgmt.c
+ * @brief Measures the latency of a full state query over management
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * The same set of data sets is fetched from ptp4l in turn with one GET
+ * per management ID and with a single GET listing all of them, and the
+ * time until every TLV of the answers has arrived is reported for both.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "contain.h"
+#include "pmc_common.h"
+#include "print.h"
+#include "stats.h"
+#include "util.h"
+#include "version.h"
+
+/* Milliseconds to collect the answers while counting them. */
+#define COUNT_TMO	200
+/* Milliseconds before a measured query is given up. */
+#define QUERY_TMO	1000
+
+/* What a monitoring agent typically reads for a full picture. */
+static const int query_ids[] = {
+	MID_C_DEFAULT_DATA_SET,
+	MID_C_CURRENT_DATA_SET,
+	MID_C_PARENT_DATA_SET,
+	MID_C_TIME_PROPERTIES_DATA_SET,
+	MID_C_TIME_STATUS_NP,
+	MID_C_GRANDMASTER_SETTINGS_NP,
+	MID_P_PORT_DATA_SET,
+	MID_P_PORT_DATA_SET_NP,
+	MID_P_PORT_PROPERTIES_NP,
+	MID_P_PORT_STATS_NP,
+	MID_P_PORT_SERVICE_STATS_NP,
+	MID_P_PORT_HWCLOCK_NP,
+};
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+/*
+ * Collect answers until 'expected' TLVs arrived or nothing came for
+ * 'tmo' milliseconds. Returns the number of TLVs or -1 on error.
+ */
+static int collect(struct pmc *pmc, int expected, int tmo)
+{
+	struct pollfd pfd = { pmc_get_transport_fd(pmc), POLLIN | POLLPRI };
+	struct ptp_message *msg;
+	int cnt, got = 0;
+
+	while (got < expected) {
+		cnt = poll(&pfd, 1, tmo);
+		if (cnt < 0) {
+			pr_err("poll failed: %m");
+			return -1;
+		}
+		if (!cnt) {
+			break;
+		}
+		msg = pmc_recv(pmc);
+		if (!msg) {
+			continue;
+		}
+		if (msg_type(msg) == MANAGEMENT &&
+		    management_action(msg) == RESPONSE) {
+			got += msg_tlv_count(msg);
+		}
+		msg_put(msg);
+	}
+	return got;
+}
+
+/* Send the query, one ID at a time or all at once. */
+static int query(struct pmc *pmc, int bulk, int *expected, int tmo)
+{
+	int i, got, total = 0;
+
+	if (bulk) {
+		if (pmc_send_get_bulk(pmc, query_ids, ARRAY_SIZE(query_ids))) {
+			return -1;
+		}
+		return collect(pmc, expected ? expected[0] : INT_MAX, tmo);
+	}
+	for (i = 0; i < ARRAY_SIZE(query_ids); i++) {
+		if (pmc_send_get_action(pmc, query_ids[i])) {
+			return -1;
+		}
+		got = collect(pmc, expected ? expected[i] : INT_MAX, tmo);
+		if (got < 0) {
+			return -1;
+		}
+		total += got;
+	}
+	return total;
+}
+
+static void report(const char *name, struct stats *stats)
+{
+	struct stats_result res;
+
+	if (stats_get_result(stats, &res)) {
+		return;
+	}
+	printf("%-7s %8u %10.1f %10.1f %10.1f %10.1f\n", name,
+	       stats_get_num_values(stats), res.min, res.mean, res.max,
+	       res.stddev);
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\nusage: %s [options]\n\n"
+		" -f [file] read configuration from 'file'\n"
+		" -h        prints this message and exits\n"
+		" -n [num]  number of queries of each kind, default 1000\n"
+		" -s [path] server address for UDS, default '/var/run/ptp4l'\n"
+		" -v        prints the software version and exits\n"
+		"\n",
+		progname);
+}
+
+int main(int argc, char *argv[])
+{
+	int bulk_tlvs, c, err = -1, expected[ARRAY_SIZE(query_ids)], got, i;
+	char *config = NULL, *progname, uds_local[MAX_IFNAME_SIZE + 1];
+	struct stats *single = NULL, *bulk = NULL;
+	int index, rounds = 1000, single_tlvs = 0;
+	struct option *opts;
+	struct config *cfg;
+	struct pmc *pmc;
+	double t0;
+
+	if (handle_term_signals()) {
+		return -1;
+	}
+	cfg = config_create();
+	if (!cfg) {
+		return -1;
+	}
+	opts = config_long_options(cfg);
+	print_set_verbose(1);
+	print_set_syslog(0);
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1+progname : argv[0];
+	while (EOF != (c = getopt_long(argc, argv, "f:hn:s:v", opts, &index))) {
+		switch (c) {
+		case 0:
+			if (config_parse_option(cfg, opts[index].name, optarg)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 'f':
+			config = optarg;
+			break;
+		case 'n':
+			if (get_arg_val_i(c, optarg, &rounds, 1, INT_MAX)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 's':
+			if (config_set_string(cfg, "uds_address", optarg)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 'v':
+			version_show(stdout);
+			config_destroy(cfg);
+			return 0;
+		case 'h':
+			usage(progname);
+			config_destroy(cfg);
+			return 0;
+		case '?':
+		default:
+			usage(progname);
+			config_destroy(cfg);
+			return -1;
+		}
+	}
+	if (optind != argc) {
+		usage(progname);
+		config_destroy(cfg);
+		return -1;
+	}
+	if (config && config_read(config, cfg)) {
+		config_destroy(cfg);
+		return -1;
+	}
+	print_set_progname(progname);
+	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+
+	snprintf(uds_local, sizeof(uds_local), "/var/run/bench_mgmt.%d",
+		 getpid());
+	pmc = pmc_create(cfg, TRANS_UDS, uds_local,
+			 config_get_string(cfg, NULL, "uds_address"), 0,
+			 config_get_int(cfg, NULL, "domainNumber"),
+			 config_get_int(cfg, NULL, "transportSpecific") << 4,
+			 0, 1);
+	if (!pmc) {
+		pr_err("failed to create pmc");
+		config_destroy(cfg);
+		return -1;
+	}
+	single = stats_create();
+	bulk = stats_create();
+	if (!single || !bulk) {
+		goto out;
+	}
+
+	/* Learn how many TLVs answer each query, one per port and ID. */
+	for (i = 0; i < ARRAY_SIZE(query_ids); i++) {
+		if (pmc_send_get_action(pmc, query_ids[i])) {
+			goto out;
+		}
+		expected[i] = collect(pmc, INT_MAX, COUNT_TMO);
+		if (expected[i] < 0) {
+			goto out;
+		}
+		single_tlvs += expected[i];
+	}
+	bulk_tlvs = query(pmc, 1, NULL, COUNT_TMO);
+	if (!single_tlvs) {
+		pr_err("no answer from %s",
+		       config_get_string(cfg, NULL, "uds_address"));
+		goto out;
+	}
+	if (bulk_tlvs != single_tlvs) {
+		pr_err("%d TLVs answer the single queries, %d the bulk one",
+		       single_tlvs, bulk_tlvs);
+		goto out;
+	}
+	printf("%zu ids answered by %d TLVs\n", ARRAY_SIZE(query_ids),
+	       single_tlvs);
+
+	for (i = 0; i < rounds && is_running(); i++) {
+		t0 = now_us();
+		got = query(pmc, 0, expected, QUERY_TMO);
+		if (got == single_tlvs) {
+			stats_add_value(single, now_us() - t0);
+		} else if (got < 0) {
+			goto out;
+		}
+		t0 = now_us();
+		got = query(pmc, 1, &bulk_tlvs, QUERY_TMO);
+		if (got == bulk_tlvs) {
+			stats_add_value(bulk, now_us() - t0);
+		} else if (got < 0) {
+			goto out;
+		}
+	}
+
+	printf("%-7s %8s %10s %10s %10s %10s\n", "query", "count",
+	       "min/us", "mean/us", "max/us", "stddev/us");
+	report("single", single);
+	report("bulk", bulk);
+	err = 0;
+out:
+	if (single) {
+		stats_destroy(single);
+	}
+	if (bulk) {
+		stats_destroy(bulk);
+	}
+	pmc_destroy(pmc);
+	config_destroy(cfg);
+	return err;
+}
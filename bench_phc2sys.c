@@ -0,0 +1,231 @@
+/**
+ * @file bench_phc2sys.c
+ * @brief Measures the cycle time of phc2sys against the number of clocks
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * The destination clocks of one phc2sys cycle are measured the way
+ * update_domain_clocks() does it, once one after the other and once on
+ * a pool of workers, for an increasing number of clocks.  The clocks
+ * are the PHC devices given on the command line, used in turn, or the
+ * system clocks when none is given.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clockadj.h"
+#include "missing.h"
+#include "print.h"
+#include "sysoff.h"
+#include "util.h"
+#include "version.h"
+#include "workers.h"
+
+#define MAX_CLOCKS	128
+
+struct bench_clock {
+	clockid_t clkid;
+	int sysoff_method;
+};
+
+struct measurement {
+	struct bench_clock *clock;
+	int readings;
+	int64_t spin;
+	int64_t offset;
+	int64_t delay;
+	uint64_t ts;
+	int err;
+};
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/* Stands in for the time a slow device takes to answer. */
+static void spin(int64_t ns)
+{
+	int64_t end;
+
+	if (ns <= 0)
+		return;
+	end = now_ns() + ns;
+	while (now_ns() < end)
+		;
+}
+
+static void measure_clock(void *arg)
+{
+	struct measurement *m = arg;
+	struct bench_clock *clock = m->clock;
+
+	if (!clock)
+		return;
+
+	if (clock->sysoff_method >= 0) {
+		m->err = sysoff_measure(CLOCKID_TO_FD(clock->clkid),
+					clock->sysoff_method, m->readings,
+					&m->offset, &m->ts, &m->delay);
+	} else {
+		m->err = clockadj_compare(clock->clkid, CLOCK_REALTIME,
+					  m->readings, &m->offset, &m->ts,
+					  &m->delay);
+	}
+	spin(m->spin);
+}
+
+static double cycle_us(struct workers *w, struct measurement *m, int n,
+		       int cycles)
+{
+	int64_t t0;
+	int c, i;
+
+	t0 = now_ns();
+	for (c = 0; c < cycles; c++) {
+		if (w) {
+			workers_run(w, measure_clock, m, sizeof(m[0]), n);
+		} else {
+			for (i = 0; i < n; i++)
+				measure_clock(&m[i]);
+		}
+	}
+	return (now_ns() - t0) / 1e3 / cycles;
+}
+
+/* Double the number of clocks, ending with the largest one. */
+static int next_count(int n, int max_clocks)
+{
+	if (n == max_clocks)
+		return 0;
+	return n * 2 < max_clocks ? n * 2 : max_clocks;
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\nusage: %s [options] [device ...]\n\n"
+		" -c [num]  largest number of clocks, default 16\n"
+		" -h        prints this message and exits\n"
+		" -l [us]   extra time each measurement takes, default 0\n"
+		" -N [num]  number of readings per measurement, default 5\n"
+		" -n [num]  number of cycles per clock count, default 1000\n"
+		" -t [num]  number of worker threads, default one per CPU\n"
+		" -v        prints the software version and exits\n"
+		"\n",
+		progname);
+}
+
+int main(int argc, char *argv[])
+{
+	int c, cycles = 1000, err = -1, i, latency = 0, max_clocks = 16, n;
+	int n_devices = 0, phc_index, readings = 5, threads;
+	struct bench_clock clocks[MAX_CLOCKS], *clock, system_clock;
+	struct measurement m[MAX_CLOCKS];
+	double serial, parallel;
+	struct workers *w;
+	char *progname;
+
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
+	if (threads > WORKERS_MAX)
+		threads = WORKERS_MAX;
+	print_set_verbose(1);
+	print_set_syslog(0);
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1+progname : argv[0];
+	while (EOF != (c = getopt(argc, argv, "c:hl:N:n:t:v"))) {
+		switch (c) {
+		case 'c':
+			if (get_arg_val_i(c, optarg, &max_clocks, 1, MAX_CLOCKS))
+				return -1;
+			break;
+		case 'l':
+			if (get_arg_val_i(c, optarg, &latency, 0, INT_MAX / 1000))
+				return -1;
+			break;
+		case 'N':
+			if (get_arg_val_i(c, optarg, &readings, 1, INT_MAX))
+				return -1;
+			break;
+		case 'n':
+			if (get_arg_val_i(c, optarg, &cycles, 1, INT_MAX))
+				return -1;
+			break;
+		case 't':
+			if (get_arg_val_i(c, optarg, &threads, 1, WORKERS_MAX))
+				return -1;
+			break;
+		case 'v':
+			version_show(stdout);
+			return 0;
+		case 'h':
+			usage(progname);
+			return 0;
+		case '?':
+		default:
+			usage(progname);
+			return -1;
+		}
+	}
+	print_set_progname(progname);
+
+	system_clock.clkid = CLOCK_MONOTONIC;
+	system_clock.sysoff_method = -1;
+	for (i = optind; i < argc && n_devices < MAX_CLOCKS; i++) {
+		clock = &clocks[n_devices];
+		clock->clkid = posix_clock_open(argv[i], &phc_index);
+		if (clock->clkid == CLOCK_INVALID) {
+			pr_err("cannot open %s", argv[i]);
+			goto out;
+		}
+		clock->sysoff_method = clock->clkid == CLOCK_REALTIME ? -1 :
+			sysoff_probe(CLOCKID_TO_FD(clock->clkid), readings);
+		n_devices++;
+	}
+
+	w = workers_create(threads, "", 0);
+	if (!w) {
+		goto out;
+	}
+	for (i = 0; i < MAX_CLOCKS; i++) {
+		memset(&m[i], 0, sizeof(m[i]));
+		m[i].clock = n_devices ? &clocks[i % n_devices] : &system_clock;
+		m[i].readings = readings;
+		m[i].spin = latency * 1000LL;
+	}
+
+	printf("%d %s, %d readings, %d us latency, %d threads\n",
+	       n_devices ? n_devices : 1, n_devices ? "devices" : "system clock",
+	       readings, latency, threads);
+	printf("%6s %12s %12s %8s\n", "clocks", "serial/us", "workers/us",
+	       "speedup");
+	for (n = 1; n; n = next_count(n, max_clocks)) {
+		serial = cycle_us(NULL, m, n, cycles);
+		parallel = cycle_us(w, m, n, cycles);
+		printf("%6d %12.1f %12.1f %8.2f\n", n, serial, parallel,
+		       serial / parallel);
+		for (i = 0; i < n; i++) {
+			if (m[i].err && m[i].err != -EBUSY) {
+				pr_err("measurement of clock %d failed", i);
+				break;
+			}
+		}
+	}
+	workers_destroy(w);
+	err = 0;
+out:
+	for (i = 0; i < n_devices; i++)
+		posix_clock_close(clocks[i].clkid);
+	return err;
+}
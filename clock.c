@@ -30,14 +30,18 @@
 #include "clock.h"
 #include "clockadj.h"
 #include "clockcheck.h"
+#include "evlog.h"
 #include "foreign.h"
 #include "filter.h"
+#include "holdover.h"
+#include "metrics.h"
 #include "missing.h"
 #include "msg.h"
 #include "phc.h"
 #include "port.h"
 #include "sad.h"
 #include "servo.h"
+#include "shm_status.h"
 #include "stats.h"
 #include "print.h"
 #include "rtnl.h"
@@ -46,26 +50,14 @@
 #include "tz.h"
 #include "uds.h"
 #include "util.h"
-
-#if USE_KTIME
-#include <ktime.h>
-#endif
+#include "warmstart.h"
 
 #define N_CLOCK_PFD (N_POLLFD + 1) /* one extra per port, for the fault timer */
-
-int do_clock_gettime(clockid_t clk_id, struct timespec *tp)
-{
-#if USE_KTIME
-	if (clk_id == CLOCK_MONOTONIC) {
-		*tp = ktime_mono_time();
-	} else if (clk_id == CLOCK_REALTIME) {
-		*tp = ktime_real_time();
-	}
-	return 0;
-#else
-	return clock_gettime(clk_id, tp);
-#endif
-}
+#define N_EXTRA_PFD 2 /* the metrics socket and its pending reply */
+#define NOTIFY_BATCH 32 /* notifications per system call */
+#define MAX_BULK_IDS \
+	((sizeof(struct message_data) - sizeof(struct management_msg)) / \
+	 sizeof(struct management_tlv))
 
 struct interface {
 	STAILQ_ENTRY(interface) list;
@@ -163,6 +155,13 @@ struct clock {
 	struct interface *uds_ro_if;
 	LIST_HEAD(clock_subscribers_head, clock_subscriber) subscribers;
 	struct monitor *slave_event_monitor;
+	struct metrics *metrics;
+	struct shm_status *shm;
+	int shm_dirty;
+	struct holdover *holdover;
+	struct warmstart *warm;
+	int warm_pending;
+	time_t warm_saved;
 	int step_window_counter;
 	int step_window;
 	struct time_zone tz[MAX_TIME_ZONES];
@@ -349,32 +348,188 @@ static void clock_prune_subscriptions(struct clock *c)
 	}
 }
 
+static void clock_publish_status(struct clock *c)
+{
+	struct shm_status_page *page;
+	struct shm_status_port *sp;
+	unsigned int n = 0;
+	struct port *p;
+
+	page = shm_status_write_begin(c->shm);
+	page->servo_state = c->servo_state;
+	page->dds = c->dds;
+	page->cur = c->cur;
+	page->pds = c->dad.pds;
+	page->tds = c->tds;
+	LIST_FOREACH(p, &c->ports, list) {
+		if (n >= SHM_STATUS_MAX_PORTS) {
+			break;
+		}
+		sp = &page->port[n++];
+		sp->portIdentity = port_identity(p);
+		sp->port_state = port_state(p);
+		port_get_stats(p, &sp->stats, &sp->service_stats);
+	}
+	page->num_ports = n;
+	shm_status_write_end(c->shm);
+	c->shm_dirty = 0;
+}
+
+static bool msg_has_auth_tlv(struct ptp_message *msg)
+{
+	struct tlv_extra *extra;
+
+	TAILQ_FOREACH(extra, &msg->tlv_list, list) {
+		if (ntohs(extra->tlv->type) == TLV_AUTHENTICATION) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void clock_notify_many(struct port *uds, struct ptp_message *msg,
+			      struct mmsghdr *mmsg, int n)
+{
+	int cnt;
+
+	/* A stale subscriber fails alone until its subscription expires. */
+	cnt = port_forward_many(uds, msg, mmsg, n);
+	if (cnt < n) {
+		pr_debug("failed to notify %d of %d subscribers",
+			 cnt < 0 ? n : n - cnt, n);
+	}
+}
+
 void clock_send_notification(struct clock *c, struct ptp_message *msg,
 			     enum notification event)
 {
+	struct management_msg head[NOTIFY_BATCH];
+	struct iovec iov[NOTIFY_BATCH][2];
+	struct mmsghdr mmsg[NOTIFY_BATCH];
 	struct port *uds = c->uds_rw_port;
 	struct clock_subscriber *s;
+	int len, n = 0;
+
+	c->shm_dirty = 1;
+
+	/*
+	 * An authenticated message needs its ICV computed over the fields
+	 * of each subscriber, so it is sent one at a time.
+	 */
+	if (msg_has_auth_tlv(msg)) {
+		LIST_FOREACH(s, &c->subscribers, list) {
+			if (!event_bitmask_get(s->events, event))
+				continue;
+			msg->header.sequenceId = htons(s->sequenceId);
+			s->sequenceId++;
+			msg->management.targetPortIdentity.clockIdentity =
+				s->targetPortIdentity.clockIdentity;
+			msg->management.targetPortIdentity.portNumber =
+				htons(s->targetPortIdentity.portNumber);
+			msg->address = s->addr;
+			sad_update_auth_tlv(clock_config(c), msg);
+			port_forward_to(uds, msg);
+		}
+		return;
+	}
+
+	/*
+	 * Otherwise only the head of the message differs between the
+	 * subscribers. Each of them gets its own copy of the head, the rest
+	 * of the message is shared, and the copies go out in batches.
+	 */
+	len = ntohs(msg->header.messageLength);
 
 	LIST_FOREACH(s, &c->subscribers, list) {
 		if (!event_bitmask_get(s->events, event))
 			continue;
-		/* send event */
-		msg->header.sequenceId = htons(s->sequenceId);
+		head[n] = msg->management;
+		head[n].hdr.sequenceId = htons(s->sequenceId);
 		s->sequenceId++;
-		msg->management.targetPortIdentity.clockIdentity =
+		head[n].targetPortIdentity.clockIdentity =
 			s->targetPortIdentity.clockIdentity;
-		msg->management.targetPortIdentity.portNumber =
+		head[n].targetPortIdentity.portNumber =
 			htons(s->targetPortIdentity.portNumber);
-		msg->address = s->addr;
-		sad_update_auth_tlv(clock_config(c), msg);
-		port_forward_to(uds, msg);
+
+		iov[n][0].iov_base = &head[n];
+		iov[n][0].iov_len = sizeof(head[n]);
+		iov[n][1].iov_base = msg->management.suffix;
+		iov[n][1].iov_len = len - sizeof(head[n]);
+
+		memset(&mmsg[n], 0, sizeof(mmsg[n]));
+		mmsg[n].msg_hdr.msg_name = &s->addr.sa;
+		mmsg[n].msg_hdr.msg_namelen = s->addr.len;
+		mmsg[n].msg_hdr.msg_iov = iov[n];
+		mmsg[n].msg_hdr.msg_iovlen = 2;
+
+		if (++n == NOTIFY_BATCH) {
+			clock_notify_many(uds, msg, mmsg, n);
+			n = 0;
+		}
+	}
+	if (n) {
+		clock_notify_many(uds, msg, mmsg, n);
+	}
+}
+
+static void clock_checkpoint(struct clock *c)
+{
+	struct timespec now;
+	char key[16];
+
+	do_clock_gettime(CLOCK_MONOTONIC, &now);
+	c->warm_saved = now.tv_sec;
+
+	if (c->best && (c->servo_state == SERVO_LOCKED ||
+			c->servo_state == SERVO_LOCKED_STABLE)) {
+		snprintf(key, sizeof(key), "delay.%hu",
+			 port_number(c->best->port));
+		warmstart_set(c->warm, "parent", "%s",
+			      pid2str(&c->best->dataset.sender));
+		warmstart_set(c->warm, "freq", "%.3f",
+			      clockadj_get_freq(c->clkid));
+		warmstart_set(c->warm, key, "%" PRId64,
+			      tmv_to_nanoseconds(c->path_delay));
+	}
+	warmstart_save(c->warm);
+}
+
+/*
+ * Seed the servo and the path delay with the saved state, if the clock
+ * was synchronized to the same parent before the restart.
+ */
+static void clock_warm_start(struct clock *c, struct foreign_clock *best)
+{
+	const char *parent, *freq, *delay;
+	char key[16];
+
+	c->warm_pending = 0;
+	parent = warmstart_get(c->warm, "parent");
+	if (!parent || strcmp(parent, pid2str(&best->dataset.sender))) {
+		return;
+	}
+	freq = warmstart_get(c->warm, "freq");
+	if (freq) {
+		servo_warm_start(c->servo, -atof(freq));
+	}
+	snprintf(key, sizeof(key), "delay.%hu", port_number(best->port));
+	delay = warmstart_get(c->warm, key);
+	if (delay) {
+		c->path_delay = nanoseconds_to_tmv(atoll(delay));
+		tsproc_set_delay(c->tsproc, c->path_delay);
 	}
+	pr_notice("warm start from parent %s, freq %s delay %s", parent,
+		  freq ? freq : "unknown", delay ? delay : "unknown");
 }
 
 void clock_destroy(struct clock *c)
 {
 	struct port *p, *tmp;
 
+	if (c->warm) {
+		clock_checkpoint(c);
+		warmstart_destroy(c->warm);
+	}
 	interface_destroy(c->uds_rw_if);
 	interface_destroy(c->uds_ro_if);
 	clock_flush_subscriptions(c);
@@ -382,6 +537,15 @@ void clock_destroy(struct clock *c)
 		clock_remove_port(c, p);
 	}
 	monitor_destroy(c->slave_event_monitor);
+	if (c->metrics) {
+		metrics_destroy(c->metrics);
+	}
+	if (c->shm) {
+		shm_status_destroy(c->shm);
+	}
+	if (c->holdover) {
+		holdover_destroy(c->holdover);
+	}
 	port_close(c->uds_rw_port);
 	port_close(c->uds_ro_port);
 	free(c->pollfd);
@@ -461,10 +625,11 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 	int datalen = 0;
 	uint8_t key;
 
+	/* Append after any TLVs already present in a bulk response. */
 	extra = calloc(1, sizeof(*extra));
-	extra->tlv = (struct TLV *) rsp->management.suffix;
+	extra->tlv = (struct TLV *) (rsp->data.buffer + rsp->header.messageLength);
 
-	tlv = (struct management_tlv *) rsp->management.suffix;
+	tlv = (struct management_tlv *) extra->tlv;
 	tlv->type = TLV_MANAGEMENT;
 	tlv->id = id;
 
@@ -1474,6 +1639,50 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		return NULL;
 	}
 
+	if (*config_get_string(config, NULL, "metrics_address")) {
+		c->metrics = metrics_create(c,
+			config_get_string(config, NULL, "metrics_address"),
+			config_get_int(config, NULL, "uds_ro_file_mode"));
+		if (!c->metrics) {
+			pr_err("failed to create the metrics socket");
+			return NULL;
+		}
+		clock_fda_changed(c);
+	}
+
+	if (*config_get_string(config, NULL, "status_shm")) {
+		c->shm = shm_status_create(config_get_string(config, NULL,
+								"status_shm"));
+		if (!c->shm) {
+			pr_err("failed to create the shared status page");
+			return NULL;
+		}
+		c->shm_dirty = 1;
+	}
+
+	if (!c->free_running &&
+	    *config_get_string(config, NULL, "holdover_file")) {
+		c->holdover = holdover_create(config_get_string(config, NULL,
+								"holdover_file"),
+					      servo_max_freq(c->servo));
+		if (!c->holdover) {
+			pr_err("failed to create the holdover model");
+			return NULL;
+		}
+	}
+
+	if (*config_get_string(config, NULL, "state_file")) {
+		c->warm = warmstart_create(config_get_string(config, NULL,
+							     "state_file"));
+		if (!c->warm) {
+			pr_err("failed to create the state store");
+			return NULL;
+		}
+		c->warm_pending = !c->free_running;
+		do_clock_gettime(CLOCK_MONOTONIC, &ts);
+		c->warm_saved = ts.tv_sec;
+	}
+
 	/* Create the ports. */
 	STAILQ_FOREACH(iface, &config->interfaces, list) {
 		if (clock_add_port(c, phc_device, phc_index, timestamping, iface)) {
@@ -1562,7 +1771,7 @@ static int clock_resize_pollfd(struct clock *c, int new_nports)
 
 	/* Need to allocate two whole extra blocks of fds for UDS ports. */
 	new_pollfd = realloc(c->pollfd,
-			     (new_nports + 2) * N_CLOCK_PFD *
+			     ((new_nports + 2) * N_CLOCK_PFD + N_EXTRA_PFD) *
 			     sizeof(struct pollfd));
 	if (!new_pollfd) {
 		return -1;
@@ -1600,6 +1809,12 @@ static void clock_check_pollfd(struct clock *c)
 	clock_fill_pollfd(dest, c->uds_rw_port);
 	dest += N_CLOCK_PFD;
 	clock_fill_pollfd(dest, c->uds_ro_port);
+	dest += N_CLOCK_PFD;
+	dest->fd = c->metrics ? metrics_fd(c->metrics) : -1;
+	dest->events = POLLIN;
+	dest++;
+	dest->fd = c->metrics ? metrics_reply_fd(c->metrics) : -1;
+	dest->events = POLLOUT;
 	c->pollfd_valid = 1;
 }
 
@@ -1652,6 +1867,7 @@ static void clock_forward_mgmt_msg(struct clock *c, struct port *p, struct ptp_m
 		if (clock_do_forward_mgmt(c, p, c->uds_rw_port, msg, &msg_ready))
 			pr_debug("uds port: management forward failed");
 		if (msg_ready) {
+			/* The TLVs were checked before, convert them back. */
 			msg_post_recv(msg, pdulen);
 			msg->management.boundaryHops++;
 		}
@@ -1663,6 +1879,129 @@ tmv_t clock_ingress_time(struct clock *c)
 	return c->ingress_ts;
 }
 
+/* Clock level IDs, which are answered by the clock and not the ports. */
+static int clock_management_id(int id)
+{
+	switch (id) {
+	case MID_C_USER_DESCRIPTION:
+	case MID_C_SAVE_IN_NON_VOLATILE_STORAGE:
+	case MID_C_RESET_NON_VOLATILE_STORAGE:
+	case MID_C_INITIALIZE:
+	case MID_C_FAULT_LOG:
+	case MID_C_FAULT_LOG_RESET:
+	case MID_C_DEFAULT_DATA_SET:
+	case MID_C_CURRENT_DATA_SET:
+	case MID_C_PARENT_DATA_SET:
+	case MID_C_TIME_PROPERTIES_DATA_SET:
+	case MID_C_PRIORITY1:
+	case MID_C_PRIORITY2:
+	case MID_C_DOMAIN:
+	case MID_C_SLAVE_ONLY:
+	case MID_C_TIME:
+	case MID_C_CLOCK_ACCURACY:
+	case MID_C_UTC_PROPERTIES:
+	case MID_C_TRACEABILITY_PROPERTIES:
+	case MID_C_TIMESCALE_PROPERTIES:
+	case MID_C_PATH_TRACE_LIST:
+	case MID_C_PATH_TRACE_ENABLE:
+	case MID_C_GRANDMASTER_CLUSTER_TABLE:
+	case MID_C_ACCEPTABLE_MASTER_TABLE:
+	case MID_C_ACCEPTABLE_MASTER_MAX_TABLE_SIZE:
+	case MID_C_ALTERNATE_TIME_OFFSET_MAX_KEY:
+	case MID_C_TRANSPARENT_CLOCK_DEFAULT_DATA_SET:
+	case MID_C_PRIMARY_DOMAIN:
+	case MID_C_TIME_STATUS_NP:
+	case MID_C_GRANDMASTER_SETTINGS_NP:
+	case MID_C_SUBSCRIBE_EVENTS_NP:
+	case MID_C_SYNCHRONIZATION_UNCERTAIN_NP:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Answer a GET which lists several management IDs. The clock level
+ * TLVs go into responses from the ingress port, the port level TLVs
+ * into one series of responses per target port.
+ */
+static void clock_manage_bulk(struct clock *c, struct port *p,
+			      struct ptp_message *req)
+{
+	int i, answers = 0, n_ids = 0, n_port_ids = 0, ids[MAX_BULK_IDS],
+		port_ids[MAX_BULK_IDS];
+	struct ptp_message *rsp = NULL;
+	struct management_tlv *mgt;
+	struct tlv_extra *extra;
+	struct port *piter;
+
+	TAILQ_FOREACH(extra, &req->tlv_list, list) {
+		if (extra->tlv->type == TLV_AUTHENTICATION) {
+			continue;
+		}
+		if (extra->tlv->type != TLV_MANAGEMENT) {
+			clock_management_send_error(p, req, MID_E_WRONG_VALUE);
+			return;
+		}
+		if (n_ids == MAX_BULK_IDS) {
+			clock_management_send_error(p, req,
+						    MID_E_RESPONSE_TOO_BIG);
+			return;
+		}
+		mgt = (struct management_tlv *) extra->tlv;
+		ids[n_ids++] = mgt->id;
+	}
+
+	for (i = 0; i < n_ids; i++) {
+		if (rsp && !port_management_bulk_fits(rsp, ids[i])) {
+			port_prepare_and_send(p, rsp, TRANS_GENERAL);
+			msg_put(rsp);
+			rsp = NULL;
+		}
+		if (!rsp) {
+			rsp = port_management_reply(port_identity(p), p, req);
+			if (!rsp) {
+				return;
+			}
+		}
+		switch (ids[i]) {
+		case MID_P_PORT_PROPERTIES_NP:
+		case MID_P_PORT_HWCLOCK_NP:
+			/* Only the UDS-RW port allowed. */
+			if (p != c->uds_rw_port) {
+				port_management_append_error(rsp, ids[i],
+							     MID_E_NOT_SUPPORTED);
+				continue;
+			}
+		}
+		if (clock_management_fill_response(c, p, req, rsp, ids[i])) {
+			continue;
+		}
+		if (clock_management_id(ids[i])) {
+			port_management_append_error(rsp, ids[i],
+						     MID_E_NOT_SUPPORTED);
+		} else {
+			port_ids[n_port_ids++] = ids[i];
+		}
+	}
+	if (rsp) {
+		if (rsp->header.messageLength > sizeof(struct management_msg)) {
+			port_prepare_and_send(p, rsp, TRANS_GENERAL);
+		}
+		msg_put(rsp);
+	}
+
+	if (!n_port_ids) {
+		return;
+	}
+	LIST_FOREACH(piter, &c->ports, list) {
+		answers += port_manage_bulk(piter, p, req, port_ids,
+					    &n_port_ids);
+	}
+	if (!answers) {
+		clock_management_send_error(p, req, MID_E_WRONG_VALUE);
+	}
+}
+
 int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 {
 	int changed = 0, res, answers;
@@ -1673,6 +2012,12 @@ int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 		{0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}
 	};
 
+	/* A message with malformed TLVs is neither forwarded nor applied. */
+	if (msg_tlv_decode(msg)) {
+		pr_err("%s: bad management message", port_log_name(p));
+		return changed;
+	}
+
 	/* Forward this message out all eligible ports. */
 	clock_forward_mgmt_msg(c, p, msg);
 
@@ -1690,6 +2035,9 @@ int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 			break;
 		}
 	default:
+		if (management_action(msg) == GET) {
+			clock_manage_bulk(c, p, msg);
+		}
 		return changed;
 	}
 	mgt = (struct management_tlv *) msg->management.suffix;
@@ -1739,41 +2087,9 @@ int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 		}
 	}
 
-	switch (mgt->id) {
-	case MID_C_USER_DESCRIPTION:
-	case MID_C_SAVE_IN_NON_VOLATILE_STORAGE:
-	case MID_C_RESET_NON_VOLATILE_STORAGE:
-	case MID_C_INITIALIZE:
-	case MID_C_FAULT_LOG:
-	case MID_C_FAULT_LOG_RESET:
-	case MID_C_DEFAULT_DATA_SET:
-	case MID_C_CURRENT_DATA_SET:
-	case MID_C_PARENT_DATA_SET:
-	case MID_C_TIME_PROPERTIES_DATA_SET:
-	case MID_C_PRIORITY1:
-	case MID_C_PRIORITY2:
-	case MID_C_DOMAIN:
-	case MID_C_SLAVE_ONLY:
-	case MID_C_TIME:
-	case MID_C_CLOCK_ACCURACY:
-	case MID_C_UTC_PROPERTIES:
-	case MID_C_TRACEABILITY_PROPERTIES:
-	case MID_C_TIMESCALE_PROPERTIES:
-	case MID_C_PATH_TRACE_LIST:
-	case MID_C_PATH_TRACE_ENABLE:
-	case MID_C_GRANDMASTER_CLUSTER_TABLE:
-	case MID_C_ACCEPTABLE_MASTER_TABLE:
-	case MID_C_ACCEPTABLE_MASTER_MAX_TABLE_SIZE:
-	case MID_C_ALTERNATE_TIME_OFFSET_MAX_KEY:
-	case MID_C_TRANSPARENT_CLOCK_DEFAULT_DATA_SET:
-	case MID_C_PRIMARY_DOMAIN:
-	case MID_C_TIME_STATUS_NP:
-	case MID_C_GRANDMASTER_SETTINGS_NP:
-	case MID_C_SUBSCRIBE_EVENTS_NP:
-	case MID_C_SYNCHRONIZATION_UNCERTAIN_NP:
+	if (clock_management_id(mgt->id)) {
 		clock_management_send_error(p, msg, MID_E_NOT_SUPPORTED);
-		break;
-	default:
+	} else {
 		answers = 0;
 		LIST_FOREACH(piter, &c->ports, list) {
 			res = port_manage(piter, p, msg);
@@ -1787,7 +2103,6 @@ int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 			 * MID_E_WRONG_VALUE for ports that do not exist */
 			clock_management_send_error(p, msg, MID_E_WRONG_VALUE);
 		}
-		break;
 	}
 	return changed;
 }
@@ -1844,16 +2159,29 @@ void clock_set_sde(struct clock *c, int sde)
 	c->sde = sde;
 }
 
+static void clock_holdover(struct clock *c)
+{
+	double freq;
+
+	if (!c->holdover || !holdover_update(c->holdover, &freq)) {
+		return;
+	}
+	if (clockadj_set_freq(c->clkid, freq)) {
+		pr_err("failed to apply the holdover frequency");
+	}
+}
+
 int clock_poll(struct clock *c)
 {
 	int cnt, i;
 	enum port_state prior_state;
 	enum fsm_event event;
+	struct timespec now;
 	struct pollfd *cur;
 	struct port *p;
 
 	clock_check_pollfd(c);
-	cnt = poll(c->pollfd, (c->nports + 2) * N_CLOCK_PFD, -1);
+	cnt = poll(c->pollfd, (c->nports + 2) * N_CLOCK_PFD + N_EXTRA_PFD, -1);
 	if (cnt < 0) {
 		if (EINTR == errno) {
 			return 0;
@@ -1926,12 +2254,29 @@ int clock_poll(struct clock *c)
 			/* sde is not expected on the UDS-RO port */
 		}
 	}
+	cur += N_CLOCK_PFD;
+	if (cur[1].revents & (POLLOUT|POLLERR|POLLHUP)) {
+		metrics_write(c->metrics);
+	}
+	if (cur[0].revents & POLLIN) {
+		metrics_serve(c->metrics);
+	}
 
 	if (c->sde) {
 		handle_state_decision_event(c);
 		c->sde = 0;
 	}
 	clock_prune_subscriptions(c);
+	if (c->shm && c->shm_dirty) {
+		clock_publish_status(c);
+	}
+	clock_holdover(c);
+	if (c->warm) {
+		do_clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec - c->warm_saved >= WARMSTART_INTERVAL) {
+			clock_checkpoint(c);
+		}
+	}
 	return 0;
 }
 
@@ -1944,6 +2289,9 @@ void clock_path_delay(struct clock *c, tmv_t req, tmv_t rx)
 
 	c->cur.meanPathDelay = tmv_to_TimeInterval(c->path_delay);
 
+	if (c->metrics) {
+		metrics_delay(c->metrics, tmv_to_nanoseconds(c->path_delay));
+	}
 	if (c->stats.delay)
 		stats_add_value(c->stats.delay, tmv_dbl(c->path_delay));
 }
@@ -1957,6 +2305,9 @@ void clock_peer_delay(struct clock *c, tmv_t ppd, tmv_t req, tmv_t rx,
 	tsproc_set_delay(c->tsproc, ppd);
 	tsproc_up_ts(c->tsproc, req, rx);
 
+	if (c->metrics) {
+		metrics_delay(c->metrics, tmv_to_nanoseconds(ppd));
+	}
 	if (c->stats.delay)
 		stats_add_value(c->stats.delay, tmv_dbl(ppd));
 }
@@ -2060,6 +2411,8 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 	double adj, weight;
 	int64_t offset;
 
+	c->shm_dirty = 1;
+
 	if (c->step_window_counter) {
 		c->step_window_counter--;
 		pr_debug("skip sync after jump %d/%d",
@@ -2093,8 +2446,18 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 	}
 
 	offset = tmv_to_nanoseconds(c->master_offset);
+	if (c->metrics) {
+		metrics_offset(c->metrics, offset);
+	}
+	if (c->holdover) {
+		holdover_reference(c->holdover, offset);
+	}
 	adj = servo_sample(c->servo, offset, tmv_to_nanoseconds(ingress),
 			   weight, &state);
+	if (state != c->servo_state) {
+		evlog_event(EVLOG_SERVO_STATE, 0, c->servo_state, state, 0,
+			    offset, NULL);
+	}
 	c->servo_state = state;
 
 	tsproc_set_clock_rate_ratio(c->tsproc, clock_rate_ratio(c));
@@ -2122,6 +2485,9 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 		if (clock_synchronize_locked(c, adj)) {
 			goto servo_unlock;
 		}
+		if (c->holdover) {
+			holdover_learn(c->holdover, -adj);
+		}
 		break;
 	case SERVO_LOCKED_STABLE:
 		if (c->write_phase_mode) {
@@ -2133,6 +2499,9 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 			if (clock_synchronize_locked(c, adj)) {
 				goto servo_unlock;
 			}
+			if (c->holdover) {
+				holdover_learn(c->holdover, -adj);
+			}
 		}
 		break;
 	}
@@ -2152,6 +2521,8 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 
 servo_unlock:
 	servo_reset(c->servo);
+	evlog_event(EVLOG_SERVO_STATE, 0, c->servo_state, SERVO_UNLOCKED, 0,
+		    offset, NULL);
 	c->servo_state = SERVO_UNLOCKED;
 	return SERVO_UNLOCKED;
 }
@@ -2239,6 +2610,7 @@ struct timePropertiesDS clock_time_properties(struct clock *c)
 
 void clock_update_time_properties(struct clock *c, struct timePropertiesDS tds)
 {
+	c->shm_dirty = 1;
 	if ((tds.flags ^ c->tds.flags) & (LEAP_61 | LEAP_59)) {
 		pr_info("updating time properties to %s leap second",
 			tds.flags & (LEAP_61 | LEAP_59) ?
@@ -2261,6 +2633,8 @@ static void handle_state_decision_event(struct clock *c)
 	struct port *piter;
 	int fresh_best = 0;
 
+	c->shm_dirty = 1;
+
 	LIST_FOREACH(piter, &c->ports, list) {
 		fc = port_compute_best(piter);
 		if (!fc)
@@ -2286,9 +2660,16 @@ static void handle_state_decision_event(struct clock *c)
 		}
 		c->ingress_ts = tmv_zero();
 		c->path_delay = c->initial_delay;
+		if (best && c->warm_pending) {
+			clock_warm_start(c, best);
+		}
 		c->master_local_rr = 1.0;
 		c->nrr = 1.0;
 		fresh_best = 1;
+		evlog_event(EVLOG_BEST_MASTER,
+			    best ? port_number(best->port) : 0, 0, 0,
+			    cid_eq(&best_id, &c->dds.clockIdentity), 0,
+			    &best_id);
 		if (cid_eq(&best_id, &c->dds.clockIdentity)) {
 			pr_notice("selected local clock %s as best master",
 					cid2str(&best_id));
@@ -396,6 +396,4 @@ void clock_check_ts(struct clock *c, uint64_t ts);
  */
 double clock_rate_ratio(struct clock *c);
 
-int do_clock_gettime(clockid_t clk_id, struct timespec *tp);
-
 #endif
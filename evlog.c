@@ -0,0 +1,139 @@
+/**
+ * @file evlog.c
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "evlog.h"
+#include "print.h"
+
+static struct evlog_header *evlog;
+static struct evlog_record *records;
+static size_t evlog_len;
+
+static const char *evlog_str[EVLOG_CNT] = {
+	"PORT_STATE",
+	"FAULT",
+	"BEST_MASTER",
+	"SERVO_STATE",
+	"GRANT_RX",
+	"GRANT_TX",
+};
+
+static int evlog_valid(struct evlog_header *hdr, unsigned int capacity)
+{
+	return !memcmp(hdr->magic, EVLOG_MAGIC, sizeof(hdr->magic)) &&
+		hdr->version == EVLOG_VERSION &&
+		hdr->record_size == sizeof(struct evlog_record) &&
+		hdr->capacity == capacity;
+}
+
+int evlog_open(const char *path, unsigned int capacity)
+{
+	struct evlog_header *hdr;
+	struct stat st;
+	size_t len;
+	int fd;
+
+	if (evlog || !capacity) {
+		return -1;
+	}
+	len = sizeof(*hdr) + capacity * sizeof(struct evlog_record);
+
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		pr_err("failed to open %s: %m", path);
+		return -1;
+	}
+	if (fstat(fd, &st)) {
+		pr_err("failed to stat %s: %m", path);
+		goto no_map;
+	}
+	if (st.st_size != len && ftruncate(fd, len)) {
+		pr_err("failed to resize %s: %m", path);
+		goto no_map;
+	}
+	hdr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		pr_err("failed to map %s: %m", path);
+		goto no_map;
+	}
+	close(fd);
+
+	if (st.st_size != len || !evlog_valid(hdr, capacity)) {
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->version = EVLOG_VERSION;
+		hdr->record_size = sizeof(struct evlog_record);
+		hdr->capacity = capacity;
+		hdr->count = 0;
+		memcpy(hdr->magic, EVLOG_MAGIC, sizeof(hdr->magic));
+	}
+
+	evlog = hdr;
+	evlog_len = len;
+	records = (struct evlog_record *) (hdr + 1);
+	return 0;
+
+no_map:
+	close(fd);
+	return -1;
+}
+
+void evlog_close(void)
+{
+	if (!evlog) {
+		return;
+	}
+	msync(evlog, evlog_len, MS_ASYNC);
+	munmap(evlog, evlog_len);
+	evlog = NULL;
+	records = NULL;
+}
+
+void evlog_event(enum evlog_event event, uint16_t port, int old_state,
+		 int new_state, int reason, int64_t value,
+		 struct ClockIdentity *id)
+{
+	struct evlog_record *rec;
+	struct timespec ts;
+	uint64_t count;
+
+	if (!evlog) {
+		return;
+	}
+	do_clock_gettime(CLOCK_REALTIME, &ts);
+
+	count = evlog->count;
+	rec = &records[count % evlog->capacity];
+	rec->ts = ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+	rec->value = value;
+	if (id) {
+		rec->id = *id;
+	} else {
+		memset(&rec->id, 0, sizeof(rec->id));
+	}
+	rec->port = port;
+	rec->event = event;
+	rec->old_state = old_state;
+	rec->new_state = new_state;
+	rec->reason = reason;
+	rec->reserved = 0;
+
+	/* Publish the record only after it has been completely written. */
+	__atomic_store_n(&evlog->count, count + 1, __ATOMIC_RELEASE);
+}
+
+const char *evlog_event_str(int event)
+{
+	if (event < 0 || event >= EVLOG_CNT) {
+		return "UNKNOWN";
+	}
+	return evlog_str[event];
+}
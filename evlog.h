@@ -0,0 +1,98 @@
+/**
+ * @file evlog.h
+ * @brief Binary log of state transitions and faults.
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#ifndef HAVE_EVLOG_H
+#define HAVE_EVLOG_H
+
+#include <stdint.h>
+
+#include "ddt.h"
+
+#define EVLOG_MAGIC	"PTPEVLOG"
+#define EVLOG_VERSION	1
+
+/**
+ * Defines the kinds of events kept in the log.
+ */
+enum evlog_event {
+	/** Port state change, reason is the fsm_event. */
+	EVLOG_PORT_STATE,
+	/** Fault detected on a port, reason is the fault_type. */
+	EVLOG_FAULT,
+	/** New best master selected, id is its clock identity. */
+	EVLOG_BEST_MASTER,
+	/** Servo state change, value is the offset in nanoseconds. */
+	EVLOG_SERVO_STATE,
+	/** Unicast grant received, reason is the message type and
+	    value the duration. A duration of zero is a denial. */
+	EVLOG_GRANT_RX,
+	/** Unicast grant sent, fields as for EVLOG_GRANT_RX. */
+	EVLOG_GRANT_TX,
+	EVLOG_CNT,
+};
+
+/**
+ * The log file starts with this header, followed by 'capacity'
+ * records. The records form a ring, the next record to be written
+ * is found at index (count % capacity). All fields are in host
+ * byte order.
+ */
+struct evlog_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t capacity;
+	uint64_t count;
+	uint8_t reserved[32];
+};
+
+struct evlog_record {
+	uint64_t ts;			/* CLOCK_REALTIME, nanoseconds */
+	int64_t value;
+	struct ClockIdentity id;
+	uint16_t port;
+	uint8_t event;
+	uint8_t old_state;
+	uint8_t new_state;
+	uint8_t reason;
+	uint16_t reserved;
+};
+
+/**
+ * Open the event log. An existing log of the same capacity is
+ * appended to, otherwise the file is created or reinitialized.
+ * @param path      Path of the log file.
+ * @param capacity  Number of records kept in the file.
+ * @return Zero on success, non-zero otherwise.
+ */
+int evlog_open(const char *path, unsigned int capacity);
+
+/**
+ * Close the event log.
+ */
+void evlog_close(void);
+
+/**
+ * Append a record to the event log. Does nothing if the log is not open.
+ * @param event      The kind of event, one of @ref evlog_event.
+ * @param port       Port number, or zero for clock wide events.
+ * @param old_state  Previous state.
+ * @param new_state  New state.
+ * @param reason     Event specific reason code.
+ * @param value      Event specific value.
+ * @param id         Optional clock identity, may be NULL.
+ */
+void evlog_event(enum evlog_event event, uint16_t port, int old_state,
+		 int new_state, int reason, int64_t value,
+		 struct ClockIdentity *id);
+
+/**
+ * Obtain a human readable name of an event.
+ * @param event  The kind of event.
+ * @return A string, never NULL.
+ */
+const char *evlog_event_str(int event);
+
+#endif
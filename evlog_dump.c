@@ -0,0 +1,185 @@
+/**
+ * @file evlog_dump.c
+ * @brief Utility program to decode the binary event log.
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "evlog.h"
+#include "fault.h"
+#include "fsm.h"
+#include "servo.h"
+#include "util.h"
+#include "version.h"
+
+static const char *servo_state_str(int state)
+{
+	switch (state) {
+	case SERVO_UNLOCKED:
+		return "UNLOCKED";
+	case SERVO_JUMP:
+		return "JUMP";
+	case SERVO_LOCKED:
+		return "LOCKED";
+	case SERVO_LOCKED_STABLE:
+		return "LOCKED_STABLE";
+	}
+	return "UNKNOWN";
+}
+
+static const char *port_state_str(int state)
+{
+	if (state < PS_INITIALIZING || state > PS_SLAVE) {
+		return "UNKNOWN";
+	}
+	return ps_str[state];
+}
+
+static const char *fsm_event_str(int event)
+{
+	if (event < EV_NONE || event > EV_RS_PASSIVE) {
+		return "UNKNOWN";
+	}
+	return ev_str[event];
+}
+
+static void show_record(struct evlog_record *rec)
+{
+	uint64_t sec = rec->ts / NS_PER_SEC, nsec = rec->ts % NS_PER_SEC;
+
+	printf("%" PRIu64 ".%09" PRIu64 " port %hu %s", sec, nsec, rec->port,
+	       evlog_event_str(rec->event));
+
+	switch (rec->event) {
+	case EVLOG_PORT_STATE:
+		printf(" %s to %s on %s",
+		       port_state_str(rec->old_state),
+		       port_state_str(rec->new_state),
+		       fsm_event_str(rec->reason));
+		if (rec->reason == EV_FAULT_DETECTED) {
+			printf(" (%s)", ft_str(rec->value));
+		}
+		break;
+	case EVLOG_FAULT:
+		printf(" %s", ft_str(rec->reason));
+		break;
+	case EVLOG_BEST_MASTER:
+		printf(" %s%s", cid2str(&rec->id),
+		       rec->reason ? " (local)" : "");
+		break;
+	case EVLOG_SERVO_STATE:
+		printf(" %s to %s offset %" PRId64,
+		       servo_state_str(rec->old_state),
+		       servo_state_str(rec->new_state), rec->value);
+		break;
+	case EVLOG_GRANT_RX:
+	case EVLOG_GRANT_TX:
+		printf(" %s message type 0x%x duration %" PRId64,
+		       cid2str(&rec->id), rec->reason, rec->value);
+		break;
+	default:
+		printf(" old %u new %u reason %u value %" PRId64,
+		       rec->old_state, rec->new_state, rec->reason,
+		       rec->value);
+		break;
+	}
+	printf("\n");
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\n"
+		"usage: %s [options] file\n\n"
+		" -h        prints this message and exits\n"
+		" -n [num]  show only the last 'num' records\n"
+		" -v        prints the software version and exits\n"
+		"\n",
+		progname);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t count, first, i, last = 0;
+	struct evlog_record *records;
+	struct evlog_header *hdr;
+	char *progname;
+	struct stat st;
+	int c, fd;
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1+progname : argv[0];
+	while (EOF != (c = getopt(argc, argv, "hn:v"))) {
+		switch (c) {
+		case 'n':
+			last = strtoull(optarg, NULL, 0);
+			break;
+		case 'v':
+			version_show(stdout);
+			return 0;
+		case 'h':
+			usage(progname);
+			return 0;
+		case '?':
+		default:
+			usage(progname);
+			return -1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(progname);
+		return -1;
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+		perror("open");
+		return -1;
+	}
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		close(fd);
+		return -1;
+	}
+	if (st.st_size < sizeof(*hdr)) {
+		fprintf(stderr, "%s: file too short\n", argv[optind]);
+		close(fd);
+		return -1;
+	}
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	if (memcmp(hdr->magic, EVLOG_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != EVLOG_VERSION ||
+	    hdr->record_size != sizeof(struct evlog_record) ||
+	    !hdr->capacity ||
+	    st.st_size < sizeof(*hdr) + hdr->capacity * hdr->record_size) {
+		fprintf(stderr, "%s: not a valid event log\n", argv[optind]);
+		munmap(hdr, st.st_size);
+		return -1;
+	}
+	records = (struct evlog_record *) (hdr + 1);
+
+	count = __atomic_load_n(&hdr->count, __ATOMIC_ACQUIRE);
+	first = count > hdr->capacity ? count - hdr->capacity : 0;
+	if (last && count - first > last) {
+		first = count - last;
+	}
+	for (i = first; i < count; i++) {
+		show_record(&records[i % hdr->capacity]);
+	}
+
+	munmap(hdr, st.st_size);
+	return 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * @file fuzz_msg.c
+ * @brief Fuzzing entry and benchmark for the message codec
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Built normally, the program replays the frames named on the command
+ * line through the fuzzing entry, or with -b measures the decode and
+ * encode rates per message type, both for the eager decoding and for
+ * the lazy one with and without the deferred TLV conversion.  Built with
+ *
+ *   make CC=clang EXTRA_CFLAGS="-g -fsanitize=fuzzer,address -DLIBFUZZER" \
+ *        EXTRA_LDFLAGS=-fsanitize=fuzzer,address fuzz_msg
+ *
+ * it is a libFuzzer target which takes corpus/msg as its seed corpus.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msg.h"
+#include "print.h"
+#include "util.h"
+#include "version.h"
+
+/* Messages decoded or encoded between two readings of the clock. */
+#define BENCH_BATCH		256
+#define BENCH_TYPES		16
+
+struct bench {
+	unsigned int frames;
+	unsigned long msgs;
+	double decode;
+	double encode;
+	double lazy;
+	double lazy_decode;
+};
+
+static struct bench bench[BENCH_TYPES];
+static struct ptp_message *batch[BENCH_BATCH];
+
+static struct ptp_message *frame_load(const uint8_t *data, size_t size)
+{
+	struct ptp_message *msg;
+
+	msg = msg_allocate();
+	memcpy(msg->data.buffer, data, size);
+	return msg;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	print_set_verbose(0);
+	print_set_syslog(0);
+	print_set_level(PRINT_LEVEL_MIN);
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct ptp_message *eager, *lazy;
+	int err_eager, err_lazy;
+
+	/* The transports never deliver more than the buffer holds. */
+	if (size > sizeof(eager->data)) {
+		return 0;
+	}
+
+	eager = frame_load(data, size);
+	err_eager = msg_post_recv(eager, size);
+	if (!err_eager) {
+		err_eager = msg_pre_send(eager);
+	}
+
+	lazy = frame_load(data, size);
+	err_lazy = msg_post_recv_lazy(lazy, size);
+	if (!err_lazy) {
+		err_lazy = msg_tlv_decode(lazy);
+	}
+	if (!err_lazy) {
+		err_lazy = msg_pre_send(lazy);
+	}
+
+	/*
+	 * Deferring the TLV conversion must neither change which frames
+	 * are accepted nor the bytes sent when they are forwarded.
+	 */
+	if (!err_eager != !err_lazy) {
+		fprintf(stderr, "eager decode %d, lazy decode %d\n",
+			err_eager, err_lazy);
+		abort();
+	}
+	if (!err_eager &&
+	    memcmp(&eager->data, &lazy->data, sizeof(eager->data))) {
+		fprintf(stderr, "eager and lazy encodings differ\n");
+		abort();
+	}
+	msg_put(lazy);
+
+	/* Feed the encoding back through the receive path. */
+	if (!err_eager) {
+		lazy = frame_load(eager->data.buffer, size);
+		msg_post_recv(lazy, size);
+		msg_put(lazy);
+	}
+	msg_put(eager);
+
+	return 0;
+}
+
+#ifndef LIBFUZZER
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void batch_load(const uint8_t *data, size_t size)
+{
+	int i;
+
+	for (i = 0; i < BENCH_BATCH; i++) {
+		batch[i] = frame_load(data, size);
+	}
+}
+
+static void batch_put(void)
+{
+	int i;
+
+	for (i = 0; i < BENCH_BATCH; i++) {
+		msg_put(batch[i]);
+	}
+}
+
+static int bench_frame(const uint8_t *data, size_t size, int rounds)
+{
+	struct ptp_message *msg;
+	double t0, t1, t2;
+	struct bench *b;
+	int err, i, n;
+
+	if (size < 1 || size > sizeof(msg->data)) {
+		return -1;
+	}
+	msg = frame_load(data, size);
+	err = msg_post_recv(msg, size);
+	msg_put(msg);
+	if (err) {
+		return err;
+	}
+	b = &bench[data[0] & 0xf];
+
+	for (n = 0; n < rounds; n++) {
+		batch_load(data, size);
+		t0 = bench_now();
+		for (i = 0; i < BENCH_BATCH; i++) {
+			msg_post_recv(batch[i], size);
+		}
+		t1 = bench_now();
+		for (i = 0; i < BENCH_BATCH; i++) {
+			msg_pre_send(batch[i]);
+		}
+		t2 = bench_now();
+		batch_put();
+		b->decode += t1 - t0;
+		b->encode += t2 - t1;
+
+		batch_load(data, size);
+		t0 = bench_now();
+		for (i = 0; i < BENCH_BATCH; i++) {
+			msg_post_recv_lazy(batch[i], size);
+		}
+		t1 = bench_now();
+		for (i = 0; i < BENCH_BATCH; i++) {
+			msg_tlv_decode(batch[i]);
+		}
+		t2 = bench_now();
+		batch_put();
+		b->lazy += t1 - t0;
+		b->lazy_decode += t2 - t0;
+		b->msgs += BENCH_BATCH;
+	}
+	b->frames++;
+	return 0;
+}
+
+static void bench_report(void)
+{
+	struct bench *b;
+	int type;
+
+	printf("%-24s %8s %12s %12s %12s %12s\n", "type", "frames",
+	       "decode/s", "encode/s", "lazy/s", "lazy+tlv/s");
+	for (type = 0; type < BENCH_TYPES; type++) {
+		b = &bench[type];
+		if (!b->frames) {
+			continue;
+		}
+		printf("%-24s %8u %12.0f %12.0f %12.0f %12.0f\n",
+		       msg_type_string(type), b->frames,
+		       b->msgs / b->decode, b->msgs / b->encode,
+		       b->msgs / b->lazy, b->msgs / b->lazy_decode);
+	}
+}
+
+static int read_frame(const char *path, uint8_t *buf, size_t *size)
+{
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	*size = fread(buf, 1, *size, fp);
+	fclose(fp);
+	return 0;
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\nusage: %s [options] frame [frame ...]\n\n"
+		" -b        measure eager and lazy decode rates and the encode\n"
+		"           rate per message type\n"
+		" -h        prints this message and exits\n"
+		" -n [num]  batches of %d messages per frame, default 100\n"
+		" -v        prints the software version and exits\n"
+		"\n",
+		progname, BENCH_BATCH);
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t buf[sizeof(struct message_data) + 1];
+	int benchmark = 0, c, i, rounds = 100;
+	char *progname;
+	size_t size;
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1+progname : argv[0];
+	while (EOF != (c = getopt(argc, argv, "bhn:v"))) {
+		switch (c) {
+		case 'b':
+			benchmark = 1;
+			break;
+		case 'n':
+			if (get_arg_val_i(c, optarg, &rounds, 1, INT_MAX)) {
+				return -1;
+			}
+			break;
+		case 'v':
+			version_show(stdout);
+			return 0;
+		case 'h':
+			usage(progname);
+			return 0;
+		case '?':
+		default:
+			usage(progname);
+			return -1;
+		}
+	}
+	if (optind == argc) {
+		usage(progname);
+		return -1;
+	}
+	LLVMFuzzerInitialize(&argc, &argv);
+
+	for (i = optind; i < argc; i++) {
+		size = sizeof(buf);
+		if (read_frame(argv[i], buf, &size)) {
+			return -1;
+		}
+		if (!benchmark) {
+			LLVMFuzzerTestOneInput(buf, size);
+		} else if (bench_frame(buf, size, rounds)) {
+			fprintf(stderr, "%s: not a valid frame, skipped\n",
+				argv[i]);
+		}
+	}
+	if (benchmark) {
+		bench_report();
+	} else {
+		printf("%d frames replayed\n", argc - optind);
+	}
+	return 0;
+}
+
+#endif
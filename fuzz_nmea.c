@@ -0,0 +1,222 @@
+/**
+ * @file fuzz_nmea.c
+ * @brief Fuzzing entry and benchmark for the NMEA parser
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Built normally, the program replays the files named on the command
+ * line through the fuzzing entry, or with -b measures the parsing rate
+ * over their concatenation.  Built with
+ *
+ *   make CC=clang EXTRA_CFLAGS="-g -fsanitize=fuzzer,address -DLIBFUZZER" \
+ *        EXTRA_LDFLAGS=-fsanitize=fuzzer,address fuzz_nmea
+ *
+ * it is a libFuzzer target which takes corpus/nmea as its seed corpus.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nmea.h"
+#include "print.h"
+#include "util.h"
+#include "version.h"
+
+/* The size of the reads done by the NMEA PPS source. */
+#define BENCH_CHUNK	4096
+/* Longer inputs only slow the byte by byte split down. */
+#define FUZZ_MAX_INPUT	(1 << 16)
+
+/*
+ * Feed the input to a new parser in pieces of 'chunk' bytes, like
+ * reads from a serial port which cut the sentences anywhere.
+ */
+static int parse_chunks(const char *buf, int len, int chunk)
+{
+	struct nmea_status status;
+	struct nmea_parser *np;
+	int left, n, parsed, results = 0;
+
+	np = nmea_parser_create();
+	if (!np) {
+		abort();
+	}
+	for (; len > 0; buf += n, len -= n) {
+		n = len < chunk ? len : chunk;
+		for (left = n; left; left -= parsed) {
+			if (!nmea_parse(np, buf + n - left, left,
+					&status, &parsed)) {
+				if (parsed < 1 || parsed > left) {
+					fprintf(stderr, "parsed %d of %d\n",
+						parsed, left);
+					abort();
+				}
+				results++;
+			} else if (parsed != left) {
+				fprintf(stderr, "parsed %d of %d\n",
+					parsed, left);
+				abort();
+			}
+		}
+	}
+	nmea_parser_destroy(np);
+	return results;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	print_set_verbose(0);
+	print_set_syslog(0);
+	print_set_level(PRINT_LEVEL_MIN);
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (!size || size > FUZZ_MAX_INPUT) {
+		return 0;
+	}
+	/* The first byte also picks one of the splits. */
+	parse_chunks((const char *) data, size, size);
+	parse_chunks((const char *) data, size, 1 + data[0]);
+	parse_chunks((const char *) data, size, 1);
+	return 0;
+}
+
+#ifndef LIBFUZZER
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_run(const char *buf, int len, int chunk, int rounds)
+{
+	double t0, t1;
+	int i, results = 0;
+
+	t0 = bench_now();
+	for (i = 0; i < rounds; i++) {
+		results += parse_chunks(buf, len, chunk);
+	}
+	t1 = bench_now();
+	printf("%d bytes x %d in %d byte reads: %.0f bytes/s, %.0f results/s\n",
+	       len, rounds, chunk, (double) len * rounds / (t1 - t0),
+	       results / (t1 - t0));
+}
+
+static int read_file(const char *path, char **buf, int *len)
+{
+	char tmp[BENCH_CHUNK], *p;
+	size_t cnt;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	while ((cnt = fread(tmp, 1, sizeof(tmp), fp)) > 0) {
+		p = realloc(*buf, *len + cnt);
+		if (!p) {
+			fclose(fp);
+			return -1;
+		}
+		*buf = p;
+		memcpy(*buf + *len, tmp, cnt);
+		*len += cnt;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\nusage: %s [options] file [file ...]\n\n"
+		" -b        measure the parsing rate over all of the files\n"
+		" -c [num]  bytes per read in the benchmark, default %d\n"
+		" -h        prints this message and exits\n"
+		" -n [num]  passes over the files, default 1000\n"
+		" -v        prints the software version and exits\n"
+		"\n",
+		progname, BENCH_CHUNK);
+}
+
+int main(int argc, char *argv[])
+{
+	int benchmark = 0, c, chunk = BENCH_CHUNK, err, i, len, rounds = 1000;
+	char *buf = NULL, *progname;
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1+progname : argv[0];
+	while (EOF != (c = getopt(argc, argv, "bc:hn:v"))) {
+		switch (c) {
+		case 'b':
+			benchmark = 1;
+			break;
+		case 'c':
+			if (get_arg_val_i(c, optarg, &chunk, 1, INT_MAX)) {
+				return -1;
+			}
+			break;
+		case 'n':
+			if (get_arg_val_i(c, optarg, &rounds, 1, INT_MAX)) {
+				return -1;
+			}
+			break;
+		case 'v':
+			version_show(stdout);
+			return 0;
+		case 'h':
+			usage(progname);
+			return 0;
+		case '?':
+		default:
+			usage(progname);
+			return -1;
+		}
+	}
+	if (optind == argc) {
+		usage(progname);
+		return -1;
+	}
+	LLVMFuzzerInitialize(&argc, &argv);
+
+	if (!benchmark) {
+		for (i = optind; i < argc; i++) {
+			len = 0;
+			err = read_file(argv[i], &buf, &len);
+			if (!err) {
+				LLVMFuzzerTestOneInput((uint8_t *) buf, len);
+			}
+			free(buf);
+			buf = NULL;
+			if (err) {
+				return -1;
+			}
+		}
+		printf("%d files replayed\n", argc - optind);
+		return 0;
+	}
+
+	len = 0;
+	for (i = optind; i < argc; i++) {
+		if (read_file(argv[i], &buf, &len)) {
+			free(buf);
+			return -1;
+		}
+	}
+	bench_run(buf, len, chunk, rounds);
+	free(buf);
+	return 0;
+}
+
+#endif
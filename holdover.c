@@ -0,0 +1,274 @@
+/**
+ * @file holdover.c
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "holdover.h"
+#include "print.h"
+
+#define NS_PER_SEC		1000000000LL
+/* Time constant of the exponential weighting of the history. */
+#define HOLDOVER_TAU		3600.0
+/* Samples needed before the learned model replaces the stored one. */
+#define HOLDOVER_MIN_SAMPLES	64
+/* Limit of the learned aging, in ppb per second. */
+#define HOLDOVER_MAX_SLOPE	1e-3
+/* The aging is extrapolated for at most this many seconds. */
+#define HOLDOVER_MAX_AGE	(4 * HOLDOVER_TAU)
+/* The reference is lost after this long, or four of its intervals. */
+#define HOLDOVER_TIMEOUT	(2 * NS_PER_SEC)
+#define HOLDOVER_APPLY_INTERVAL	NS_PER_SEC
+#define HOLDOVER_SAVE_INTERVAL	(600 * NS_PER_SEC)
+
+struct holdover {
+	char *path;
+	double max_freq;
+	/* Weighted regression sums of the frequency over time. */
+	double s0, st, sf, stt, stf;
+	unsigned int samples;
+	uint64_t epoch;
+	uint64_t last_sample;
+	uint64_t last_save;
+	/* The calibration loaded from the file. */
+	int have_stored;
+	double stored_freq;
+	double stored_slope;
+	int64_t stored_time;
+	/* Arrival of the reference measurements. */
+	uint64_t last_ref;
+	uint64_t ref_interval;
+	/* State of the holdover. */
+	int active;
+	uint64_t start;
+	uint64_t last_apply;
+};
+
+static uint64_t holdover_now(clockid_t clkid)
+{
+	struct timespec ts;
+
+	clock_gettime(clkid, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static double holdover_clamp(double slope)
+{
+	if (slope > HOLDOVER_MAX_SLOPE)
+		return HOLDOVER_MAX_SLOPE;
+	if (slope < -HOLDOVER_MAX_SLOPE)
+		return -HOLDOVER_MAX_SLOPE;
+	return slope;
+}
+
+/*
+ * Fit the frequency and its rate of change at time 't', in seconds
+ * since the epoch. Returns zero if the history is too short.
+ */
+static int holdover_fit(struct holdover *h, double t, double *freq,
+			double *slope)
+{
+	double det, a, b = 0.0;
+
+	if (h->samples < HOLDOVER_MIN_SAMPLES || h->s0 <= 0.0)
+		return -1;
+
+	det = h->s0 * h->stt - h->st * h->st;
+	if (det > 1e-9 * h->s0 * h->s0)
+		b = holdover_clamp((h->s0 * h->stf - h->st * h->sf) / det);
+	a = (h->sf - b * h->st) / h->s0;
+
+	*freq = a + b * t;
+	*slope = b;
+	return 0;
+}
+
+static int holdover_predict(struct holdover *h, uint64_t now, double *freq)
+{
+	double age, slope, t = (int64_t) (now - h->epoch) / 1e9;
+
+	if (h->samples) {
+		age = (int64_t) (now - h->last_sample) / 1e9;
+		if (age > HOLDOVER_MAX_AGE)
+			t -= age - HOLDOVER_MAX_AGE;
+	}
+
+	if (!holdover_fit(h, t, freq, &slope)) {
+		/* the learned model */
+	} else if (h->have_stored) {
+		age = holdover_now(CLOCK_REALTIME) / NS_PER_SEC - h->stored_time;
+		if (age < 0.0)
+			age = 0.0;
+		if (age > HOLDOVER_MAX_AGE)
+			age = HOLDOVER_MAX_AGE;
+		*freq = h->stored_freq + h->stored_slope * age;
+	} else if (h->s0 > 0.0) {
+		*freq = h->sf / h->s0;
+	} else {
+		return -1;
+	}
+
+	if (*freq > h->max_freq)
+		*freq = h->max_freq;
+	if (*freq < -h->max_freq)
+		*freq = -h->max_freq;
+	return 0;
+}
+
+static void holdover_load(struct holdover *h)
+{
+	long long time;
+	FILE *fp;
+
+	fp = fopen(h->path, "r");
+	if (!fp) {
+		pr_info("holdover: no calibration in %s", h->path);
+		return;
+	}
+	if (fscanf(fp, "freq %lf\nslope %lf\ntime %lld\n", &h->stored_freq,
+		   &h->stored_slope, &time) != 3) {
+		pr_err("holdover: malformed calibration in %s", h->path);
+	} else {
+		h->stored_slope = holdover_clamp(h->stored_slope);
+		h->stored_time = time;
+		h->have_stored = 1;
+		pr_info("holdover: loaded freq %+.3f ppb slope %+.3e ppb/s",
+			h->stored_freq, h->stored_slope);
+	}
+	fclose(fp);
+}
+
+static void holdover_save(struct holdover *h, uint64_t now)
+{
+	double freq, slope, t = (int64_t) (now - h->epoch) / 1e9;
+	char tmp[strlen(h->path) + 5];
+	FILE *fp;
+
+	h->last_save = now;
+	if (holdover_fit(h, t, &freq, &slope))
+		return;
+
+	/* Replace the file atomically, so a crash leaves the old one. */
+	snprintf(tmp, sizeof(tmp), "%s.tmp", h->path);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		pr_err("holdover: failed to open %s: %m", tmp);
+		return;
+	}
+	fprintf(fp, "freq %.3f\nslope %.9e\ntime %lld\n", freq, slope,
+		(long long) (holdover_now(CLOCK_REALTIME) / NS_PER_SEC));
+	if (fclose(fp) || rename(tmp, h->path)) {
+		pr_err("holdover: failed to write %s: %m", h->path);
+		remove(tmp);
+	}
+}
+
+struct holdover *holdover_create(const char *path, double max_freq)
+{
+	struct holdover *h;
+
+	h = calloc(1, sizeof(*h));
+	if (!h) {
+		return NULL;
+	}
+	h->path = strdup(path);
+	if (!h->path) {
+		free(h);
+		return NULL;
+	}
+	h->max_freq = max_freq;
+	h->epoch = holdover_now(CLOCK_MONOTONIC);
+	h->last_save = h->epoch;
+	holdover_load(h);
+	return h;
+}
+
+void holdover_destroy(struct holdover *h)
+{
+	holdover_save(h, holdover_now(CLOCK_MONOTONIC));
+	free(h->path);
+	free(h);
+}
+
+void holdover_learn(struct holdover *h, double freq)
+{
+	uint64_t now = holdover_now(CLOCK_MONOTONIC);
+	double t = (int64_t) (now - h->epoch) / 1e9, w;
+
+	if (h->active)
+		return;
+	if (h->samples) {
+		w = exp(-(int64_t) (now - h->last_sample) / 1e9 / HOLDOVER_TAU);
+		h->s0 *= w;
+		h->st *= w;
+		h->sf *= w;
+		h->stt *= w;
+		h->stf *= w;
+	}
+	h->s0 += 1.0;
+	h->st += t;
+	h->sf += freq;
+	h->stt += t * t;
+	h->stf += t * freq;
+	h->samples++;
+	h->last_sample = now;
+
+	if (now - h->last_save >= HOLDOVER_SAVE_INTERVAL)
+		holdover_save(h, now);
+}
+
+void holdover_reference(struct holdover *h, int64_t offset)
+{
+	uint64_t now = holdover_now(CLOCK_MONOTONIC);
+	double duration;
+
+	if (h->last_ref)
+		h->ref_interval = now - h->last_ref;
+	h->last_ref = now;
+
+	if (!h->active)
+		return;
+	h->active = 0;
+	duration = (now - h->start) / 1e9;
+	pr_notice("holdover ended after %.1f s, offset %" PRId64 " ns, "
+		  "mean frequency error %+.3f ppb", duration, offset,
+		  duration > 0.0 ? offset / duration : 0.0);
+}
+
+int holdover_update(struct holdover *h, double *freq)
+{
+	uint64_t now = holdover_now(CLOCK_MONOTONIC), timeout;
+
+	/* Holdover only follows a reference seen since the start. */
+	if (!h->last_ref)
+		return 0;
+
+	if (!h->active) {
+		timeout = 4 * h->ref_interval;
+		if (timeout < HOLDOVER_TIMEOUT)
+			timeout = HOLDOVER_TIMEOUT;
+		if (now - h->last_ref < timeout)
+			return 0;
+		if (holdover_predict(h, now, freq))
+			return 0;
+		h->active = 1;
+		h->start = now;
+		h->last_apply = now;
+		pr_notice("reference lost, holdover at %+.3f ppb", *freq);
+		return 1;
+	}
+	if (now - h->last_apply < HOLDOVER_APPLY_INTERVAL)
+		return 0;
+	h->last_apply = now;
+	return holdover_predict(h, now, freq) ? 0 : 1;
+}
+
+int holdover_active(struct holdover *h)
+{
+	return h->active;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file holdover.h
+ * @brief Predicts the frequency of a clock while its reference is lost.
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#ifndef HAVE_HOLDOVER_H
+#define HAVE_HOLDOVER_H
+
+#include <stdint.h>
+
+/** Opaque type */
+struct holdover;
+
+/**
+ * Creates a holdover model, loading the calibration stored in a file.
+ * @param path		Name of the file holding the calibration of the clock.
+ * @param max_freq	The largest frequency adjustment to predict, in ppb.
+ * @return		A pointer to a new model on success, NULL otherwise.
+ */
+struct holdover *holdover_create(const char *path, double max_freq);
+
+/**
+ * Destroys a holdover model, storing its calibration.
+ * @param h	A pointer obtained via holdover_create().
+ */
+void holdover_destroy(struct holdover *h);
+
+/**
+ * Records the frequency applied by a locked servo, which is used to
+ * learn the frequency of the oscillator over time.
+ * @param h	A pointer obtained via holdover_create().
+ * @param freq	The frequency adjustment in parts per billion.
+ */
+void holdover_learn(struct holdover *h, double freq);
+
+/**
+ * Reports a measurement against the reference. When the clock is in
+ * holdover, this ends the holdover and logs its accuracy.
+ * @param h		A pointer obtained via holdover_create().
+ * @param offset	The offset from the reference in nanoseconds.
+ */
+void holdover_reference(struct holdover *h, int64_t offset);
+
+/**
+ * Checks whether the reference has been lost, and provides the
+ * frequency to apply in holdover at most once per second.
+ * @param h	A pointer obtained via holdover_create().
+ * @param freq	Returns the predicted frequency in parts per billion.
+ * @return	One if 'freq' should be applied to the clock, zero otherwise.
+ */
+int holdover_update(struct holdover *h, double *freq);
+
+/**
+ * Tells whether the clock is in holdover.
+ * @param h	A pointer obtained via holdover_create().
+ * @return	One if the reference has been lost, zero otherwise.
+ */
+int holdover_active(struct holdover *h);
+
+#endif
@@ -0,0 +1,366 @@
+/**
+ * @file metrics.c
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "metrics.h"
+#include "msg.h"
+#include "mtab.h"
+#include "port.h"
+#include "print.h"
+#include "unicast_service.h"
+#include "util.h"
+
+#define N_BUCKETS 7
+
+struct histogram {
+	uint64_t bucket[N_BUCKETS];
+	uint64_t count;
+	double sum;
+};
+
+struct metrics {
+	struct clock *clock;
+	char *address;
+	int fd;
+	/* The reply still being written to a slow reader. */
+	int reply_fd;
+	char *reply;
+	size_t reply_len;
+	size_t reply_off;
+	struct histogram offset;
+	struct histogram delay;
+};
+
+/* Upper bounds of the histogram buckets in nanoseconds, the last is +Inf. */
+static const int64_t bucket_limit[N_BUCKETS - 1] = {
+	10, 100, 1000, 10000, 100000, 1000000,
+};
+
+static void histogram_add(struct histogram *h, int64_t value)
+{
+	int i;
+
+	for (i = 0; i < N_BUCKETS - 1; i++) {
+		if (value <= bucket_limit[i]) {
+			break;
+		}
+	}
+	h->bucket[i]++;
+	h->count++;
+	h->sum += value;
+}
+
+static void histogram_show(FILE *fp, const char *name,
+			   struct histogram *h)
+{
+	uint64_t total = 0;
+	int i;
+
+	fprintf(fp, "# TYPE %s histogram\n", name);
+	for (i = 0; i < N_BUCKETS - 1; i++) {
+		total += h->bucket[i];
+		fprintf(fp, "%s_bucket{le=\"%lld\"} %llu\n", name,
+			(long long) bucket_limit[i], (unsigned long long) total);
+	}
+	fprintf(fp, "%s_bucket{le=\"+Inf\"} %llu\n", name,
+		(unsigned long long) h->count);
+	fprintf(fp, "%s_sum %.0f\n", name, h->sum);
+	fprintf(fp, "%s_count %llu\n", name, (unsigned long long) h->count);
+}
+
+static void metrics_show_clock(FILE *fp, struct clock *c)
+{
+	struct currentDS *cds = clock_current_dataset(c);
+	struct parent_ds *dad = clock_parent_ds(c);
+
+	fprintf(fp, "# TYPE ptp4l_servo_state gauge\n");
+	fprintf(fp, "ptp4l_servo_state %d\n", clock_servo_state(c));
+	fprintf(fp, "# TYPE ptp4l_offset_ns gauge\n");
+	fprintf(fp, "ptp4l_offset_ns %lld\n",
+		(long long) (cds->offsetFromMaster >> 16));
+	fprintf(fp, "# TYPE ptp4l_path_delay_ns gauge\n");
+	fprintf(fp, "ptp4l_path_delay_ns %lld\n",
+		(long long) (cds->meanPathDelay >> 16));
+	fprintf(fp, "# TYPE ptp4l_steps_removed gauge\n");
+	fprintf(fp, "ptp4l_steps_removed %hu\n", cds->stepsRemoved);
+	fprintf(fp, "# TYPE ptp4l_grandmaster_info gauge\n");
+	fprintf(fp, "ptp4l_grandmaster_info{identity=\"%s\",class=\"%hhu\"} 1\n",
+		cid2str(&dad->pds.grandmasterIdentity),
+		dad->pds.grandmasterClockQuality.clockClass);
+}
+
+static int unicast_masters_granted(struct port *p)
+{
+	struct unicast_master_table *table = port_unicast_master_table(p);
+	struct unicast_master_address *ucma;
+	int count = 0;
+
+	if (!table) {
+		return 0;
+	}
+	STAILQ_FOREACH(ucma, &table->addrs, list) {
+		if (ucma->granted) {
+			count++;
+		}
+	}
+	return count;
+}
+
+#define PORT_LABELS "{port=\"%hu\",interface=\"%s\""
+
+static void metrics_show_msg_counts(FILE *fp, struct clock *c,
+				    const char *name, int tx)
+{
+	struct PortServiceStats service_stats;
+	struct PortStats stats;
+	struct port *p;
+	uint64_t count;
+	int i;
+
+	fprintf(fp, "# TYPE %s counter\n", name);
+	for (p = clock_first_port(c); p; p = port_next(p)) {
+		port_get_stats(p, &stats, &service_stats);
+		for (i = 0; i < MAX_MESSAGE_TYPES; i++) {
+			if (!strcmp(msg_type_string(i), "unknown")) {
+				continue;
+			}
+			count = tx ? stats.txMsgType[i] : stats.rxMsgType[i];
+			fprintf(fp, "%s" PORT_LABELS ",type=\"%s\"} %llu\n",
+				name, port_number(p), port_name(p),
+				msg_type_string(i), (unsigned long long) count);
+		}
+	}
+}
+
+#define SHOW_SERVICE_STAT(fp, c, field)					\
+do {									\
+	struct PortServiceStats _ss;					\
+	struct PortStats _s;						\
+	struct port *_p;						\
+	fprintf(fp, "# TYPE ptp4l_port_" #field "_total counter\n");	\
+	for (_p = clock_first_port(c); _p; _p = port_next(_p)) {	\
+		port_get_stats(_p, &_s, &_ss);				\
+		fprintf(fp, "ptp4l_port_" #field "_total" PORT_LABELS	\
+			"} %llu\n", port_number(_p), port_name(_p),	\
+			(unsigned long long) _ss.field);		\
+	}								\
+} while (0)
+
+static void metrics_show_ports(FILE *fp, struct clock *c)
+{
+	struct port *p;
+
+	fprintf(fp, "# TYPE ptp4l_port_state gauge\n");
+	for (p = clock_first_port(c); p; p = port_next(p)) {
+		fprintf(fp, "ptp4l_port_state" PORT_LABELS ",state=\"%s\"} %d\n",
+			port_number(p), port_name(p), ps_str[port_state(p)],
+			port_state(p));
+	}
+
+	metrics_show_msg_counts(fp, c, "ptp4l_port_rx_messages_total", 0);
+	metrics_show_msg_counts(fp, c, "ptp4l_port_tx_messages_total", 1);
+
+	SHOW_SERVICE_STAT(fp, c, announce_timeout);
+	SHOW_SERVICE_STAT(fp, c, sync_timeout);
+	SHOW_SERVICE_STAT(fp, c, delay_timeout);
+	SHOW_SERVICE_STAT(fp, c, unicast_service_timeout);
+	SHOW_SERVICE_STAT(fp, c, unicast_request_timeout);
+	SHOW_SERVICE_STAT(fp, c, master_announce_timeout);
+	SHOW_SERVICE_STAT(fp, c, master_sync_timeout);
+	SHOW_SERVICE_STAT(fp, c, qualification_timeout);
+	SHOW_SERVICE_STAT(fp, c, sync_mismatch);
+	SHOW_SERVICE_STAT(fp, c, followup_mismatch);
+
+	fprintf(fp, "# TYPE ptp4l_port_unicast_grants gauge\n");
+	for (p = clock_first_port(c); p; p = port_next(p)) {
+		fprintf(fp, "ptp4l_port_unicast_grants" PORT_LABELS "} %d\n",
+			port_number(p), port_name(p),
+			unicast_service_count(p));
+	}
+	fprintf(fp, "# TYPE ptp4l_port_unicast_masters_granted gauge\n");
+	for (p = clock_first_port(c); p; p = port_next(p)) {
+		fprintf(fp, "ptp4l_port_unicast_masters_granted" PORT_LABELS
+			"} %d\n", port_number(p), port_name(p),
+			unicast_masters_granted(p));
+	}
+}
+
+struct metrics *metrics_create(struct clock *c, const char *address,
+			       int mode)
+{
+	struct sockaddr_un sa;
+	struct metrics *m;
+
+	m = calloc(1, sizeof(*m));
+	if (!m) {
+		return NULL;
+	}
+	m->clock = c;
+	m->reply_fd = -1;
+	m->address = strdup(address);
+	if (!m->address) {
+		goto no_addr;
+	}
+
+	m->fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (m->fd < 0) {
+		pr_err("metrics: failed to create socket: %m");
+		goto no_sock;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_LOCAL;
+	strncpy(sa.sun_path, address, sizeof(sa.sun_path) - 1);
+
+	if (!unlink(address))
+		pr_err("metrics: removed existing %s", address);
+
+	if (bind(m->fd, (struct sockaddr *) &sa, sizeof(sa))) {
+		pr_err("metrics: bind failed: %m");
+		goto no_bind;
+	}
+	chmod(address, mode);
+	if (listen(m->fd, 16)) {
+		pr_err("metrics: listen failed: %m");
+		goto no_listen;
+	}
+	return m;
+
+no_listen:
+	unlink(address);
+no_bind:
+	close(m->fd);
+no_sock:
+	free(m->address);
+no_addr:
+	free(m);
+	return NULL;
+}
+
+static void metrics_reply_done(struct metrics *m)
+{
+	close(m->reply_fd);
+	free(m->reply);
+	m->reply_fd = -1;
+	m->reply = NULL;
+	clock_fda_changed(m->clock);
+}
+
+/* Returns non-zero while a part of the reply remains to be written. */
+static int metrics_send(struct metrics *m)
+{
+	ssize_t cnt;
+
+	while (m->reply_off < m->reply_len) {
+		cnt = send(m->reply_fd, m->reply + m->reply_off,
+			   m->reply_len - m->reply_off,
+			   MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (cnt < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 1;
+			}
+			pr_debug("metrics: send failed: %m");
+			return 0;
+		}
+		m->reply_off += cnt;
+	}
+	return 0;
+}
+
+void metrics_destroy(struct metrics *m)
+{
+	if (m->reply_fd >= 0) {
+		close(m->reply_fd);
+		free(m->reply);
+	}
+	close(m->fd);
+	unlink(m->address);
+	free(m->address);
+	free(m);
+}
+
+int metrics_fd(struct metrics *m)
+{
+	return m->fd;
+}
+
+int metrics_reply_fd(struct metrics *m)
+{
+	return m->reply_fd;
+}
+
+void metrics_serve(struct metrics *m)
+{
+	size_t len = 0;
+	char *buf = NULL;
+	FILE *fp;
+	int fd;
+
+	fd = accept4(m->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			pr_err("metrics: accept failed: %m");
+		}
+		return;
+	}
+
+	fp = open_memstream(&buf, &len);
+	if (!fp) {
+		close(fd);
+		return;
+	}
+	metrics_show_clock(fp, m->clock);
+	histogram_show(fp, "ptp4l_offset_abs_ns", &m->offset);
+	histogram_show(fp, "ptp4l_path_delay_hist_ns", &m->delay);
+	metrics_show_ports(fp, m->clock);
+	fclose(fp);
+
+	/* Only one reply is kept pending, a reader that stalls loses it. */
+	if (m->reply_fd >= 0) {
+		pr_debug("metrics: dropping an unfinished reply");
+		metrics_reply_done(m);
+	}
+	m->reply_fd = fd;
+	m->reply = buf;
+	m->reply_len = len;
+	m->reply_off = 0;
+
+	if (metrics_send(m)) {
+		/* Finish the rest once the socket becomes writable. */
+		clock_fda_changed(m->clock);
+	} else {
+		metrics_reply_done(m);
+	}
+}
+
+void metrics_write(struct metrics *m)
+{
+	if (m->reply_fd < 0) {
+		return;
+	}
+	if (!metrics_send(m)) {
+		metrics_reply_done(m);
+	}
+}
+
+void metrics_offset(struct metrics *m, int64_t offset)
+{
+	histogram_add(&m->offset, offset < 0 ? -offset : offset);
+}
+
+void metrics_delay(struct metrics *m, int64_t delay)
+{
+	histogram_add(&m->delay, delay);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file metrics.h
+ * @brief Serves clock and port counters in a text format over a UDS.
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#ifndef HAVE_METRICS_H
+#define HAVE_METRICS_H
+
+#include <stdint.h>
+
+struct clock;
+struct metrics;
+
+/**
+ * Create a metrics server listening on a local stream socket.
+ * @param c        The clock whose counters are served.
+ * @param address  The path of the socket.
+ * @param mode     The file mode of the socket.
+ * @return A pointer to a new metrics server on success, NULL otherwise.
+ */
+struct metrics *metrics_create(struct clock *c, const char *address,
+			       int mode);
+
+/**
+ * Destroy a metrics server.
+ * @param m  Pointer obtained via @ref metrics_create().
+ */
+void metrics_destroy(struct metrics *m);
+
+/**
+ * Obtain the listening socket of a metrics server.
+ * @param m  Pointer obtained via @ref metrics_create().
+ * @return The file descriptor to be polled for incoming connections.
+ */
+int metrics_fd(struct metrics *m);
+
+/**
+ * Obtain the connection of a reply which is still being written.
+ * @param m  Pointer obtained via @ref metrics_create().
+ * @return The file descriptor to be polled for POLLOUT, or -1 when
+ *         no reply is pending.
+ */
+int metrics_reply_fd(struct metrics *m);
+
+/**
+ * Accept a pending connection and write out the current counters.
+ * When the reader is too slow to take the whole reply at once, the
+ * remainder is kept and written by @ref metrics_write().
+ * @param m  Pointer obtained via @ref metrics_create().
+ */
+void metrics_serve(struct metrics *m);
+
+/**
+ * Continue writing a pending reply.
+ * @param m  Pointer obtained via @ref metrics_create().
+ */
+void metrics_write(struct metrics *m);
+
+/**
+ * Account a new offset from the master in the offset histogram.
+ * @param m       Pointer obtained via @ref metrics_create().
+ * @param offset  The offset in nanoseconds.
+ */
+void metrics_offset(struct metrics *m, int64_t offset);
+
+/**
+ * Account a new path delay in the delay histogram.
+ * @param m      Pointer obtained via @ref metrics_create().
+ * @param delay  The path delay in nanoseconds.
+ */
+void metrics_delay(struct metrics *m, int64_t delay);
+
+#endif
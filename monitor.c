@@ -5,21 +5,32 @@
  */
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "address.h"
 #include "monitor.h"
 #include "print.h"
 
-#define RECORDS_PER_MESSAGE 1
+#define MAX_SUBSCRIBERS 8
 
+/*
+ * The messages are kept in the network byte order for their whole
+ * life. Only the records, the source port identity and the sequence
+ * number are written in place before a message is sent, and the same
+ * buffer is sent to each of the subscribers.
+ */
 struct monitor_message {
 	struct ptp_message *msg;
+	struct PortIdentity source;
+	uint16_t seqnum;
 	int records_per_msg;
 	int count;
 };
 
 struct monitor {
 	struct port *dst_port;
+	struct address subscriber[MAX_SUBSCRIBERS];
+	int n_subscribers;
 	struct slave_rx_sync_timing_data_tlv *sync_tlv;
 	struct slave_delay_timing_data_tlv *delay_tlv;
 	struct monitor_message delay;
@@ -31,31 +42,50 @@ static bool monitor_active(struct monitor *monitor)
 	return monitor->dst_port ? true : false;
 }
 
-static int monitor_forward(struct port *port, struct ptp_message *msg)
+static int monitor_forward(struct monitor *monitor, struct monitor_message *mm)
 {
-	int err, pdulen = msg->header.messageLength;
-
-	if (msg_pre_send(msg)) {
-		return -1;
-	}
-	err = port_forward_to(port, msg);
-	if (err) {
-		pr_debug("failed to send signaling message to slave event monitor: %s",
-			 strerror(-err));
+	struct ptp_message *msg = mm->msg;
+	int err, i;
+
+	msg->header.sequenceId = htons(mm->seqnum++);
+
+	for (i = 0; i < monitor->n_subscribers; i++) {
+		msg->address = monitor->subscriber[i];
+		err = port_forward_to(monitor->dst_port, msg);
+		if (err) {
+			pr_debug("failed to send signaling message to slave event monitor: %s",
+				 strerror(-err));
+		}
 	}
-	if (msg_post_recv(msg, pdulen)) {
-		return -1;
-	}
-	msg->header.sequenceId++;
+	mm->count = 0;
 
 	return 0;
 }
 
+static void monitor_set_source(struct monitor_message *mm,
+			       struct PortIdentity *wire,
+			       struct PortIdentity *source_pid)
+{
+	mm->source = *source_pid;
+	wire->clockIdentity = source_pid->clockIdentity;
+	wire->portNumber = htons(source_pid->portNumber);
+	mm->count = 0;
+}
+
+static void timestamp_to_wire(struct Timestamp *wire, tmv_t t)
+{
+	struct Timestamp ts = tmv_to_Timestamp(t);
+
+	wire->seconds_lsb = htonl(ts.seconds_lsb);
+	wire->seconds_msb = htons(ts.seconds_msb);
+	wire->nanoseconds = htonl(ts.nanoseconds);
+}
+
 static struct tlv_extra *monitor_init_message(struct monitor_message *mm,
 					      struct port *destination,
 					      uint16_t tlv_type,
 					      size_t tlv_size,
-					      struct address address)
+					      int records_per_msg)
 {
 	struct ptp_message *msg;
 	struct tlv_extra *extra;
@@ -74,22 +104,28 @@ static struct tlv_extra *monitor_init_message(struct monitor_message *mm,
 		sizeof(extra->tlv->length);
 
 	mm->msg = msg;
-	mm->msg->address = address;
-	mm->records_per_msg = RECORDS_PER_MESSAGE;
+	mm->seqnum = msg->header.sequenceId;
+	mm->records_per_msg = records_per_msg;
 	mm->count = 0;
 
+	/* The records are empty, so this only converts the frame. */
+	if (msg_pre_send(msg)) {
+		msg_put(msg);
+		mm->msg = NULL;
+		return NULL;
+	}
 	return extra;
 }
 
-static int monitor_init_delay(struct monitor *monitor, struct address address)
+static int monitor_init_delay(struct monitor *monitor, int records)
 {
 	const size_t tlv_size = sizeof(struct slave_delay_timing_data_tlv) +
-		sizeof(struct slave_delay_timing_record) * RECORDS_PER_MESSAGE;
+		sizeof(struct slave_delay_timing_record) * records;
 	struct tlv_extra *extra;
 
 	extra = monitor_init_message(&monitor->delay, monitor->dst_port,
 				     TLV_SLAVE_DELAY_TIMING_DATA_NP, tlv_size,
-				     address);
+				     records);
 	if (!extra) {
 		return -1;
 	}
@@ -98,15 +134,15 @@ static int monitor_init_delay(struct monitor *monitor, struct address address)
 	return 0;
 }
 
-static int monitor_init_sync(struct monitor *monitor, struct address address)
+static int monitor_init_sync(struct monitor *monitor, int records)
 {
 	const size_t tlv_size = sizeof(struct slave_rx_sync_timing_data_tlv) +
-		sizeof(struct slave_rx_sync_timing_record) * RECORDS_PER_MESSAGE;
+		sizeof(struct slave_rx_sync_timing_record) * records;
 	struct tlv_extra *extra;
 
 	extra = monitor_init_message(&monitor->sync, monitor->dst_port,
 				     TLV_SLAVE_RX_SYNC_TIMING_DATA, tlv_size,
-				     address);
+				     records);
 	if (!extra) {
 		return -1;
 	}
@@ -115,12 +151,42 @@ static int monitor_init_sync(struct monitor *monitor, struct address address)
 	return 0;
 }
 
+static int monitor_add_subscribers(struct monitor *monitor, const char *paths)
+{
+	char *copy, *path, *saveptr;
+	struct sockaddr_un sa;
+	struct address *addr;
+	int err = 0;
+
+	copy = strdup(paths);
+	if (!copy) {
+		return -1;
+	}
+	for (path = strtok_r(copy, " \t", &saveptr); path;
+	     path = strtok_r(NULL, " \t", &saveptr)) {
+		if (monitor->n_subscribers == MAX_SUBSCRIBERS) {
+			pr_err("too many slave event monitors, at most %d",
+			       MAX_SUBSCRIBERS);
+			err = -1;
+			break;
+		}
+		memset(&sa, 0, sizeof(sa));
+		sa.sun_family = AF_LOCAL;
+		snprintf(sa.sun_path, sizeof(sa.sun_path) - 1, "%s", path);
+		addr = &monitor->subscriber[monitor->n_subscribers++];
+		addr->sun = sa;
+		addr->len = sizeof(sa);
+	}
+	free(copy);
+
+	return err;
+}
+
 struct monitor *monitor_create(struct config *config, struct port *dst)
 {
 	struct monitor *monitor;
-	struct address address;
-	struct sockaddr_un sa;
 	const char *path;
+	int records;
 
 	monitor = calloc(1, sizeof(*monitor));
 	if (!monitor) {
@@ -131,19 +197,30 @@ struct monitor *monitor_create(struct config *config, struct port *dst)
 		/* Return an inactive monitor. */
 		return monitor;
 	}
-	memset(&sa, 0, sizeof(sa));
-	sa.sun_family = AF_LOCAL;
-	snprintf(sa.sun_path, sizeof(sa.sun_path) - 1, "%s", path);
-	address.sun = sa;
-	address.len = sizeof(sa);
+	records = config_get_int(config, NULL, "slave_event_monitor_records");
+	if (records > SLAVE_DELAY_TIMING_MAX ||
+	    records > SLAVE_RX_SYNC_TIMING_MAX) {
+		pr_err("slave_event_monitor_records must not exceed %zu",
+		       SLAVE_RX_SYNC_TIMING_MAX < SLAVE_DELAY_TIMING_MAX ?
+		       SLAVE_RX_SYNC_TIMING_MAX : SLAVE_DELAY_TIMING_MAX);
+		free(monitor);
+		return NULL;
+	}
+	if (monitor_add_subscribers(monitor, path)) {
+		free(monitor);
+		return NULL;
+	}
+	if (!monitor->n_subscribers) {
+		return monitor;
+	}
 
 	monitor->dst_port = dst;
 
-	if (monitor_init_delay(monitor, address)) {
+	if (monitor_init_delay(monitor, records)) {
 		free(monitor);
 		return NULL;
 	}
-	if (monitor_init_sync(monitor, address)) {
+	if (monitor_init_sync(monitor, records)) {
 		msg_put(monitor->delay.msg);
 		free(monitor);
 		return NULL;
@@ -156,31 +233,27 @@ int monitor_delay(struct monitor *monitor, struct PortIdentity source_pid,
 		  uint16_t seqid, tmv_t t3, tmv_t corr, tmv_t t4)
 {
 	struct slave_delay_timing_record *record;
-	struct ptp_message *msg;
 
 	if (!monitor_active(monitor)) {
 		return 0;
 	}
 
-	msg = monitor->delay.msg;
-
-	if (!pid_eq(&monitor->delay_tlv->sourcePortIdentity, &source_pid)) {
+	if (!pid_eq(&monitor->delay.source, &source_pid)) {
 		/* There was a change in remote master. Drop stale records. */
-		memcpy(&monitor->delay_tlv->sourcePortIdentity, &source_pid,
-		       sizeof(monitor->delay_tlv->sourcePortIdentity));
-		monitor->delay.count = 0;
+		monitor_set_source(&monitor->delay,
+				   &monitor->delay_tlv->sourcePortIdentity,
+				   &source_pid);
 	}
 
 	record = monitor->delay_tlv->record + monitor->delay.count;
-	record->sequenceId                  = seqid;
-	record->delayOriginTimestamp        = tmv_to_Timestamp(t3);
-	record->totalCorrectionField        = tmv_to_TimeInterval(corr);
-	record->delayResponseTimestamp      = tmv_to_Timestamp(t4);
+	record->sequenceId = htons(seqid);
+	timestamp_to_wire(&record->delayOriginTimestamp, t3);
+	record->totalCorrectionField = host2net64(tmv_to_TimeInterval(corr));
+	timestamp_to_wire(&record->delayResponseTimestamp, t4);
 
 	monitor->delay.count++;
 	if (monitor->delay.count == monitor->delay.records_per_msg) {
-		monitor->delay.count = 0;
-		return monitor_forward(monitor->dst_port, msg);
+		return monitor_forward(monitor, &monitor->delay);
 	}
 	return 0;
 }
@@ -200,32 +273,28 @@ int monitor_sync(struct monitor *monitor, struct PortIdentity source_pid,
 		 uint16_t seqid, tmv_t t1, tmv_t corr, tmv_t t2)
 {
 	struct slave_rx_sync_timing_record *record;
-	struct ptp_message *msg;
 
 	if (!monitor_active(monitor)) {
 		return 0;
 	}
 
-	msg = monitor->sync.msg;
-
-	if (!pid_eq(&monitor->sync_tlv->sourcePortIdentity, &source_pid)) {
+	if (!pid_eq(&monitor->sync.source, &source_pid)) {
 		/* There was a change in remote master. Drop stale records. */
-		memcpy(&monitor->sync_tlv->sourcePortIdentity, &source_pid,
-		       sizeof(monitor->sync_tlv->sourcePortIdentity));
-		monitor->sync.count = 0;
+		monitor_set_source(&monitor->sync,
+				   &monitor->sync_tlv->sourcePortIdentity,
+				   &source_pid);
 	}
 
 	record = monitor->sync_tlv->record + monitor->sync.count;
-	record->sequenceId                 = seqid;
-	record->syncOriginTimestamp        = tmv_to_Timestamp(t1);
-	record->totalCorrectionField       = tmv_to_TimeInterval(corr);
+	record->sequenceId = htons(seqid);
+	timestamp_to_wire(&record->syncOriginTimestamp, t1);
+	record->totalCorrectionField = host2net64(tmv_to_TimeInterval(corr));
 	record->scaledCumulativeRateOffset = 0;
-	record->syncEventIngressTimestamp  = tmv_to_Timestamp(t2);
+	timestamp_to_wire(&record->syncEventIngressTimestamp, t2);
 
 	monitor->sync.count++;
 	if (monitor->sync.count == monitor->sync.records_per_msg) {
-		monitor->sync.count = 0;
-		return monitor_forward(monitor->dst_port, msg);
+		return monitor_forward(monitor, &monitor->sync);
 	}
 	return 0;
 }
@@ -147,7 +147,7 @@ static void port_id_pre_send(struct PortIdentity *pid)
 	pid->portNumber = htons(pid->portNumber);
 }
 
-static int suffix_post_recv(struct ptp_message *msg, int len)
+static int suffix_post_recv(struct ptp_message *msg, int len, int lazy)
 {
 	uint8_t *ptr = msg_suffix(msg);
 	struct tlv_extra *extra;
@@ -160,6 +160,9 @@ static int suffix_post_recv(struct ptp_message *msg, int len)
 
 	while (len >= sizeof(struct TLV)) {
 		extra = calloc(1, sizeof(struct tlv_extra));
+		if (!extra) {
+			return -ENOMEM;
+		}
 		extra->tlv = (struct TLV *) ptr;
 		extra->tlv->type = ntohs(extra->tlv->type);
 		extra->tlv->length = ntohs(extra->tlv->length);
@@ -177,6 +180,15 @@ static int suffix_post_recv(struct ptp_message *msg, int len)
 		suffix_len += extra->tlv->length;
 		len -= extra->tlv->length;
 		ptr += extra->tlv->length;
+		/*
+		 * The authentication TLV is checked before the message
+		 * reaches any of the consumers of the other TLVs.
+		 */
+		if (lazy && extra->tlv->type != TLV_AUTHENTICATION) {
+			extra->raw = 1;
+			msg_tlv_attach(msg, extra);
+			continue;
+		}
 		err = tlv_post_recv(extra);
 		if (err) {
 			free(extra);
@@ -194,7 +206,9 @@ static void suffix_pre_send(struct ptp_message *msg)
 
 	TAILQ_FOREACH(extra, &msg->tlv_list, list) {
 		tlv = extra->tlv;
-		tlv_pre_send(tlv, extra);
+		if (!extra->raw) {
+			tlv_pre_send(tlv, extra);
+		}
 		tlv->type = htons(tlv->type);
 		tlv->length = htons(tlv->length);
 	}
@@ -272,7 +286,7 @@ void msg_get(struct ptp_message *m)
 	m->refcnt++;
 }
 
-int msg_post_recv(struct ptp_message *m, int cnt)
+static int post_recv(struct ptp_message *m, int cnt, int lazy)
 {
 	int err, pdulen, suffix_len, type;
 
@@ -359,7 +373,7 @@ int msg_post_recv(struct ptp_message *m, int cnt)
 		break;
 	}
 
-	suffix_len = suffix_post_recv(m, cnt - pdulen);
+	suffix_len = suffix_post_recv(m, cnt - pdulen, lazy);
 	if (suffix_len < 0) {
 		return suffix_len;
 	}
@@ -370,6 +384,34 @@ int msg_post_recv(struct ptp_message *m, int cnt)
 	return 0;
 }
 
+int msg_post_recv(struct ptp_message *m, int cnt)
+{
+	return post_recv(m, cnt, 0);
+}
+
+int msg_post_recv_lazy(struct ptp_message *m, int cnt)
+{
+	return post_recv(m, cnt, 1);
+}
+
+int msg_tlv_decode(struct ptp_message *m)
+{
+	struct tlv_extra *extra;
+	int err;
+
+	TAILQ_FOREACH(extra, &m->tlv_list, list) {
+		if (!extra->raw) {
+			continue;
+		}
+		err = tlv_post_recv(extra);
+		if (err) {
+			return err;
+		}
+		extra->raw = 0;
+	}
+	return 0;
+}
+
 int msg_pre_send(struct ptp_message *m)
 {
 	int type;
@@ -419,6 +461,23 @@ int msg_pre_send(struct ptp_message *m)
 	return 0;
 }
 
+void msg_delay_resp_fill(struct ptp_message *rsp,
+			 const struct ptp_message *tmpl,
+			 const struct ptp_message *req)
+{
+	struct delay_resp_msg *dr = &rsp->delay_resp;
+
+	*dr = tmpl->delay_resp;
+	dr->hdr.domainNumber = req->header.domainNumber;
+	dr->hdr.correction = host2net64(req->header.correction);
+	dr->hdr.sequenceId = htons(req->header.sequenceId);
+	dr->receiveTimestamp = tmv_to_Timestamp(req->hwts.ts);
+	timestamp_pre_send(&dr->receiveTimestamp);
+	dr->requestingPortIdentity = req->header.sourcePortIdentity;
+	dr->requestingPortIdentity.portNumber =
+		htons(dr->requestingPortIdentity.portNumber);
+}
+
 struct tlv_extra *msg_tlv_append(struct ptp_message *msg, int length)
 {
 	struct tlv_extra *extra;
@@ -463,6 +522,9 @@ int msg_tlv_copy(struct ptp_message *msg, struct ptp_message *dup) {
 	TAILQ_FOREACH(extra, &msg->tlv_list, list) {
 		tlv = (void *) extra->tlv - (void *) msg + (void *) dup;
 		dup_extra = calloc(1, sizeof(struct tlv_extra));
+		if (!dup_extra) {
+			return -1;
+		}
 		dup_extra->tlv = tlv;
 		msg_tlv_attach(dup, dup_extra);
 	}
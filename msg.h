@@ -319,7 +319,8 @@ void msg_tlv_attach(struct ptp_message *msg, struct tlv_extra *extra);
  *             The passed message must have been passed to @ref msg_post_recv()
  *             in order to have tlv pointers attached.
  * @param dup  A duplicate of msg that is still in network byte order.
- * @return     -1 if the messages do not match, otherwise 0
+ * @return     -1 if the messages do not match or on allocation failure,
+ *             otherwise 0
  */
 int msg_tlv_copy(struct ptp_message *msg, struct ptp_message *dup);
 
@@ -397,6 +398,28 @@ void msg_get(struct ptp_message *m);
  */
 int msg_post_recv(struct ptp_message *m, int cnt);
 
+/**
+ * Process messages after reception, leaving the values of the TLVs in
+ * network byte order. Only the TLV headers are converted and checked
+ * against the length of the message. The values are converted and
+ * checked by @ref msg_tlv_decode(), which the consumers of the TLVs
+ * must call first. A message which is only forwarded or dropped never
+ * pays for converting its TLVs.
+ * @param m    A message obtained using @ref msg_allocate().
+ * @param cnt  The size of 'm' in bytes.
+ * @return   Zero on success, non-zero if the message is invalid.
+ */
+int msg_post_recv_lazy(struct ptp_message *m, int cnt);
+
+/**
+ * Convert the TLVs left in network byte order by @ref msg_post_recv_lazy().
+ * The TLVs which are already converted are skipped, so this may be
+ * called more than once.
+ * @param m    A message passed to @ref msg_post_recv_lazy().
+ * @return     Zero on success, non-zero if a TLV is invalid.
+ */
+int msg_tlv_decode(struct ptp_message *m);
+
 /**
  * Prepare messages for transmission.
  * @param m  A message obtained using @ref msg_allocate().
@@ -404,6 +427,18 @@ int msg_post_recv(struct ptp_message *m, int cnt);
  */
 int msg_pre_send(struct ptp_message *m);
 
+/**
+ * Fills in a Delay_Resp message ready for transmission from a template,
+ * patching in the fields which answer a given Delay_Req.
+ * @param rsp   A message obtained using @ref msg_allocate().
+ * @param tmpl  A Delay_Resp message without TLVs, already passed
+ *              through @ref msg_pre_send().
+ * @param req   The received Delay_Req message.
+ */
+void msg_delay_resp_fill(struct ptp_message *rsp,
+			 const struct ptp_message *tmpl,
+			 const struct ptp_message *req);
+
 /**
  * Print messages for debugging purposes.
  * @param type  Value of the messageType field as returned by @ref msg_type().
@@ -11,180 +11,297 @@
 #include "nmea.h"
 #include "print.h"
 
-#define NMEA_CHAR_MIN	' '
-#define NMEA_CHAR_MAX	'~'
 #define NMEA_MAX_LENGTH	256
-
-enum nmea_state {
-	NMEA_IDLE,
-	NMEA_HAVE_DOLLAR,
-	NMEA_HAVE_STARTG,
-	NMEA_HAVE_STARTX,
-	NMEA_HAVE_BODY,
-	NMEA_HAVE_CSUMA,
-	NMEA_HAVE_CSUM_MSB,
-	NMEA_HAVE_CSUM_LSB,
-	NMEA_HAVE_PENULTIMATE,
-};
+#define NMEA_MAX_FIELDS	32
 
 struct nmea_parser {
 	char sentence[NMEA_MAX_LENGTH + 1];
-	char payload_checksum[3];
-	enum nmea_state state;
-	uint8_t checksum;
 	int offset;
+	struct nmea_status status;
+	time_t last_tod;
+	bool published_valid;
+	bool have_rmc;
+	bool rmc_valid;
 };
 
-static void nmea_reset(struct nmea_parser *np);
+struct nmea_decoder {
+	const char *type;
+	int min_fields;
+	/* Returns one if the sentence carried a complete time of day. */
+	int (*decode)(struct nmea_parser *np, char **field, int n);
+};
 
-static void nmea_accumulate(struct nmea_parser *np, char c)
+static int nmea_digits(const char *str, int len)
 {
-	if (c < NMEA_CHAR_MIN || c > NMEA_CHAR_MAX) {
-		nmea_reset(np);
-		return;
+	int i, val = 0;
+
+	for (i = 0; i < len; i++) {
+		if (str[i] < '0' || str[i] > '9') {
+			return -1;
+		}
+		val = val * 10 + str[i] - '0';
+	}
+	return val;
+}
+
+static int nmea_hex(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
 	}
-	if (np->offset == NMEA_MAX_LENGTH) {
-		nmea_reset(np);
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
 	}
-	np->sentence[np->offset++] = c;
-	np->checksum ^= c;
+	return -0x100;
 }
 
-static int nmea_parse_symbol(struct nmea_parser *np, char c)
+/* Parse a time field of the form hhmmss[.s...] into 'tm' and 'nsec'. */
+static int nmea_time(const char *str, struct tm *tm, long *nsec)
 {
-	switch (np->state) {
-	case NMEA_IDLE:
-		if (c == '$') {
-			np->state = NMEA_HAVE_DOLLAR;
-		}
-		break;
-	case NMEA_HAVE_DOLLAR:
-		if (c == 'G') {
-			np->state = NMEA_HAVE_STARTG;
-			nmea_accumulate(np, c);
-		} else {
-			nmea_reset(np);
-		}
-		break;
-	case NMEA_HAVE_STARTG:
-		np->state = NMEA_HAVE_STARTX;
-		nmea_accumulate(np, c);
-		break;
-	case NMEA_HAVE_STARTX:
-		np->state = NMEA_HAVE_BODY;
-		nmea_accumulate(np, c);
-		break;
-	case NMEA_HAVE_BODY:
-		if (c == '*') {
-			np->state = NMEA_HAVE_CSUMA;
-		} else {
-			nmea_accumulate(np, c);
-		}
-		break;
-	case NMEA_HAVE_CSUMA:
-		np->state = NMEA_HAVE_CSUM_MSB;
-		np->payload_checksum[0] = c;
-		break;
-	case NMEA_HAVE_CSUM_MSB:
-		np->state = NMEA_HAVE_CSUM_LSB;
-		np->payload_checksum[1] = c;
-		break;
-	case NMEA_HAVE_CSUM_LSB:
-		if (c == '\n') {
-			/*skip the CR*/
-			return 0;
-		}
-		if (c == '\r') {
-			np->state = NMEA_HAVE_PENULTIMATE;
-		} else {
-			nmea_reset(np);
-		}
-		break;
-	case NMEA_HAVE_PENULTIMATE:
-		if (c == '\n') {
-			return 0;
+	long scale = 100000000;
+
+	tm->tm_hour = nmea_digits(str, 2);
+	tm->tm_min = nmea_digits(str + 2, 2);
+	tm->tm_sec = nmea_digits(str + 4, 2);
+	if (tm->tm_hour < 0 || tm->tm_min < 0 || tm->tm_sec < 0) {
+		return -1;
+	}
+	*nsec = 0;
+	str += 6;
+	if (*str == '.') {
+		for (str++; *str >= '0' && *str <= '9' && scale; str++) {
+			*nsec += (*str - '0') * scale;
+			scale /= 10;
 		}
-		nmea_reset(np);
-		break;
 	}
-	return -1;
+	return 0;
 }
 
-static void nmea_reset(struct nmea_parser *np)
+static int nmea_set_tod(struct nmea_parser *np, struct tm *tm, long nsec)
 {
-	memset(np, 0, sizeof(*np));
+	/* Convert an inserted leap second to ambiguous 23:59:59 */
+	if (tm->tm_sec == 60)
+		tm->tm_sec = 59;
+	tm->tm_isdst = 0;
+	np->status.ts.tv_sec = mktime(tm);
+	np->status.ts.tv_nsec = nsec;
+	return 1;
+}
+
+static int nmea_decode_gga(struct nmea_parser *np, char **field, int n)
+{
+	np->status.fix_quality = atoi(field[6]);
+	np->status.satellites = atoi(field[7]);
+	np->status.hdop = atof(field[8]);
+	return 0;
+}
+
+static int nmea_decode_gsa(struct nmea_parser *np, char **field, int n)
+{
+	np->status.fix_mode = atoi(field[2]);
+	np->status.pdop = atof(field[15]);
+	return 0;
 }
 
-static int nmea_scan_rmc(struct nmea_parser *np, struct nmea_rmc *result)
+static int nmea_decode_rmc(struct nmea_parser *np, char **field, int n)
 {
-	int cnt, i, msec = 0;
-	char *ptr, status;
-	uint8_t checksum;
 	struct tm tm = {0};
+	long nsec;
 
-	pr_debug("nmea sentence: %s", np->sentence);
-	cnt = sscanf(np->payload_checksum, "%02hhx", &checksum);
-	if (cnt != 1) {
-		return -1;
+	np->have_rmc = true;
+	np->rmc_valid = field[2][0] == 'A';
+
+	if (nmea_time(field[1], &tm, &nsec) || strlen(field[9]) != 6) {
+		return 0;
 	}
-	if (checksum != np->checksum) {
-		pr_err("checksum mismatch 0x%02hhx != 0x%02hhx on %s",
-		       checksum, np->checksum, np->sentence);
-		return -1;
+	tm.tm_mday = nmea_digits(field[9], 2);
+	tm.tm_mon = nmea_digits(field[9] + 2, 2) - 1;
+	tm.tm_year = nmea_digits(field[9] + 4, 2) + 100;
+	if (tm.tm_mday < 0 || tm.tm_mon < 0 || tm.tm_year < 100) {
+		return 0;
 	}
-	cnt = sscanf(np->sentence,
-		     "G%*cRMC,%2d%2d%2d.%d,%c",
-		     &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &msec, &status);
-	if (cnt != 5) {
-		cnt = sscanf(np->sentence,
-			     "G%*cRMC,%2d%2d%2d,%c",
-			     &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &status);
-		if (cnt != 4) {
-			return -1;
+	return nmea_set_tod(np, &tm, nsec);
+}
+
+static int nmea_decode_zda(struct nmea_parser *np, char **field, int n)
+{
+	struct tm tm = {0};
+	long nsec;
+
+	if (nmea_time(field[1], &tm, &nsec) || strlen(field[4]) != 4) {
+		return 0;
+	}
+	tm.tm_mday = nmea_digits(field[2], 2);
+	tm.tm_mon = nmea_digits(field[3], 2) - 1;
+	tm.tm_year = nmea_digits(field[4], 4) - 1900;
+	if (tm.tm_mday < 0 || tm.tm_mon < 0 || tm.tm_year < 0) {
+		return 0;
+	}
+	return nmea_set_tod(np, &tm, nsec);
+}
+
+static const struct nmea_decoder nmea_decoders[] = {
+	{ "GGA",  9, nmea_decode_gga },
+	{ "GSA", 16, nmea_decode_gsa },
+	{ "RMC", 10, nmea_decode_rmc },
+	{ "ZDA",  5, nmea_decode_zda },
+};
+
+/* XOR the bytes a word at a time, folding the word at the end. */
+static uint8_t nmea_checksum(const char *ptr, int len)
+{
+	uint64_t word, acc = 0;
+	uint8_t sum = 0;
+	int i;
+
+	for (; len >= (int) sizeof(word); len -= sizeof(word)) {
+		memcpy(&word, ptr, sizeof(word));
+		acc ^= word;
+		ptr += sizeof(word);
+	}
+	for (i = 0; i < (int) sizeof(acc); i++) {
+		sum ^= acc >> (8 * i);
+	}
+	while (len--) {
+		sum ^= *ptr++;
+	}
+	return sum;
+}
+
+static bool nmea_fix_valid(struct nmea_parser *np)
+{
+	struct nmea_status *st = &np->status;
+
+	if (!np->have_rmc && st->fix_quality < 0 && st->fix_mode < 0) {
+		return false;
+	}
+	return (!np->have_rmc || np->rmc_valid) &&
+	       (st->fix_quality < 0 || st->fix_quality > 0) &&
+	       (st->fix_mode < 0 || st->fix_mode > 1);
+}
+
+/*
+ * Decode one complete line. Returns one when a new time of day is
+ * available, which is the case for the first time of day sentence in
+ * every second, and whenever the fix is lost.
+ */
+static int nmea_process(struct nmea_parser *np)
+{
+	char *body, *field[NMEA_MAX_FIELDS], *star, *end;
+	const struct nmea_decoder *dec = NULL;
+	int i, n = 0, csum, tod;
+	bool valid;
+
+	end = np->sentence + np->offset;
+	/* A line cut short by a new sentence starts at the last '$'. */
+	body = memrchr(np->sentence, '$', np->offset);
+	if (!body) {
+		return 0;
+	}
+	body++;
+	star = memchr(body, '*', end - body);
+	if (!star || end - star < 3) {
+		return 0;
+	}
+	*star = 0;
+	pr_debug("nmea sentence: %s", body);
+
+	csum = nmea_hex(star[1]) * 16 + nmea_hex(star[2]);
+	if (csum < 0 || csum != nmea_checksum(body, star - body)) {
+		pr_err("checksum mismatch 0x%02x != 0x%02hhx on %s",
+		       csum, nmea_checksum(body, star - body), body);
+		return 0;
+	}
+
+	field[n++] = body;
+	for (i = 0; body + i < star && n < NMEA_MAX_FIELDS; i++) {
+		if (body[i] == ',') {
+			body[i] = 0;
+			field[n++] = body + i + 1;
 		}
 	}
-	ptr = np->sentence;
-	for (i = 0; i < 9; i++) {
-		ptr = strchr(ptr, ',');
-		if (!ptr) {
-			return -1;
+	if (strlen(field[0]) != 5) {
+		return 0;
+	}
+	for (i = 0; i < (int) (sizeof(nmea_decoders) / sizeof(nmea_decoders[0])); i++) {
+		if (!strcmp(field[0] + 2, nmea_decoders[i].type)) {
+			dec = &nmea_decoders[i];
+			break;
 		}
-		ptr++;
 	}
-	cnt = sscanf(ptr, "%2d%2d%2d", &tm.tm_mday, &tm.tm_mon, &tm.tm_year);
-	if (cnt != 3) {
-		return -1;
+	if (!dec || n < dec->min_fields) {
+		return 0;
+	}
+
+	tod = dec->decode(np, field, n);
+	valid = nmea_fix_valid(np);
+	np->status.fix_valid = valid;
+
+	if (tod && np->status.ts.tv_sec != np->last_tod) {
+		np->last_tod = np->status.ts.tv_sec;
+		np->published_valid = valid;
+		return 1;
+	}
+	if (np->published_valid && !valid) {
+		np->published_valid = false;
+		return 1;
 	}
-	/* Convert an inserted leap second to ambiguous 23:59:59 */
-	if (tm.tm_sec == 60)
-		tm.tm_sec = 59;
-	tm.tm_year += 100;
-	tm.tm_mon--;
-	tm.tm_isdst = 0;
-	result->ts.tv_sec = mktime(&tm);
-	result->ts.tv_nsec = msec * 1000000UL;
-	result->fix_valid = status == 'A' ? true : false;
 	return 0;
 }
 
+static void nmea_reset(struct nmea_parser *np)
+{
+	memset(np, 0, sizeof(*np));
+	np->status.fix_quality = -1;
+	np->status.fix_mode = -1;
+	np->status.satellites = -1;
+	np->status.hdop = -1;
+	np->status.pdop = -1;
+	np->last_tod = -1;
+}
+
 int nmea_parse(struct nmea_parser *np, const char *ptr, int buflen,
-	       struct nmea_rmc *result, int *parsed)
+	       struct nmea_status *result, int *parsed)
 {
-	int count = 0;
-	while (buflen) {
-		if (!nmea_parse_symbol(np, *ptr)) {
-			if (!nmea_scan_rmc(np, result)) {
-				nmea_reset(np);
-				*parsed = count + 1;
-				return 0;
+	const char *pos = ptr, *end = ptr + buflen, *nl;
+	int len;
+
+	while (pos < end) {
+		if (!np->offset) {
+			pos = memchr(pos, '$', end - pos);
+			if (!pos) {
+				break;
 			}
-			nmea_reset(np);
 		}
-		buflen--;
-		count++;
-		ptr++;
+		nl = memchr(pos, '\n', end - pos);
+		len = (nl ? nl + 1 : end) - pos;
+		if (np->offset + len > NMEA_MAX_LENGTH) {
+			/* Too long, look for the next sentence. */
+			if (!np->offset) {
+				pos++;
+			}
+			np->offset = 0;
+			continue;
+		}
+		memcpy(np->sentence + np->offset, pos, len);
+		np->offset += len;
+		pos += len;
+		if (!nl) {
+			break;
+		}
+		np->sentence[np->offset] = 0;
+		if (nmea_process(np)) {
+			np->offset = 0;
+			*result = np->status;
+			*parsed = pos - ptr;
+			return 0;
+		}
+		np->offset = 0;
 	}
-	*parsed = count;
+	*parsed = buflen;
 	return -1;
 }
 
@@ -12,22 +12,41 @@
 /** Opaque type. */
 struct nmea_parser;
 
-struct nmea_rmc {
+/**
+ * The state of a receiver, collected from its RMC, ZDA, GGA and GSA
+ * sentences. The fields which were never reported are -1.
+ */
+struct nmea_status {
+	/** UTC time of the first time of day sentence in the second. */
 	struct timespec ts;
+	/** Whether all of the reported fix indicators are good. */
 	bool fix_valid;
+	/** GGA fix quality, zero meaning no fix. */
+	int fix_quality;
+	/** GSA fix mode, 1 for no fix, 2 for 2D and 3 for 3D. */
+	int fix_mode;
+	/** GGA number of satellites in use. */
+	int satellites;
+	/** GGA horizontal dilution of precision. */
+	double hdop;
+	/** GSA position dilution of precision. */
+	double pdop;
 };
 
 /**
- * Parses NMEA RMC sentences out of a given buffer.
+ * Parses NMEA sentences out of a given buffer. The sentences may be
+ * split across calls. A result is returned for the first sentence
+ * which carries a time of day (RMC or ZDA) in every second, and when
+ * the fix is lost.
  * @param np		Pointer obtained via nmea_parser_create().
  * @param buf		Pointer to the data to be parsed.
  * @param buflen	Length of 'buf' in bytes.
- * @param rmc		Pointer to hold the result.
+ * @param status	Pointer to hold the result.
  * @param parsed	Returns the number of bytes parsed, possibly less than buflen.
- * @return		Zero on success, non-zero otherwise.
+ * @return		Zero when 'status' holds a new result, non-zero otherwise.
  */
 int nmea_parse(struct nmea_parser *np, const char *buf, int buflen,
-	       struct nmea_rmc *rmc, int *parsed);
+	       struct nmea_status *status, int *parsed);
 
 /**
  * Creates an instance of an NMEA parser.
@@ -27,6 +27,7 @@
 #include <unistd.h>
 
 #include "phc.h"
+#include "util.h"
 
 /*
  * On 32 bit platforms, the PHC driver's maximum adjustment (type
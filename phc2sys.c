@@ -28,9 +28,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/queue.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -58,6 +60,8 @@
 #include "uds.h"
 #include "util.h"
 #include "version.h"
+#include "warmstart.h"
+#include "workers.h"
 
 #define KP 0.7
 #define KI 0.3
@@ -69,12 +73,19 @@
 
 #define MAX_DOMAINS 16
 
+/* Loop statistics are reported this often without a summary option. */
+#define LOOP_STATS_UPDATES 64
+
+/* Locked updates needed before the adaptive update interval is doubled. */
+#define ADAPTIVE_STABLE_UPDATES 8
+
 struct clock {
 	LIST_ENTRY(clock) list;
 	LIST_ENTRY(clock) dst_list;
 	clockid_t clkid;
 	int phc_index;
 	int sysoff_method;
+	int sysoff_raw;
 	int is_utc;
 	int dest_only;
 	int state;
@@ -85,6 +96,11 @@ struct clock {
 	int utc_offset_set;
 	struct servo *servo;
 	enum servo_state servo_state;
+	double interval;
+	double cur_interval;
+	uint64_t next_update;
+	unsigned int stable_updates;
+	int warm_started;
 	char *device;
 	const char *source_label;
 	struct stats *offset_stats;
@@ -106,6 +122,8 @@ struct domain {
 	enum servo_type servo_type;
 	int phc_readings;
 	double phc_interval;
+	double timer_interval;
+	double max_interval;
 	int forced_sync_offset;
 	int kernel_leap;
 	int state_changed;
@@ -119,14 +137,84 @@ struct domain {
 	struct clock *src_clock;
 	struct domain *src_domain;
 	int src_priority;
+	struct workers *workers;
+	/* Event loop state */
+	int timer_fd;
+	int pps_fd;
+	uint32_t pps_seq;
+	struct clock *pps_clock;
+	int pps_ready;
+	int tick;
+	uint64_t next_tick;
+	unsigned int timer_wakeups;
+	unsigned int agent_wakeups;
+	unsigned int overruns;
+	struct stats *latency_stats;
+	struct stats *cycle_stats;
 };
 
 static struct config *phc2sys_config;
+static struct warmstart *phc2sys_warm;
 
 static int clock_handle_leap(struct domain *domain,
 			     struct clock *clock,
 			     int64_t offset, uint64_t ts);
 
+/*
+ * Seed the first servo of a clock with the frequency saved before the
+ * restart, if the clock was synchronized to the same source.
+ */
+static void warm_start(struct domain *domain, struct clock *clock,
+		       struct servo *servo)
+{
+	const char *freq, *source;
+	char key[128];
+
+	if (!phc2sys_warm || clock->warm_started || domain->free_running ||
+	    !domain->src_clock)
+		return;
+	clock->warm_started = 1;
+
+	snprintf(key, sizeof(key), "source.%s", clock->device);
+	source = warmstart_get(phc2sys_warm, key);
+	if (!source || strcmp(source, domain->src_clock->device))
+		return;
+	snprintf(key, sizeof(key), "freq.%s", clock->device);
+	freq = warmstart_get(phc2sys_warm, key);
+	if (!freq)
+		return;
+
+	servo_warm_start(servo, -atof(freq));
+	pr_notice("%s: warm start from %s, freq %s", clock->device, source,
+		  freq);
+}
+
+static void warm_checkpoint(struct domain *domains, int n_domains)
+{
+	struct domain *domain;
+	struct clock *clock;
+	char key[128];
+	int i;
+
+	for (i = 0; i < n_domains; i++) {
+		domain = &domains[i];
+		if (!domain->src_clock)
+			continue;
+		LIST_FOREACH(clock, &domain->dst_clocks, dst_list) {
+			if (clock->servo_state != SERVO_LOCKED &&
+			    clock->servo_state != SERVO_LOCKED_STABLE)
+				continue;
+			snprintf(key, sizeof(key), "source.%s", clock->device);
+			warmstart_set(phc2sys_warm, key, "%s",
+				      domain->src_clock->device);
+			snprintf(key, sizeof(key), "freq.%s", clock->device);
+			warmstart_set(phc2sys_warm, key, "%.3f",
+				      clockadj_get_freq(clock->clkid));
+		}
+	}
+	warmstart_save(phc2sys_warm);
+}
+
 static struct servo *servo_add(struct domain *domain,
 			       struct clock *clock)
 {
@@ -154,7 +242,8 @@ static struct servo *servo_add(struct domain *domain,
 		return NULL;
 	}
 
-	servo_sync_interval(servo, domain->phc_interval);
+	servo_sync_interval(servo, clock->cur_interval);
+	warm_start(domain, clock, servo);
 
 	return servo;
 }
@@ -165,6 +254,7 @@ static struct clock *clock_add(struct domain *domain, const char *device,
 	struct clock *c, *c2;
 	clockid_t clkid = CLOCK_INVALID;
 	char phc_device[19];
+	double rate;
 
 	if (device) {
 		if (phc_index >= 0) {
@@ -188,6 +278,11 @@ static struct clock *clock_add(struct domain *domain, const char *device,
 	c->servo_state = SERVO_UNLOCKED;
 	c->device = device ? strdup(device) : NULL;
 
+	/* A section named after the device may override the domain rate. */
+	rate = config_get_double(phc2sys_config, device, "update_rate");
+	c->interval = rate > 0.0 ? 1.0 / rate : domain->phc_interval;
+	c->cur_interval = c->interval;
+
 	if (c->clkid == CLOCK_REALTIME) {
 		c->source_label = "sys";
 		c->is_utc = 1;
@@ -214,9 +309,14 @@ static struct clock *clock_add(struct domain *domain, const char *device,
 		}
 	}
 
-	if (clkid != CLOCK_INVALID && clkid != CLOCK_REALTIME)
+	if (clkid != CLOCK_INVALID && clkid != CLOCK_REALTIME) {
 		c->sysoff_method = sysoff_probe(CLOCKID_TO_FD(clkid),
 						domain->phc_readings);
+		if (c->sysoff_method >= 0)
+			c->sysoff_raw = sysoff_probe_raw(CLOCKID_TO_FD(clkid),
+							 c->sysoff_method,
+							 domain->phc_readings);
+	}
 
 	/* Add the clock to the end of the list to keep them in the
 	   command-line or ptp4l order */
@@ -611,6 +711,41 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 	stats_reset(clock->delay_stats);
 }
 
+static void set_clock_interval(struct clock *clock, double interval)
+{
+	if (clock->cur_interval == interval)
+		return;
+	pr_debug("%s update interval %.3f s", clock->device, interval);
+	clock->cur_interval = interval;
+	servo_sync_interval(clock->servo, interval);
+}
+
+/*
+ * Back off while the servo stays locked within its offset threshold,
+ * and return to the configured rate as soon as it leaves that state.
+ */
+static void adapt_clock_interval(struct domain *domain, struct clock *clock,
+				 enum servo_state state)
+{
+	double interval;
+
+	if (domain->max_interval <= clock->interval)
+		return;
+
+	if (state != SERVO_LOCKED_STABLE) {
+		clock->stable_updates = 0;
+		set_clock_interval(clock, clock->interval);
+		return;
+	}
+	if (++clock->stable_updates < ADAPTIVE_STABLE_UPDATES)
+		return;
+	clock->stable_updates = 0;
+	interval = 2 * clock->cur_interval;
+	if (interval > domain->max_interval)
+		interval = domain->max_interval;
+	set_clock_interval(clock, interval);
+}
+
 static void update_clock(struct domain *domain, struct clock *clock,
 			 int64_t offset, uint64_t ts, int64_t delay)
 {
@@ -636,6 +771,7 @@ static void update_clock(struct domain *domain, struct clock *clock,
 
 	ppb = servo_sample(clock->servo, offset, ts, 1.0, &state);
 	clock->servo_state = state;
+	adapt_clock_interval(domain, clock, state);
 
 	switch (state) {
 	case SERVO_UNLOCKED:
@@ -682,6 +818,7 @@ report:
 servo_unlock:
 	servo_reset(clock->servo);
 	clock->servo_state = SERVO_UNLOCKED;
+	adapt_clock_interval(domain, clock, SERVO_UNLOCKED);
 }
 
 static void enable_pps_output(clockid_t src)
@@ -694,17 +831,24 @@ static void enable_pps_output(clockid_t src)
 		pr_warning("failed to enable PPS output");
 }
 
-static int read_pps(int fd, int64_t *offset, uint64_t *ts)
+/*
+ * Fetch the latest PPS event without waiting for one. Returns one if
+ * the event was not seen before.
+ */
+static int read_pps(struct domain *domain, int64_t *offset, uint64_t *ts)
 {
 	struct pps_fdata pfd;
 
-	pfd.timeout.sec = 10;
+	pfd.timeout.sec = 0;
 	pfd.timeout.nsec = 0;
 	pfd.timeout.flags = ~PPS_TIME_INVALID;
-	if (ioctl(fd, PPS_FETCH, &pfd)) {
+	if (ioctl(domain->pps_fd, PPS_FETCH, &pfd)) {
 		pr_err("failed to fetch PPS: %m");
 		return 0;
 	}
+	if (pfd.info.assert_sequence == domain->pps_seq)
+		return 0;
+	domain->pps_seq = pfd.info.assert_sequence;
 
 	*ts = pfd.info.assert_tu.sec * NS_PER_SEC;
 	*ts += pfd.info.assert_tu.nsec;
@@ -716,59 +860,64 @@ static int read_pps(int fd, int64_t *offset, uint64_t *ts)
 	return 1;
 }
 
-static int do_pps_loop(struct domain *domain, struct clock *clock,
-		       int fd)
+static void pps_start(struct domain *domain)
 {
-	int64_t pps_offset, phc_offset, phc_delay;
-	uint64_t pps_ts, phc_ts;
-	clockid_t src = domain->src_clock->clkid;
-	int err;
+	struct pps_fdata pfd;
 
 	domain->src_clock->source_label = "pps";
 
-	if (src == CLOCK_INVALID) {
+	if (domain->src_clock->clkid == CLOCK_INVALID) {
 		/* The sync offset can't be applied with PPS alone. */
 		pmc_agent_set_sync_offset(domain->agent, 0);
 	} else {
 		enable_pps_output(domain->src_clock->clkid);
 	}
 
-	while (is_running()) {
-		if (!read_pps(fd, &pps_offset, &pps_ts)) {
-			continue;
-		}
+	/* Only the events from now on are of interest. */
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.timeout.flags = ~PPS_TIME_INVALID;
+	if (!ioctl(domain->pps_fd, PPS_FETCH, &pfd))
+		domain->pps_seq = pfd.info.assert_sequence;
+}
 
-		/* If a PHC is available, use it to get the whole number
-		   of seconds in the offset and PPS for the rest. */
-		if (src != CLOCK_INVALID) {
-			err = clockadj_compare(src, clock->clkid,
-					       domain->phc_readings,
-					       &phc_offset, &phc_ts,
-					       &phc_delay);
-			if (err == -EBUSY)
-				continue;
-			if (err)
-				return -1;
+static int pps_update(struct domain *domain)
+{
+	int64_t pps_offset, phc_offset, phc_delay;
+	clockid_t src = domain->src_clock->clkid;
+	struct clock *clock = domain->pps_clock;
+	uint64_t pps_ts, phc_ts;
+	int err;
 
-			/* Convert the time stamp to the PHC time. */
-			phc_ts -= phc_offset;
+	if (!read_pps(domain, &pps_offset, &pps_ts))
+		return 0;
 
-			/* Check if it is close to the start of the second. */
-			if (phc_ts % NS_PER_SEC > PHC_PPS_OFFSET_LIMIT) {
-				pr_warning("PPS is not in sync with PHC"
-					   " (0.%09lld)", phc_ts % NS_PER_SEC);
-				continue;
-			}
+	/* If a PHC is available, use it to get the whole number
+	   of seconds in the offset and PPS for the rest. */
+	if (src != CLOCK_INVALID) {
+		err = clockadj_compare(src, clock->clkid,
+				       domain->phc_readings,
+				       &phc_offset, &phc_ts,
+				       &phc_delay);
+		if (err == -EBUSY)
+			return 0;
+		if (err)
+			return -1;
+
+		/* Convert the time stamp to the PHC time. */
+		phc_ts -= phc_offset;
 
-			phc_ts = phc_ts / NS_PER_SEC * NS_PER_SEC;
-			pps_offset = pps_ts - phc_ts;
+		/* Check if it is close to the start of the second. */
+		if (phc_ts % NS_PER_SEC > PHC_PPS_OFFSET_LIMIT) {
+			pr_warning("PPS is not in sync with PHC"
+				   " (0.%09lld)", phc_ts % NS_PER_SEC);
+			return 0;
 		}
 
-		if (pmc_agent_update(domain->agent) < 0)
-			continue;
-		update_clock(domain, clock, pps_offset, pps_ts, -1);
+		phc_ts = phc_ts / NS_PER_SEC * NS_PER_SEC;
+		pps_offset = pps_ts - phc_ts;
 	}
-	close(fd);
+
+	update_clock(domain, clock, pps_offset, pps_ts, -1);
 	return 0;
 }
 
@@ -792,17 +941,115 @@ static int update_needed(struct clock *c)
 	return 0;
 }
 
-static int update_domain_clocks(struct domain *domain)
-{
-	int64_t offset, delay;
+/* The offset of the system clock from a PHC, at the system time 'ts'. */
+struct phc_reading {
+	int64_t offset;
+	int64_t delay;
+	uint64_t ts;
+	int err;
+};
+
+struct measurement {
+	struct domain *domain;
 	struct clock *clock;
+	const struct phc_reading *src;
+	const struct phc_reading *src_raw;
+	int64_t offset;
+	int64_t delay;
 	uint64_t ts;
 	int err;
+};
+
+static void read_phc(struct domain *domain, struct clock *clock,
+		     struct phc_reading *r, int raw)
+{
+	if (raw)
+		r->err = sysoff_measure_raw(CLOCKID_TO_FD(clock->clkid),
+					    clock->sysoff_method,
+					    domain->phc_readings,
+					    &r->offset, &r->ts, &r->delay);
+	else
+		r->err = sysoff_measure(CLOCKID_TO_FD(clock->clkid),
+					clock->sysoff_method,
+					domain->phc_readings,
+					&r->offset, &r->ts, &r->delay);
+}
 
+static void measure_clock(void *arg)
+{
+	struct measurement *m = arg;
+	struct clock *src = m->domain->src_clock, *clock = m->clock;
+	const struct phc_reading *sr = m->src;
+	struct phc_reading r;
+	int raw;
+
+	if (!clock)
+		return;
+
+	if (clock->clkid == CLOCK_REALTIME && sr) {
+		/* use the sysoff reading of the source */
+		m->err = sr->err;
+		m->offset = sr->offset;
+		m->ts = sr->ts;
+		m->delay = sr->delay;
+	} else if (clock->sysoff_method >= 0 &&
+		   (src->clkid == CLOCK_REALTIME || sr || m->src_raw)) {
+		/*
+		 * Use reversed sysoff. Between two PHCs the offset is
+		 * derived from their offsets to CLOCK_MONOTONIC_RAW if
+		 * both support it, or else to the system clock.
+		 */
+		raw = m->src_raw && clock->sysoff_raw;
+		if (raw)
+			sr = m->src_raw;
+		read_phc(m->domain, clock, &r, raw);
+		m->err = r.err;
+		if (m->err)
+			return;
+		m->offset = -r.offset;
+		m->ts = r.ts + m->offset;
+		m->delay = r.delay;
+		if (sr) {
+			m->err = sr->err;
+			m->offset += sr->offset;
+			m->delay += sr->delay;
+		}
+	} else {
+		/* use phc */
+		m->err = clockadj_compare(src->clkid, clock->clkid,
+					  m->domain->phc_readings,
+					  &m->offset, &m->ts, &m->delay);
+	}
+}
+
+static int update_domain_clocks(struct domain *domain, uint64_t now)
+{
+	struct phc_reading src_reading, src_raw_reading;
+	int i, n = 0, due = 0, slot = -1, need_rt = 0, need_raw = 0;
+	struct clock *clock, *src = domain->src_clock;
+	struct measurement m[MAX_DST_CLOCKS];
+	uint64_t slack;
+
+	/* Tolerate a late tick rather than skipping a whole period. */
+	slack = domain->timer_interval * NS_PER_SEC / 2;
+
+	/*
+	 * Every destination keeps the slot of its position in the list,
+	 * and clocks which are not due leave their slot empty, so that a
+	 * clock is always measured by the same worker.
+	 */
 	LIST_FOREACH(clock, &domain->dst_clocks, dst_list) {
+		if (++slot == MAX_DST_CLOCKS)
+			break;
+		m[slot].domain = domain;
+		m[slot].clock = NULL;
+
 		if (!update_needed(clock))
 			continue;
 
+		if (clock->next_update > now + slack)
+			continue;
+
 		/* don't try to synchronize the clock to itself */
 		if (clock->clkid == domain->src_clock->clkid ||
 		    (clock->phc_index >= 0 &&
@@ -810,101 +1057,351 @@ static int update_domain_clocks(struct domain *domain)
 		    !strcmp(clock->device, domain->src_clock->device))
 			continue;
 
-		if (clock->clkid == CLOCK_REALTIME &&
-		    domain->src_clock->sysoff_method >= 0) {
-			/* use sysoff */
-			err = sysoff_measure(CLOCKID_TO_FD(domain->src_clock->clkid),
-					     domain->src_clock->sysoff_method,
-					     domain->phc_readings,
-					     &offset, &ts, &delay);
-		} else if (domain->src_clock->clkid == CLOCK_REALTIME &&
-			   clock->sysoff_method >= 0) {
-			/* use reversed sysoff */
-			err = sysoff_measure(CLOCKID_TO_FD(clock->clkid),
-					     clock->sysoff_method,
-					     domain->phc_readings,
-					     &offset, &ts, &delay);
-			if (!err) {
-				offset = -offset;
-				ts += offset;
-			}
-		} else {
-			/* use phc */
-			err = clockadj_compare(domain->src_clock->clkid,
-					       clock->clkid,
-					       domain->phc_readings,
-					       &offset, &ts, &delay);
+		clock->next_update = now + clock->cur_interval * NS_PER_SEC;
+		m[slot].clock = clock;
+		m[slot].src = NULL;
+		m[slot].src_raw = NULL;
+		n = slot + 1;
+		due++;
+	}
+
+	/*
+	 * Read a source PHC only once per cycle and reference clock.
+	 * The PHC destinations are compared with it through
+	 * CLOCK_MONOTONIC_RAW where possible, which is not slewed by
+	 * the servo of the system clock between the two readings, and
+	 * the other destinations through the system clock.
+	 */
+	if (n && src->clkid != CLOCK_REALTIME && src->sysoff_method >= 0) {
+		for (i = 0; i < n; i++) {
+			if (!m[i].clock)
+				continue;
+			if (src->sysoff_raw && m[i].clock->sysoff_raw)
+				need_raw = 1;
+			else
+				need_rt = 1;
 		}
-		if (err == -EBUSY)
+		if (need_rt)
+			read_phc(domain, src, &src_reading, 0);
+		if (need_raw)
+			read_phc(domain, src, &src_raw_reading, 1);
+		for (i = 0; i < n; i++) {
+			m[i].src = need_rt ? &src_reading : NULL;
+			m[i].src_raw = need_raw ? &src_raw_reading : NULL;
+		}
+	}
+
+	/*
+	 * Measure all clocks first, in parallel when there is a pool of
+	 * workers, so that they are sampled at nearly the same time.
+	 * The servos then run here, in the main thread.
+	 */
+	if (domain->workers && due > 1) {
+		workers_run(domain->workers, measure_clock, m, sizeof(m[0]), n);
+	} else {
+		for (i = 0; i < n; i++)
+			measure_clock(&m[i]);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!m[i].clock || m[i].err == -EBUSY)
 			continue;
-		if (err)
+		if (m[i].err)
 			return -1;
-		update_clock(domain, clock, offset, ts, delay);
+		update_clock(domain, m[i].clock, m[i].offset, m[i].ts,
+			     m[i].delay);
 	}
 
 	return 0;
 }
 
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/* The epoll data carries the domain index and the kind of the source. */
+#define LOOP_EV_AGENT	0
+#define LOOP_EV_TIMER	1
+#define LOOP_EV_PPS	2
+#define LOOP_EV_KIND	3
+#define LOOP_EV(index, kind)	((index) << 2 | (kind))
+
+static int loop_add_domain(int epfd, struct domain *domain, int index)
+{
+	struct itimerspec tmo;
+	struct epoll_event ev;
+	struct clock *clock;
+	int fd;
+
+	domain->latency_stats = stats_create();
+	domain->cycle_stats = stats_create();
+	if (!domain->latency_stats || !domain->cycle_stats) {
+		pr_err("failed to create loop statistics");
+		return -1;
+	}
+
+	domain->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+					  TFD_NONBLOCK | TFD_CLOEXEC);
+	if (domain->timer_fd < 0) {
+		pr_err("failed to create timer: %m");
+		return -1;
+	}
+	/* The timer runs at the highest rate of any clock in the domain. */
+	domain->timer_interval = domain->phc_interval;
+	LIST_FOREACH(clock, &domain->clocks, list) {
+		if (clock->interval < domain->timer_interval)
+			domain->timer_interval = clock->interval;
+	}
+	tmo.it_interval.tv_sec = domain->timer_interval;
+	tmo.it_interval.tv_nsec =
+		(domain->timer_interval - tmo.it_interval.tv_sec) * 1e9;
+	tmo.it_value = tmo.it_interval;
+	domain->next_tick = monotonic_ns() +
+		domain->timer_interval * NS_PER_SEC;
+	if (timerfd_settime(domain->timer_fd, 0, &tmo, NULL)) {
+		pr_err("failed to set timer: %m");
+		return -1;
+	}
+	ev.events = EPOLLIN;
+	ev.data.u32 = LOOP_EV(index, LOOP_EV_TIMER);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, domain->timer_fd, &ev)) {
+		pr_err("failed to add timer to epoll: %m");
+		return -1;
+	}
+
+	if (domain->pps_fd >= 0) {
+		pps_start(domain);
+		/*
+		 * Older kernels report a PPS device as always readable,
+		 * but they do wake up the waiters on every event.
+		 */
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.u32 = LOOP_EV(index, LOOP_EV_PPS);
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, domain->pps_fd, &ev)) {
+			pr_err("failed to add PPS device to epoll: %m");
+			return -1;
+		}
+	}
+
+	fd = pmc_agent_get_fd(domain->agent);
+	if (fd < 0) {
+		return 0;
+	}
+	ev.events = EPOLLIN;
+	ev.data.u32 = LOOP_EV(index, LOOP_EV_AGENT);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+		pr_err("failed to add pmc socket to epoll: %m");
+		return -1;
+	}
+	return 0;
+}
+
+static void loop_del_domain(struct domain *domain)
+{
+	if (domain->timer_fd >= 0) {
+		close(domain->timer_fd);
+		domain->timer_fd = -1;
+	}
+	if (domain->pps_fd >= 0) {
+		close(domain->pps_fd);
+		domain->pps_fd = -1;
+	}
+	if (domain->latency_stats) {
+		stats_destroy(domain->latency_stats);
+		domain->latency_stats = NULL;
+	}
+	if (domain->cycle_stats) {
+		stats_destroy(domain->cycle_stats);
+		domain->cycle_stats = NULL;
+	}
+}
+
+static void loop_timer_expired(struct domain *domain)
+{
+	uint64_t expirations, interval, now;
+
+	if (read(domain->timer_fd, &expirations, sizeof(expirations)) !=
+	    sizeof(expirations)) {
+		return;
+	}
+	now = monotonic_ns();
+	interval = domain->timer_interval * NS_PER_SEC;
+	domain->next_tick += (expirations - 1) * interval;
+	if (now > domain->next_tick) {
+		stats_add_value(domain->latency_stats, now - domain->next_tick);
+	}
+	domain->next_tick += interval;
+	domain->overruns += expirations - 1;
+	domain->timer_wakeups++;
+	domain->tick = 1;
+}
+
+static void loop_report(struct domain *domain, int index)
+{
+	struct stats_result latency, cycle;
+	unsigned int max_count;
+
+	max_count = domain->stats_max_count ?
+		domain->stats_max_count : LOOP_STATS_UPDATES;
+	if (stats_get_num_values(domain->cycle_stats) < max_count) {
+		return;
+	}
+	if (stats_get_result(domain->latency_stats, &latency)) {
+		memset(&latency, 0, sizeof(latency));
+	}
+	stats_get_result(domain->cycle_stats, &cycle);
+
+	print(domain->stats_max_count ? LOG_INFO : LOG_DEBUG,
+	      "loop #%d wakeups timer %u ptp4l %u overruns %u "
+	      "latency %.0f max %.0f cycle %.0f max %.0f",
+	      index + 1, domain->timer_wakeups, domain->agent_wakeups,
+	      domain->overruns, latency.mean, latency.max,
+	      cycle.mean, cycle.max);
+
+	domain->timer_wakeups = 0;
+	domain->agent_wakeups = 0;
+	domain->overruns = 0;
+	stats_reset(domain->latency_stats);
+	stats_reset(domain->cycle_stats);
+}
+
+/*
+ * Process the messages from ptp4l and check the subscription of a
+ * domain. Returns one if the port states changed.
+ */
+static int loop_update_agent(struct domain *domain, int index)
+{
+	int prev_sub;
+
+	if (pmc_agent_update(domain->agent) < 0) {
+		return 0;
+	}
+
+	prev_sub = domain->agent_subscribed;
+	domain->agent_subscribed = pmc_agent_is_subscribed(domain->agent);
+	if (!domain->has_rt_clock && !domain->agent_subscribed) {
+		if (prev_sub) {
+			pr_err("Lost connection to ptp4l #%d", index + 1);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (domain->state_changed) {
+		/* force getting offset, as it may have
+		 * changed after the port state change */
+		if (pmc_agent_query_utc_offset(domain->agent, 1000)) {
+			pr_err("failed to get UTC offset");
+		}
+		return 1;
+	}
+	return 0;
+}
+
 static int do_loop(struct domain *domains, int n_domains)
 {
-	int i, state_changed, prev_sub;
-	struct timespec interval;
+	struct epoll_event events[2 * MAX_DOMAINS];
+	int cnt, epfd, i, index, state_changed, err = -1;
+	uint64_t start, last_save;
 	struct domain *domain;
 
-	/* All domains have the same interval */
-	interval.tv_sec = domains[0].phc_interval;
-	interval.tv_nsec = (domains[0].phc_interval - interval.tv_sec) * 1e9;
+	for (i = 0; i < n_domains; i++) {
+		domains[i].timer_fd = -1;
+	}
+	last_save = monotonic_ns();
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		pr_err("failed to create epoll: %m");
+		return -1;
+	}
+	for (i = 0; i < n_domains; i++) {
+		if (loop_add_domain(epfd, &domains[i], i)) {
+			goto out;
+		}
+	}
 
+	/*
+	 * Each domain measures its clocks when its own timer expires,
+	 * while messages from ptp4l are handled as soon as they arrive.
+	 */
 	while (is_running()) {
-		clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
-
-		state_changed = 0;
-		for (i = 0; i < n_domains; i++) {
-			domain = &domains[i];
-			if (pmc_agent_update(domain->agent) < 0) {
+		cnt = epoll_wait(epfd, events, 2 * MAX_DOMAINS, -1);
+		if (cnt < 0) {
+			if (errno == EINTR) {
 				continue;
 			}
+			pr_err("epoll_wait failed: %m");
+			goto out;
+		}
 
-			prev_sub = domain->agent_subscribed;
-			domain->agent_subscribed =
-				pmc_agent_is_subscribed(domain->agent);
-			if (!domain->has_rt_clock && !domain->agent_subscribed) {
-				if (prev_sub) {
-					pr_err("Lost connection to ptp4l #%d", i + 1);
-					state_changed = 1;
-				}
-				continue;
+		state_changed = 0;
+		for (i = 0; i < cnt; i++) {
+			index = events[i].data.u32 >> 2;
+			domain = &domains[index];
+			switch (events[i].data.u32 & LOOP_EV_KIND) {
+			case LOOP_EV_TIMER:
+				loop_timer_expired(domain);
+				break;
+			case LOOP_EV_PPS:
+				domain->pps_ready = 1;
+				break;
+			default:
+				domain->agent_wakeups++;
+				break;
 			}
-
-			if (domain->state_changed) {
+			if (loop_update_agent(domain, index)) {
 				state_changed = 1;
-
-				/* force getting offset, as it may have
-				 * changed after the port state change */
-				if (pmc_agent_query_utc_offset(domain->agent,
-							       1000)) {
-					pr_err("failed to get UTC offset");
-					continue;
-				}
 			}
 		}
 
 		if (state_changed) {
 			reconfigure(domains, n_domains);
-			state_changed = 0;
 		}
 
 		for (i = 0; i < n_domains; i++) {
 			domain = &domains[i];
 
-			if (!domain->src_clock)
+			if (domain->pps_ready) {
+				domain->pps_ready = 0;
+				start = monotonic_ns();
+				if (pps_update(domain))
+					goto out;
+				stats_add_value(domain->cycle_stats,
+						monotonic_ns() - start);
+			}
+
+			if (!domain->tick)
 				continue;
+			domain->tick = 0;
+
+			/* With PPS, the clock is updated on the PPS events. */
+			if (domain->src_clock && domain->pps_fd < 0) {
+				start = monotonic_ns();
+				if (update_domain_clocks(domain, start))
+					goto out;
+				stats_add_value(domain->cycle_stats,
+						monotonic_ns() - start);
+			}
+			loop_report(domain, i);
+		}
 
-			if (update_domain_clocks(domain))
-				return -1;
+		if (phc2sys_warm &&
+		    monotonic_ns() - last_save >= WARMSTART_INTERVAL * NS_PER_SEC) {
+			warm_checkpoint(domains, n_domains);
+			last_save = monotonic_ns();
 		}
 	}
-	return 0;
+	err = 0;
+out:
+	for (i = 0; i < n_domains; i++) {
+		loop_del_domain(&domains[i]);
+	}
+	close(epfd);
+	return err;
 }
 
 static int clock_compute_state(struct domain *domain,
@@ -1195,7 +1692,8 @@ static void usage(char *progname)
 		" -I [ki]        integration constant (0.3)\n"
 		" -S [step]      step threshold (disabled)\n"
 		" -F [step]      step threshold only on start (0.00002)\n"
-		" -R [rate]      update rate for the time sink devices in HZ (1.0)\n"
+		" -R [rate]      update rate for the time sink devices in HZ (1.0),\n"
+		"                repeat for each domain given with -z/-n\n"
 		" -N [num]       number of source clock readings per update (5)\n"
 		" -L [limit]     sanity frequency limit in ppb (200000000)\n"
 		" -M [num]       NTP SHM segment number (0)\n"
@@ -1219,16 +1717,19 @@ int main(int argc, char *argv[])
 	const char *dst_names[MAX_DST_CLOCKS], *uds_remotes[MAX_DOMAINS];
 	char uds_local[MAX_IFNAME_SIZE + 1];
 	int domain_numbers[MAX_DOMAINS], domain_number_cnt = 0;
+	double phc_rates[MAX_DOMAINS];
+	int phc_rate_cnt = 0;
 	int i, autocfg = 0, c, index, ntpshm_segment, offset = 0;
 	int pps_fd = -1, cmd_line_print_level, r = -1, rt = 0;
 	int wait_sync = 0, dst_cnt = 0, uds_remote_cnt = 0;
 	struct config *cfg;
 	struct option *opts;
-	double phc_rate, tmp;
+	double tmp;
 	struct domain domains[MAX_DOMAINS];
 	struct domain settings = {
 		.phc_readings = 5,
 		.phc_interval = 1.0,
+		.pps_fd = -1,
 	};
 	int n_domains = 0;
 
@@ -1329,9 +1830,14 @@ int main(int argc, char *argv[])
 				goto end;
 			break;
 		case 'R':
-			if (get_arg_val_d(c, optarg, &phc_rate, 1e-9, DBL_MAX))
+			if (phc_rate_cnt == MAX_DOMAINS) {
+				fprintf(stderr, "too many rates\n");
 				goto end;
-			settings.phc_interval = 1.0 / phc_rate;
+			}
+			if (get_arg_val_d(c, optarg, &phc_rates[phc_rate_cnt],
+					  1e-9, DBL_MAX))
+				goto end;
+			settings.phc_interval = 1.0 / phc_rates[phc_rate_cnt++];
 			break;
 		case 'N':
 			if (get_arg_val_i(c, optarg, &settings.phc_readings, 1, INT_MAX))
@@ -1464,6 +1970,10 @@ int main(int argc, char *argv[])
 	print_set_verbose(config_get_int(cfg, NULL, "verbose"));
 	print_set_syslog(config_get_int(cfg, NULL, "use_syslog"));
 	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+	if (print_set_queue_size(config_get_int(cfg, NULL, "log_queue_size"))) {
+		fprintf(stderr, "failed to start the log writer\n");
+		goto end;
+	}
 
 	settings.free_running = config_get_int(cfg, NULL, "free_running");
 	settings.servo_type = config_get_int(cfg, NULL, "clock_servo");
@@ -1472,8 +1982,21 @@ int main(int argc, char *argv[])
 		config_set_int(cfg, "sanity_freq_limit", 0);
 	}
 	settings.kernel_leap = config_get_int(cfg, NULL, "kernel_leap");
+	settings.max_interval = config_get_double(cfg, NULL,
+						  "max_update_interval");
 	settings.sanity_freq_limit = config_get_int(cfg, NULL, "sanity_freq_limit");
 
+	if (config_get_int(cfg, NULL, "measurement_threads")) {
+		settings.workers = workers_create(
+			config_get_int(cfg, NULL, "measurement_threads"),
+			config_get_string(cfg, NULL, "measurement_cpus"),
+			config_get_int(cfg, NULL, "measurement_priority"));
+		if (!settings.workers) {
+			fprintf(stderr, "failed to start the measurement threads\n");
+			goto end;
+		}
+	}
+
 	if (autocfg) {
 		if (n_domains == 0)
 			n_domains = 1;
@@ -1493,6 +2016,9 @@ int main(int argc, char *argv[])
 
 	for (i = 0; i < n_domains; i++) {
 		domains[i] = settings;
+		/* Each -R applies to one domain, the last one to the rest. */
+		if (i < phc_rate_cnt)
+			domains[i].phc_interval = 1.0 / phc_rates[i];
 		domains[i].agent = pmc_agent_create();
 		if (!domains[i].agent) {
 			return -1;
@@ -1502,6 +2028,13 @@ int main(int argc, char *argv[])
 			pmc_agent_set_sync_offset(domains[i].agent, offset);
 	}
 
+	if (*config_get_string(cfg, NULL, "phc2sys.state_file")) {
+		phc2sys_warm = warmstart_create(config_get_string(cfg, NULL,
+							"phc2sys.state_file"));
+		if (!phc2sys_warm)
+			goto end;
+	}
+
 	if (autocfg) {
 		for (i = 0; i < n_domains; i++) {
 			if (rt && i + 1 == n_domains) {
@@ -1524,6 +2057,12 @@ int main(int argc, char *argv[])
 			if (init_pmc_node(cfg, domains[i].agent, uds_local,
 					  phc2sys_recv_subscribed, &domains[i]))
 				goto end;
+			/* The status page belongs to a single ptp4l instance. */
+			if (n_domains - !!rt == 1 &&
+			    *config_get_string(cfg, NULL, "status_shm") &&
+			    pmc_agent_attach_status(domains[i].agent,
+					config_get_string(cfg, NULL, "status_shm")))
+				goto end;
 			if (auto_init_ports(&domains[i]) < 0)
 				goto end;
 		}
@@ -1600,18 +2139,27 @@ int main(int argc, char *argv[])
 		 * implement a mean to specify PTP port to PPS mapping */
 		dst->servo = servo_add(&domains[0], dst);
 		servo_sync_interval(dst->servo, 1.0);
-		r = do_pps_loop(&domains[0], dst, pps_fd);
-	} else {
-		r = do_loop(&domains[0], 1);
+		/* The PPS updates come at a fixed rate of one per second. */
+		domains[0].max_interval = 0.0;
+		domains[0].pps_fd = pps_fd;
+		domains[0].pps_clock = dst;
 	}
+	r = do_loop(&domains[0], 1);
 
 end:
+	if (phc2sys_warm) {
+		warm_checkpoint(domains, n_domains);
+		warmstart_destroy(phc2sys_warm);
+	}
 	for (i = 0; i < n_domains; i++) {
 		if (domains[i].agent)
 			pmc_agent_destroy(domains[i].agent);
 		clock_cleanup(&domains[i]);
 		port_cleanup(&domains[i]);
 	}
+	if (settings.workers)
+		workers_destroy(settings.workers);
+	print_cleanup();
 	config_destroy(cfg);
 	return r;
 bad_usage:
@@ -44,6 +44,7 @@ struct pi_servo {
 	double ki;
 	double last_freq;
 	int count;
+	int warm;
 	/* configuration: */
 	double configured_pi_kp;
 	double configured_pi_ki;
@@ -61,6 +62,17 @@ static void pi_destroy(struct servo *servo)
 	free(s);
 }
 
+static enum servo_state pi_first_state(struct servo *servo, int64_t offset)
+{
+	if ((servo->first_update &&
+	     servo->first_step_threshold &&
+	     servo->first_step_threshold < llabs(offset)) ||
+	    (servo->step_threshold &&
+	     servo->step_threshold < llabs(offset)))
+		return SERVO_JUMP;
+	return SERVO_LOCKED;
+}
+
 static double pi_sample(struct servo *servo,
 			int64_t offset,
 			uint64_t local_ts,
@@ -77,6 +89,14 @@ static double pi_sample(struct servo *servo,
 		s->local[0] = local_ts;
 		*state = SERVO_UNLOCKED;
 		s->count = 1;
+		if (!s->warm)
+			break;
+
+		/* The drift is known from a previous run, skip estimating it. */
+		s->warm = 0;
+		*state = pi_first_state(servo, offset);
+		ppb = s->drift;
+		s->count = 2;
 		break;
 	case 1:
 		s->offset[1] = offset;
@@ -110,15 +130,7 @@ static double pi_sample(struct servo *servo,
 		else if (s->drift > servo->max_frequency)
 			s->drift = servo->max_frequency;
 
-		if ((servo->first_update &&
-		     servo->first_step_threshold &&
-		     servo->first_step_threshold < llabs(offset)) ||
-		    (servo->step_threshold &&
-		     servo->step_threshold < llabs(offset)))
-			*state = SERVO_JUMP;
-		else
-			*state = SERVO_LOCKED;
-
+		*state = pi_first_state(servo, offset);
 		ppb = s->drift;
 		s->count = 2;
 		break;
@@ -175,6 +187,17 @@ static void pi_reset(struct servo *servo)
 	struct pi_servo *s = container_of(servo, struct pi_servo, servo);
 
 	s->count = 0;
+	s->warm = 0;
+}
+
+static void pi_warm_start(struct servo *servo, double freq)
+{
+	struct pi_servo *s = container_of(servo, struct pi_servo, servo);
+
+	s->drift = freq;
+	s->last_freq = freq;
+	s->count = 0;
+	s->warm = 1;
 }
 
 struct servo *pi_servo_create(struct config *cfg, double fadj, int sw_ts)
@@ -189,6 +212,7 @@ struct servo *pi_servo_create(struct config *cfg, double fadj, int sw_ts)
 	s->servo.sample  = pi_sample;
 	s->servo.sync_interval = pi_sync_interval;
 	s->servo.reset   = pi_reset;
+	s->servo.warm_start = pi_warm_start;
 	s->drift         = fadj;
 	s->last_freq     = fadj;
 	s->kp            = 0.0;
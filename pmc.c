@@ -156,7 +156,8 @@ static void pmc_show_signaling(struct ptp_message *msg, FILE *fp)
 	fflush(fp);
 }
 
-static void pmc_show(struct ptp_message *msg, FILE *fp)
+static void pmc_show_tlv(struct ptp_message *msg, struct tlv_extra *extra,
+			 FILE *fp)
 {
 	struct external_grandmaster_properties_np *egpn;
 	struct alternate_time_offset_properties *atop;
@@ -165,6 +166,7 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 	struct unicast_master_table_np *umtn;
 	struct grandmaster_settings_np *gsn;
 	struct port_service_stats_np *pssp;
+	struct unicast_service_load_np *uslp;
 	struct mgmt_clock_description *cd;
 	struct management_tlv_datum *mtd;
 	struct unicast_master_entry *ume;
@@ -177,7 +179,6 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 	struct management_tlv *mgt;
 	struct time_status_np *tsn;
 	struct port_stats_np *pcp;
-	struct tlv_extra *extra;
 	struct port_ds_np *pnp;
 	struct defaultDS *dds;
 	struct currentDS *cds;
@@ -185,36 +186,14 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 	uint64_t next_jump;
 	struct portDS *p;
 	struct TLV *tlv;
-	int action, i;
+	int i;
 	uint8_t *buf;
 
-	if (msg_type(msg) == SIGNALING) {
-		pmc_show_signaling(msg, fp);
-		return;
-	}
-	if (msg_type(msg) != MANAGEMENT) {
-		return;
-	}
-	action = management_action(msg);
-	if (action < GET || action > ACKNOWLEDGE) {
-		return;
-	}
 	fprintf(fp, "\t%s seq %hu %s ",
 		pid2str(&msg->header.sourcePortIdentity),
-		msg->header.sequenceId, pmc_action_string(action));
-	switch (msg_tlv_count(msg)) {
-	case 1:
-		break;
-	case 2:
-		extra = TAILQ_LAST(&msg->tlv_list, tlv_list);
-		if (extra->tlv->type == TLV_AUTHENTICATION) {
-			break;
-		}
-	default:
-		goto out;
-	}
-	extra = TAILQ_FIRST(&msg->tlv_list);
-	tlv = (struct TLV *) msg->management.suffix;
+		msg->header.sequenceId,
+		pmc_action_string(management_action(msg)));
+	tlv = extra->tlv;
 	if (tlv->type == TLV_MANAGEMENT) {
 		fprintf(fp, "MANAGEMENT ");
 	} else if (tlv->type == TLV_MANAGEMENT_ERROR_STATUS) {
@@ -224,7 +203,7 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 		fprintf(fp, "unknown-tlv ");
 		goto out;
 	}
-	mgt = (struct management_tlv *) msg->management.suffix;
+	mgt = (struct management_tlv *) extra->tlv;
 	if (mgt->length == 2 && mgt->id != MID_P_NULL_MANAGEMENT) {
 		fprintf(fp, "empty-tlv ");
 		goto out;
@@ -603,6 +582,26 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 		pssp->stats.sync_mismatch,
 		pssp->stats.followup_mismatch);
 		break;
+	case MID_P_UNICAST_SERVICE_LOAD_NP:
+		uslp = (struct unicast_service_load_np *) mgt->data;
+		fprintf(fp, "UNICAST_SERVICE_LOAD_NP "
+			IFMT "portIdentity     %s"
+			IFMT "clients          %u"
+			IFMT "maxPacketRate    %u"
+			IFMT "packetRate       %u"
+			IFMT "maxTsRate        %u"
+			IFMT "tsRate           %u"
+			IFMT "denied           %u"
+			IFMT "shortened        %u",
+			pid2str(&uslp->portIdentity),
+			uslp->clients,
+			uslp->max_packet_rate,
+			uslp->packet_rate,
+			uslp->max_ts_rate,
+			uslp->ts_rate,
+			uslp->denied,
+			uslp->shortened);
+		break;
 	case MID_P_UNICAST_MASTER_TABLE_NP:
 		umtn = (struct unicast_master_table_np *) mgt->data;
 		fprintf(fp, "UNICAST_MASTER_TABLE_NP "
@@ -701,6 +700,41 @@ out:
 	fflush(fp);
 }
 
+static void pmc_show(struct ptp_message *msg, FILE *fp)
+{
+	struct tlv_extra *extra;
+	int action, count = 0;
+
+	if (msg_type(msg) == SIGNALING) {
+		pmc_show_signaling(msg, fp);
+		return;
+	}
+	if (msg_type(msg) != MANAGEMENT) {
+		return;
+	}
+	action = management_action(msg);
+	if (action < GET || action > ACKNOWLEDGE) {
+		return;
+	}
+	/*
+	 * A response to a bulk GET carries several management TLVs,
+	 * which are shown as if each one came in its own message.
+	 */
+	TAILQ_FOREACH(extra, &msg->tlv_list, list) {
+		if (extra->tlv->type == TLV_AUTHENTICATION) {
+			continue;
+		}
+		pmc_show_tlv(msg, extra, fp);
+		count++;
+	}
+	if (!count) {
+		fprintf(fp, "\t%s seq %hu %s \n",
+			pid2str(&msg->header.sourcePortIdentity),
+			msg->header.sequenceId, pmc_action_string(action));
+		fflush(fp);
+	}
+}
+
 static void usage(char *progname)
 {
 	fprintf(stderr,
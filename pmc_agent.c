@@ -25,6 +25,7 @@
 #include "notification.h"
 #include "pmc_agent.h"
 #include "print.h"
+#include "shm_status.h"
 #include "util.h"
 
 /* The subscription duration needs to be longer than the update interval to be
@@ -36,6 +37,18 @@
 /* Update interval if the agent not subscribed, just polling the UTC offset */
 #define DEFAULT_UPDATE_INTERVAL 60
 
+/* Largest number of IDs in one bulk query, one bit each in a mask. */
+#define MAX_BULK_IDS 64
+
+/* Seconds until a ptp4l without bulk GET support is probed again */
+#define BULK_RETRY_INTERVAL 60
+
+enum bulk_support {
+	BULK_UNKNOWN,
+	BULK_SUPPORTED,
+	BULK_UNSUPPORTED,
+};
+
 struct pmc_agent {
 	struct pmc *pmc;
 	uint64_t pmc_last_update;
@@ -46,6 +59,8 @@ struct pmc_agent {
 	bool dds_valid;
 	int leap;
 	int pmc_ds_requested;
+	enum bulk_support bulk;
+	uint64_t bulk_retry;
 	bool stay_subscribed;
 	int sync_offset;
 	int utc_offset_traceable;
@@ -53,6 +68,13 @@ struct pmc_agent {
 	/* Callback on message reception */
 	pmc_node_recv_subscribed_t *recv_subscribed;
 	void *recv_context;
+
+	/* Optional shared status page published by ptp4l */
+	char *status_name;
+	struct shm_status *status;
+	struct shm_status_page *status_page;
+	uint8_t status_port_state[SHM_STATUS_MAX_PORTS];
+	bool status_valid;
 };
 
 static void send_subscription(struct pmc_agent *node)
@@ -204,6 +226,152 @@ static int run_pmc(struct pmc_agent *node, int timeout, int ds_id,
 	}
 }
 
+/*
+ * With 'fence' set, a single GET of NULL_MANAGEMENT follows the bulk
+ * request. ptp4l handles the requests in order, and one that knows
+ * bulk GETs answers or rejects every ID before the fence. A fence
+ * answered first therefore means that the bulk request was dropped.
+ */
+static int run_pmc_bulk(struct pmc_agent *node, int timeout,
+			const int *ids, int n_ids, bool fence,
+			pmc_agent_bulk_cb_t *cb, void *context)
+{
+	uint64_t answered = 0, all = (n_ids < 64 ? 1ULL << n_ids : 0) - 1;
+	struct management_error_status *mes;
+	struct management_tlv *mgt;
+	struct ptp_message *msg;
+	struct tlv_extra *extra;
+	struct pollfd pollfd;
+	bool fenced = false;
+	int cnt, i, matched;
+
+	if (n_ids < 1 || n_ids > MAX_BULK_IDS) {
+		return -EINVAL;
+	}
+	if (pmc_send_get_bulk(node->pmc, ids, n_ids)) {
+		return -EIO;
+	}
+	if (fence && pmc_send_get_action(node->pmc, MID_P_NULL_MANAGEMENT)) {
+		return -EIO;
+	}
+	while (answered != all || (fence && !fenced)) {
+		pollfd.fd = pmc_get_transport_fd(node->pmc);
+		pollfd.events = POLLIN|POLLPRI;
+
+		cnt = poll(&pollfd, 1, timeout);
+		if (cnt < 0) {
+			pr_err("poll failed");
+			return -EINTR;
+		}
+		if (!cnt) {
+			return -ETIMEDOUT;
+		}
+
+		msg = pmc_recv(node->pmc);
+		if (!msg) {
+			continue;
+		}
+		if (!check_clock_identity(node, msg) ||
+		    msg_type(msg) != MANAGEMENT ||
+		    management_action(msg) != RESPONSE) {
+			msg_put(msg);
+			continue;
+		}
+		matched = 0;
+		TAILQ_FOREACH(extra, &msg->tlv_list, list) {
+			/* Each rejected ID comes back as an error status. */
+			if (extra->tlv->type == TLV_MANAGEMENT_ERROR_STATUS) {
+				mes = (struct management_error_status *)
+					extra->tlv;
+				if (fence && mes->id == MID_P_NULL_MANAGEMENT) {
+					fenced = true;
+					matched = 1;
+					continue;
+				}
+				for (i = 0; i < n_ids; i++) {
+					if (ids[i] == mes->id) {
+						msg_put(msg);
+						return -ENODEV;
+					}
+				}
+				continue;
+			}
+			if (extra->tlv->type != TLV_MANAGEMENT) {
+				continue;
+			}
+			mgt = (struct management_tlv *) extra->tlv;
+			if (fence && mgt->id == MID_P_NULL_MANAGEMENT) {
+				fenced = true;
+				matched = 1;
+				continue;
+			}
+			for (i = 0; i < n_ids; i++) {
+				if (ids[i] != mgt->id) {
+					continue;
+				}
+				answered |= 1ULL << i;
+				cb(context, msg, mgt->id, mgt->data);
+				matched = 1;
+				break;
+			}
+		}
+		/* Anything else is a notification. */
+		if (!matched && is_msg_mgt(msg) > 0) {
+			node->recv_subscribed(node->recv_context, msg, -1);
+		}
+		msg_put(msg);
+		if (fenced && answered != all) {
+			return -EOPNOTSUPP;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Send a bulk query, probing first whether ptp4l supports them. Lack
+ * of support is only concluded from an explicit probe, and it is
+ * probed for again after a while, as ptp4l may be restarted.
+ */
+static int query_bulk(struct pmc_agent *node, int timeout,
+		      const int *ids, int n_ids,
+		      pmc_agent_bulk_cb_t *cb, void *context)
+{
+	struct timespec tp;
+	uint64_t ts;
+	int res;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tp)) {
+		pr_err("failed to read clock: %m");
+		return -errno;
+	}
+	ts = tp.tv_sec * NS_PER_SEC + tp.tv_nsec;
+
+	if (node->bulk == BULK_UNSUPPORTED) {
+		if (ts < node->bulk_retry) {
+			return -EOPNOTSUPP;
+		}
+		node->bulk = BULK_UNKNOWN;
+	}
+	res = run_pmc_bulk(node, timeout, ids, n_ids,
+			   node->bulk == BULK_UNKNOWN, cb, context);
+	switch (res) {
+	case 0:
+	case -ENODEV:
+		node->bulk = BULK_SUPPORTED;
+		break;
+	case -EOPNOTSUPP:
+		pr_debug("bulk GET not supported, using single queries");
+		node->bulk = BULK_UNSUPPORTED;
+		node->bulk_retry = ts + BULK_RETRY_INTERVAL * NS_PER_SEC;
+		break;
+	default:
+		/* Nothing learned, probe again with the next query. */
+		node->bulk = BULK_UNKNOWN;
+		break;
+	}
+	return res;
+}
+
 static int renew_subscription(struct pmc_agent *node, int timeout)
 {
 	struct ptp_message *msg;
@@ -217,6 +385,119 @@ static int renew_subscription(struct pmc_agent *node, int timeout)
 	return 0;
 }
 
+static void status_apply_tds(struct pmc_agent *node,
+			     struct timePropertiesDS *tds)
+{
+	if (tds->flags & PTP_TIMESCALE) {
+		node->sync_offset = tds->currentUtcOffset;
+		if (tds->flags & LEAP_61)
+			node->leap = 1;
+		else if (tds->flags & LEAP_59)
+			node->leap = -1;
+		else
+			node->leap = 0;
+		node->utc_offset_traceable = tds->flags & UTC_OFF_VALID &&
+					     tds->flags & TIME_TRACEABLE;
+	} else {
+		node->sync_offset = 0;
+		node->leap = 0;
+		node->utc_offset_traceable = 0;
+	}
+}
+
+static void status_notify_port(struct pmc_agent *node,
+			       struct shm_status_port *sp)
+{
+	struct management_tlv *mgt;
+	struct ptp_message *msg;
+	struct portDS *pds;
+
+	msg = msg_allocate();
+	if (!msg) {
+		return;
+	}
+	msg->header.tsmt = MANAGEMENT;
+	msg->header.sourcePortIdentity = sp->portIdentity;
+	msg->management.flags = RESPONSE;
+	mgt = (struct management_tlv *) msg->management.suffix;
+	mgt->type = TLV_MANAGEMENT;
+	mgt->length = sizeof(mgt->id) + sizeof(*pds);
+	mgt->id = MID_P_PORT_DATA_SET;
+	pds = (struct portDS *) mgt->data;
+	pds->portIdentity = sp->portIdentity;
+	pds->portState = sp->port_state;
+
+	node->recv_subscribed(node->recv_context, msg, -1);
+	msg_put(msg);
+}
+
+static void status_detach(struct pmc_agent *node)
+{
+	if (node->status) {
+		shm_status_destroy(node->status);
+	}
+	node->status = NULL;
+	node->status_valid = false;
+}
+
+/*
+ * Take the port states and time properties from the shared status
+ * page. Returns zero when the page is usable, an error code when the
+ * caller needs to fall back to the management interface.
+ */
+static int status_update(struct pmc_agent *node)
+{
+	struct shm_status_page *page = node->status_page;
+	unsigned int i, n;
+	int err;
+
+	if (!node->status) {
+		node->status = shm_status_open(node->status_name);
+		if (!node->status) {
+			return -ENODEV;
+		}
+		memset(node->status_port_state, 0,
+		       sizeof(node->status_port_state));
+	}
+	err = shm_status_read(node->status, page);
+	if (err == 1) {
+		return node->status_valid ? 0 : -EAGAIN;
+	}
+	if (err) {
+		if (err != -EBUSY) {
+			pr_debug("shared status page %s unusable: %s",
+				 node->status_name, strerror(-err));
+			status_detach(node);
+		} else {
+			/* Not a snapshot to rely on, use the socket meanwhile. */
+			node->status_valid = false;
+		}
+		return err;
+	}
+	if (node->dds_valid &&
+	    !cid_eq(&node->dds.clockIdentity, &page->dds.clockIdentity)) {
+		status_detach(node);
+		return -ENODEV;
+	}
+	node->dds = page->dds;
+	node->dds_valid = true;
+	status_apply_tds(node, &page->tds);
+
+	n = page->num_ports;
+	if (n > SHM_STATUS_MAX_PORTS) {
+		n = SHM_STATUS_MAX_PORTS;
+	}
+	for (i = 0; i < n; i++) {
+		if (node->status_port_state[i] == page->port[i].port_state) {
+			continue;
+		}
+		node->status_port_state[i] = page->port[i].port_state;
+		status_notify_port(node, &page->port[i]);
+	}
+	node->status_valid = true;
+	return 0;
+}
+
 int run_pmc_wait_sync(struct pmc_agent *node, int timeout)
 {
 	struct ptp_message *msg;
@@ -272,9 +553,26 @@ void pmc_agent_destroy(struct pmc_agent *agent)
 	if (agent->pmc) {
 		pmc_destroy(agent->pmc);
 	}
+	status_detach(agent);
+	free(agent->status_page);
+	free(agent->status_name);
 	free(agent);
 }
 
+int pmc_agent_attach_status(struct pmc_agent *agent, const char *name)
+{
+	agent->status_page = malloc(sizeof(*agent->status_page));
+	agent->status_name = strdup(name);
+	if (!agent->status_page || !agent->status_name) {
+		free(agent->status_page);
+		free(agent->status_name);
+		agent->status_page = NULL;
+		agent->status_name = NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
+
 void pmc_agent_disable(struct pmc_agent *agent)
 {
 	if (agent->pmc) {
@@ -283,6 +581,14 @@ void pmc_agent_disable(struct pmc_agent *agent)
 	agent->pmc = NULL;
 }
 
+int pmc_agent_get_fd(struct pmc_agent *agent)
+{
+	if (!agent->pmc) {
+		return -1;
+	}
+	return pmc_get_transport_fd(agent->pmc);
+}
+
 int pmc_agent_get_leap(struct pmc_agent *agent)
 {
 	return agent->leap;
@@ -318,16 +624,73 @@ int pmc_agent_query_dds(struct pmc_agent *node, int timeout)
 	return 0;
 }
 
+struct port_properties {
+	unsigned int port;
+	enum port_state *state;
+	int *tstamping;
+	int *phc_index;
+	char *iface;
+};
+
+static void copy_port_properties(struct port_properties *pp,
+				 struct port_properties_np *ppn)
+{
+	int len;
+
+	*pp->state = ppn->port_state;
+	*pp->tstamping = ppn->timestamping;
+	len = ppn->interface.length;
+	if (len > IFNAMSIZ - 1) {
+		len = IFNAMSIZ - 1;
+	}
+	memcpy(pp->iface, ppn->interface.text, len);
+	pp->iface[len] = '\0';
+}
+
+static void port_properties_cb(void *context, struct ptp_message *msg,
+			       int id, void *data)
+{
+	struct port_properties *pp = context;
+	struct port_properties_np *ppn;
+	struct port_hwclock_np *phn;
+
+	switch (id) {
+	case MID_P_PORT_PROPERTIES_NP:
+		ppn = data;
+		if (ppn->portIdentity.portNumber == pp->port) {
+			copy_port_properties(pp, ppn);
+		}
+		break;
+	case MID_P_PORT_HWCLOCK_NP:
+		phn = data;
+		if (phn->portIdentity.portNumber == pp->port) {
+			*pp->phc_index = phn->phc_index;
+		}
+		break;
+	}
+}
+
 int pmc_agent_query_port_properties(struct pmc_agent *node, int timeout,
 				    unsigned int port, enum port_state *state,
 				    int *tstamping, int *phc_index, char *iface)
 {
+	static const int ids[] = {
+		MID_P_PORT_PROPERTIES_NP, MID_P_PORT_HWCLOCK_NP,
+	};
+	struct port_properties pp = {
+		port, state, tstamping, phc_index, iface,
+	};
 	struct port_properties_np *ppn;
 	struct port_hwclock_np *phn;
 	struct ptp_message *msg;
-	int res, len;
+	int res;
 
 	pmc_target_port(node->pmc, port);
+	res = query_bulk(node, timeout, ids, 2, port_properties_cb, &pp);
+	if (res != -EOPNOTSUPP) {
+		pmc_target_all(node->pmc);
+		return res;
+	}
 	while (1) {
 		res = run_pmc(node, timeout, MID_P_PORT_PROPERTIES_NP, &msg);
 		if (is_run_pmc_error(res)) {
@@ -338,14 +701,7 @@ int pmc_agent_query_port_properties(struct pmc_agent *node, int timeout,
 			msg_put(msg);
 			continue;
 		}
-		*state = ppn->port_state;
-		*tstamping = ppn->timestamping;
-		len = ppn->interface.length;
-		if (len > IFNAMSIZ - 1) {
-			len = IFNAMSIZ - 1;
-		}
-		memcpy(iface, ppn->interface.text, len);
-		iface[len] = '\0';
+		copy_port_properties(&pp, ppn);
 
 		msg_put(msg);
 		break;
@@ -371,6 +727,13 @@ out:
 	return run_pmc_err2errno(res);
 }
 
+int pmc_agent_query_bulk(struct pmc_agent *node, int timeout,
+			 const int *ids, int n_ids,
+			 pmc_agent_bulk_cb_t *cb, void *context)
+{
+	return query_bulk(node, timeout, ids, n_ids, cb, context);
+}
+
 int pmc_agent_query_utc_offset(struct pmc_agent *node, int timeout)
 {
 	struct timePropertiesDS *tds;
@@ -383,21 +746,7 @@ int pmc_agent_query_utc_offset(struct pmc_agent *node, int timeout)
 	}
 
 	tds = (struct timePropertiesDS *) management_tlv_data(msg);
-	if (tds->flags & PTP_TIMESCALE) {
-		node->sync_offset = tds->currentUtcOffset;
-		if (tds->flags & LEAP_61)
-			node->leap = 1;
-		else if (tds->flags & LEAP_59)
-			node->leap = -1;
-		else
-			node->leap = 0;
-		node->utc_offset_traceable = tds->flags & UTC_OFF_VALID &&
-					     tds->flags & TIME_TRACEABLE;
-	} else {
-		node->sync_offset = 0;
-		node->leap = 0;
-		node->utc_offset_traceable = 0;
-	}
+	status_apply_tds(node, tds);
 	msg_put(msg);
 	return 0;
 }
@@ -425,6 +774,11 @@ int pmc_agent_update(struct pmc_agent *node)
 	if (!node->pmc) {
 		return 0;
 	}
+	if (node->status_name && !status_update(node)) {
+		/* Discard what is left of an earlier subscription. */
+		run_pmc(node, 0, -1, &msg);
+		return 0;
+	}
 	if (clock_gettime(CLOCK_MONOTONIC, &tp)) {
 		pr_err("failed to read clock: %m");
 		return -errno;
@@ -461,6 +815,9 @@ int pmc_agent_is_subscribed(struct pmc_agent *agent)
 	struct timespec tp;
 	uint64_t ts;
 
+	if (agent->status_valid) {
+		return 1;
+	}
 	if (clock_gettime(CLOCK_MONOTONIC, &tp)) {
 		pr_err("failed to read clock: %m");
 		return 0;
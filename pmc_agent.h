@@ -32,6 +32,9 @@ struct pmc_agent;
 typedef int pmc_node_recv_subscribed_t(void *context, struct ptp_message *msg,
 				       int excluded);
 
+typedef void pmc_agent_bulk_cb_t(void *context, struct ptp_message *msg,
+				 int id, void *data);
+
 int init_pmc_node(struct config *cfg, struct pmc_agent *agent, const char *uds,
 		  pmc_node_recv_subscribed_t *recv_subscribed, void *context);
 int run_pmc_wait_sync(struct pmc_agent *agent, int timeout);
@@ -48,12 +51,29 @@ struct pmc_agent *pmc_agent_create(void);
  */
 void pmc_agent_destroy(struct pmc_agent *agent);
 
+/**
+ * Take the port states and time properties from the shared status
+ * page published by ptp4l, whenever that page is available, instead
+ * of polling over the management interface.
+ * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
+ * @param name   The name of the page, see the status_shm option.
+ * @return       Zero on success, negative error code otherwise.
+ */
+int pmc_agent_attach_status(struct pmc_agent *agent, const char *name);
+
 /**
  * Disconnects the PMC agent from the ptp4l service.
  * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
  */
 void pmc_agent_disable(struct pmc_agent *agent);
 
+/**
+ * Gets the socket used to talk to ptp4l, for waiting on notifications.
+ * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
+ * @return       The file descriptor, or -1 if the agent is disabled.
+ */
+int pmc_agent_get_fd(struct pmc_agent *agent);
+
 /**
  * Gets the current leap adjustment.
  * @param agent  Pointer to a PMC instance obtained via @ref pmc_agent_create().
@@ -92,6 +112,29 @@ int pmc_agent_get_sync_offset(struct pmc_agent *agent);
  */
 int pmc_agent_query_dds(struct pmc_agent *agent, int timeout);
 
+/**
+ * Queries several data sets from the ptp4l service with a single
+ * request, which ptp4l answers with as few responses as fit.
+ *
+ * In addition:
+ *
+ * - The port state notification callback might be invoked.
+ *
+ * @param agent    Pointer to a PMC instance obtained via @ref pmc_agent_create().
+ * @param timeout  Transmit and receive timeout in milliseconds.
+ * @param ids      The management IDs of interest, at most 64.
+ * @param n_ids    The number of elements in 'ids'.
+ * @param cb       Invoked with the data of every matching TLV received.
+ * @param context  Passed to 'cb'.
+ * @return         Zero once every ID was answered at least once,
+ *                 -ENODEV if ptp4l rejected one of the IDs,
+ *                 -EOPNOTSUPP if ptp4l does not support bulk queries,
+ *                 other negative error code otherwise.
+ */
+int pmc_agent_query_bulk(struct pmc_agent *agent, int timeout,
+			 const int *ids, int n_ids,
+			 pmc_agent_bulk_cb_t *cb, void *context);
+
 /**
  * Queries the port properties of a given port from the ptp4l service.
  *
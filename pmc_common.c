@@ -35,6 +35,7 @@
 #define BAD_ID       -1
 #define AMBIGUOUS_ID -2
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+#define MAX_BULK_GET 64
 
 /*
    Field                  Len  Type
@@ -160,6 +161,7 @@ struct management_id idtab[] = {
 	{ "POWER_PROFILE_SETTINGS_NP", MID_P_POWER_PROFILE_SETTINGS_NP, do_set_action },
 	{ "CMLDS_INFO_NP", MID_P_CMLDS_INFO_NP, do_get_action },
 	{ "PORT_CORRECTIONS_NP", MID_P_PORT_CORRECTIONS_NP, do_set_action },
+	{ "UNICAST_SERVICE_LOAD_NP", MID_P_UNICAST_SERVICE_LOAD_NP, do_get_action },
 };
 
 static void do_get_action(struct pmc *pmc, int action, int index, char *str)
@@ -731,6 +733,9 @@ static int pmc_tlv_datalen(struct pmc *pmc, int id)
 	case MID_P_PORT_SERVICE_STATS_NP:
 		len += sizeof(struct port_service_stats_np);
 		break;
+	case MID_P_UNICAST_SERVICE_LOAD_NP:
+		len += sizeof(struct unicast_service_load_np);
+		break;
 	case MID_P_UNICAST_MASTER_TABLE_NP:
 		len += EMPTY_UNICAST_MASTER_TABLE_NP;
 		break;
@@ -808,6 +813,36 @@ int pmc_send_get_action(struct pmc *pmc, int id)
 	return 0;
 }
 
+int pmc_send_get_bulk(struct pmc *pmc, const int *ids, int n_ids)
+{
+	struct management_tlv *mgt;
+	struct ptp_message *msg;
+	struct tlv_extra *extra;
+	int i;
+
+	msg = pmc_message(pmc, GET);
+	if (!msg) {
+		return -1;
+	}
+	/* The TLVs are always empty, keeping the request small. */
+	for (i = 0; i < n_ids; i++) {
+		extra = msg_tlv_append(msg, sizeof(*mgt));
+		if (!extra) {
+			msg_put(msg);
+			return -1;
+		}
+		mgt = (struct management_tlv *) extra->tlv;
+		mgt->type = TLV_MANAGEMENT;
+		mgt->length = sizeof(mgt->id);
+		mgt->id = ids[i];
+	}
+
+	pmc_send(pmc, msg);
+	msg_put(msg);
+
+	return 0;
+}
+
 int pmc_send_set_action(struct pmc *pmc, int id, void *data, int datasize)
 {
 	struct management_tlv *mgt;
@@ -967,6 +1002,49 @@ const char *pmc_action_string(int action)
 	return action_string[action];
 }
 
+/*
+ * Handle a GET listing more than one ID. Returns one if the command
+ * was dealt with, either sent or refused with a message, zero if it
+ * lists a single ID and -1 if it is malformed.
+ */
+static int do_bulk_get(struct pmc *pmc, char *str)
+{
+	int ids[MAX_BULK_GET], index, len, n_ids = 0, offset = 0;
+	char id_str[64+1] = {0};
+
+	if (sscanf(str, " %*10s%n", &offset) < 0 || !offset) {
+		return 0;
+	}
+	while (1 == sscanf(str + offset, " %64s%n", id_str, &len)) {
+		offset += len;
+		index = parse_id(id_str);
+		if (index == BAD_ID) {
+			fprintf(stdout, "unknown id %s\n", id_str);
+			return -1;
+		}
+		if (index == AMBIGUOUS_ID) {
+			fprintf(stdout, "id %s is too ambiguous\n", id_str);
+			return 1;
+		}
+		if (idtab[index].func == not_supported) {
+			not_supported(pmc, GET, index, str);
+			return 1;
+		}
+		if (n_ids == MAX_BULK_GET) {
+			fprintf(stdout, "too many ids, at most %d\n",
+				MAX_BULK_GET);
+			return 1;
+		}
+		ids[n_ids++] = idtab[index].code;
+	}
+	if (n_ids < 2) {
+		return 0;
+	}
+	fprintf(stdout, "sending: GET %d ids\n", n_ids);
+	pmc_send_get_bulk(pmc, ids, n_ids);
+	return 1;
+}
+
 int pmc_do_command(struct pmc *pmc, char *str)
 {
 	int action, id;
@@ -994,6 +1072,15 @@ int pmc_do_command(struct pmc *pmc, char *str)
 		return 0;
 	}
 
+	if (action == GET) {
+		switch (do_bulk_get(pmc, str)) {
+		case 1:
+			return 0;
+		case -1:
+			return -1;
+		}
+	}
+
 	fprintf(stdout, "sending: %s %s\n",
 		action_string[action], idtab[id].name);
 
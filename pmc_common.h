@@ -40,6 +40,9 @@ int pmc_get_transport_fd(struct pmc *pmc);
 
 int pmc_send_get_action(struct pmc *pmc, int id);
 
+/* Send one GET listing several IDs, answered by as few responses as fit. */
+int pmc_send_get_bulk(struct pmc *pmc, const int *ids, int n_ids);
+
 int pmc_send_set_action(struct pmc *pmc, int id, void *data, int datasize);
 
 int pmc_send_set_aton(struct pmc *pmc, int id, uint8_t key, const char *name);
@@ -29,6 +29,7 @@
 #include "bmc.h"
 #include "clock.h"
 #include "designated_fsm.h"
+#include "evlog.h"
 #include "filter.h"
 #include "missing.h"
 #include "msg.h"
@@ -564,6 +565,9 @@ static struct follow_up_info_tlv *follow_up_info_extract(struct ptp_message *m)
 	struct follow_up_info_tlv *f;
 	struct tlv_extra *extra;
 
+	if (msg_tlv_decode(m)) {
+		return NULL;
+	}
 	TAILQ_FOREACH(extra, &m->tlv_list, list) {
 		f = (struct follow_up_info_tlv *) extra->tlv;
 		if (f->type == TLV_ORGANIZATION_EXTENSION &&
@@ -910,6 +914,7 @@ static int port_management_fill_response(struct port *target,
 	struct ieee_c37_238_settings_np *pwr;
 	struct unicast_master_table_np *umtn;
 	struct unicast_master_address *ucma;
+	struct unicast_service_load_np *usln;
 	struct port_service_stats_np *pssn;
 	struct mgmt_clock_description *cd;
 	struct management_tlv_datum *mtd;
@@ -931,10 +936,11 @@ static int port_management_fill_response(struct port *target,
 	uint8_t *buf;
 	int datalen;
 
+	/* Append after any TLVs already present in a bulk response. */
 	extra = calloc(1, sizeof(struct tlv_extra));
-	extra->tlv = (struct TLV *) rsp->management.suffix;
+	extra->tlv = (struct TLV *) (rsp->data.buffer + rsp->header.messageLength);
 
-	tlv = (struct management_tlv *) rsp->management.suffix;
+	tlv = (struct management_tlv *) extra->tlv;
 	tlv->type = TLV_MANAGEMENT;
 	tlv->id = id;
 
@@ -1106,6 +1112,12 @@ static int port_management_fill_response(struct port *target,
 		pssn->stats = target->service_stats;
 		datalen = sizeof(*pssn);
 		break;
+	case MID_P_UNICAST_SERVICE_LOAD_NP:
+		usln = (struct unicast_service_load_np *)tlv->data;
+		unicast_service_load(target, usln);
+		usln->portIdentity = target->portIdentity;
+		datalen = sizeof(*usln);
+		break;
 	case MID_P_UNICAST_MASTER_TABLE_NP:
 		umtn = (struct unicast_master_table_np *)tlv->data;
 		buf = tlv->data + sizeof(umtn->actual_table_size);
@@ -1360,6 +1372,9 @@ static int port_set_sync_tx_tmo(struct port *p)
 void port_show_transition(struct port *p, enum port_state next,
 			  enum fsm_event event)
 {
+	evlog_event(EVLOG_PORT_STATE, portnum(p), p->state, next, event,
+		    event == EV_FAULT_DETECTED ? last_fault_type(p) : 0, NULL);
+
 	if (event == EV_FAULT_DETECTED) {
 		pr_notice("%s: %s to %s on %s (%s)", p->log_name,
 			  ps_str[p->state], ps_str[next], ev_str[event],
@@ -2299,6 +2314,69 @@ out:
 	return err;
 }
 
+/* Prepares the Delay_Resp template, again when the interval changes. */
+static int port_delay_resp_template(struct port *p)
+{
+	struct ptp_message *msg = p->delay_resp_tmpl;
+
+	if (msg && msg->header.logMessageInterval == p->logMinDelayReqInterval) {
+		return 0;
+	}
+	if (!msg) {
+		msg = msg_allocate();
+		if (!msg) {
+			return -1;
+		}
+		p->delay_resp_buf = msg_allocate();
+		if (!p->delay_resp_buf) {
+			msg_put(msg);
+			return -1;
+		}
+		p->delay_resp_buf->hwts.type = p->timestamping;
+		p->delay_resp_tmpl = msg;
+	}
+	memset(&msg->delay_resp, 0, sizeof(msg->delay_resp));
+
+	msg->header.tsmt               = DELAY_RESP | p->transportSpecific;
+	msg->header.ver                = ptp_hdr_ver;
+	msg->header.messageLength      = sizeof(struct delay_resp_msg);
+	msg->header.sourcePortIdentity = p->portIdentity;
+	msg->header.logMessageInterval = p->logMinDelayReqInterval;
+
+	return msg_pre_send(msg);
+}
+
+/*
+ * Answers a Delay_Req by patching the template into a buffer which is
+ * reused for every response, leaving out the general message path.
+ */
+static int port_delay_resp_fast(struct port *p, struct ptp_message *m)
+{
+	struct ptp_message *msg;
+	int cnt;
+
+	if (port_delay_resp_template(p)) {
+		return -1;
+	}
+	msg = p->delay_resp_buf;
+	msg_delay_resp_fill(msg, p->delay_resp_tmpl, m);
+
+	if (p->hybrid_e2e && msg_unicast(m)) {
+		msg->address = m->address;
+		msg->header.flagField[0] |= UNICAST;
+		msg->header.logMessageInterval = 0x7f;
+		cnt = transport_sendto(p->trp, &p->fda, TRANS_GENERAL, msg);
+	} else {
+		cnt = transport_send(p->trp, &p->fda, TRANS_GENERAL, msg);
+	}
+	if (cnt <= 0) {
+		pr_err("%s: send delay response failed", p->log_name);
+		return -1;
+	}
+	port_stats_inc_tx(p, msg);
+	return 0;
+}
+
 static int process_delay_req(struct port *p, struct ptp_message *m)
 {
 	struct ptp_message *msg;
@@ -2315,6 +2393,10 @@ static int process_delay_req(struct port *p, struct ptp_message *m)
 		return 0;
 	}
 
+	if (!nsm && !port_has_security(p)) {
+		return port_delay_resp_fast(p, m);
+	}
+
 	msg = msg_allocate();
 	if (!msg) {
 		return -1;
@@ -2802,6 +2884,10 @@ void port_close(struct port *p)
 
 	unicast_client_cleanup(p);
 	unicast_service_cleanup(p);
+	if (p->delay_resp_tmpl) {
+		msg_put(p->delay_resp_tmpl);
+		msg_put(p->delay_resp_buf);
+	}
 	transport_destroy(p->trp);
 	tsproc_destroy(p->tsproc);
 	if (p->fault_fd >= 0) {
@@ -3196,7 +3282,7 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 			return EV_NONE;
 		}
 	}
-	err = msg_post_recv(msg, cnt);
+	err = msg_post_recv_lazy(msg, cnt);
 	if (err) {
 		switch (err) {
 		case -EBADMSG:
@@ -3325,6 +3411,19 @@ int port_forward_to(struct port *p, struct ptp_message *msg)
 	return 0;
 }
 
+int port_forward_many(struct port *p, struct ptp_message *msg,
+		      struct mmsghdr *msgvec, unsigned int vlen)
+{
+	int cnt;
+
+	cnt = transport_sendmany(p->trp, &p->fda, msgvec, vlen);
+	if (cnt < 0) {
+		return cnt;
+	}
+	p->stats.txMsgType[msg_type(msg)] += cnt;
+	return cnt;
+}
+
 int port_prepare_and_send(struct port *p, struct ptp_message *msg,
 			  enum transport_event event)
 {
@@ -3358,11 +3457,33 @@ struct PortIdentity port_identity(struct port *p)
 	return p->portIdentity;
 }
 
+void port_get_stats(struct port *p, struct PortStats *stats,
+		    struct PortServiceStats *service_stats)
+{
+	*stats = p->stats;
+	*service_stats = p->service_stats;
+}
+
 int port_number(struct port *p)
 {
 	return portnum(p);
 }
 
+const char *port_name(struct port *p)
+{
+	return p->name;
+}
+
+struct port *port_next(struct port *p)
+{
+	return LIST_NEXT(p, list);
+}
+
+struct unicast_master_table *port_unicast_master_table(struct port *p)
+{
+	return p->unicast_master_table;
+}
+
 const char *port_log_name(struct port *p)
 {
 	return p->log_name;
@@ -3373,6 +3494,96 @@ int port_link_status_get(struct port *p)
 	return !!(p->link_status & LINK_UP);
 }
 
+/* Port level IDs which are known but not implemented. */
+static int port_management_unsupported(int id)
+{
+	switch (id) {
+	case MID_P_NULL_MANAGEMENT:
+	case MID_P_CLOCK_DESCRIPTION:
+	case MID_P_PORT_DATA_SET:
+	case MID_P_LOG_ANNOUNCE_INTERVAL:
+	case MID_P_ANNOUNCE_RECEIPT_TIMEOUT:
+	case MID_P_LOG_SYNC_INTERVAL:
+	case MID_P_VERSION_NUMBER:
+	case MID_P_ENABLE_PORT:
+	case MID_P_DISABLE_PORT:
+	case MID_P_UNICAST_NEGOTIATION_ENABLE:
+	case MID_P_UNICAST_MASTER_TABLE:
+	case MID_P_UNICAST_MASTER_MAX_TABLE_SIZE:
+	case MID_P_ACCEPTABLE_MASTER_TABLE_ENABLED:
+	case MID_P_ALTERNATE_MASTER:
+	case MID_P_MASTER_ONLY:
+	case MID_P_TRANSPARENT_CLOCK_PORT_DATA_SET:
+	case MID_P_DELAY_MECHANISM:
+	case MID_P_LOG_MIN_PDELAY_REQ_INTERVAL:
+		return 1;
+	}
+	return 0;
+}
+
+int port_management_bulk_fits(struct ptp_message *rsp, int id)
+{
+	if (rsp->header.messageLength == sizeof(struct management_msg)) {
+		return 1;
+	}
+	switch (id) {
+	case MID_P_CLOCK_DESCRIPTION:
+	case MID_P_UNICAST_MASTER_TABLE_NP:
+		/* Variable length, these get a message of their own. */
+		return 0;
+	}
+	return rsp->header.messageLength + MGMT_BULK_TLV_MAX <= MGMT_BULK_MAX_LEN;
+}
+
+int port_manage_bulk(struct port *p, struct port *ingress,
+		     struct ptp_message *req, int *ids, int *n_ids)
+{
+	UInteger16 target = req->management.targetPortIdentity.portNumber;
+	struct ptp_message *rsp = NULL;
+	int i = 0, answers = 0;
+
+	if (target != portnum(p) && target != 0xffff) {
+		return 0;
+	}
+	while (i < *n_ids) {
+		if (rsp && !port_management_bulk_fits(rsp, ids[i])) {
+			port_prepare_and_send(ingress, rsp, TRANS_GENERAL);
+			msg_put(rsp);
+			rsp = NULL;
+		}
+		if (!rsp) {
+			rsp = port_management_reply(port_identity(p), ingress,
+						    req);
+			if (!rsp) {
+				return answers;
+			}
+		}
+		if (port_management_fill_response(p, rsp, ids[i])) {
+			answers++;
+		} else if (port_management_unsupported(ids[i])) {
+			if (!port_management_append_error(rsp, ids[i],
+							  MID_E_NOT_SUPPORTED))
+				answers++;
+		} else {
+			if (!port_management_append_error(rsp, ids[i],
+							  MID_E_NO_SUCH_ID))
+				answers++;
+			(*n_ids)--;
+			memmove(&ids[i], &ids[i + 1],
+				(*n_ids - i) * sizeof(ids[0]));
+			continue;
+		}
+		i++;
+	}
+	if (rsp) {
+		if (rsp->header.messageLength > sizeof(struct management_msg)) {
+			port_prepare_and_send(ingress, rsp, TRANS_GENERAL);
+		}
+		msg_put(rsp);
+	}
+	return answers;
+}
+
 int port_manage(struct port *p, struct port *ingress, struct ptp_message *msg)
 {
 	struct management_tlv *mgt;
@@ -3398,41 +3609,37 @@ int port_manage(struct port *p, struct port *ingress, struct ptp_message *msg)
 		return -1;
 	}
 
-	switch (mgt->id) {
-	case MID_P_NULL_MANAGEMENT:
-	case MID_P_CLOCK_DESCRIPTION:
-	case MID_P_PORT_DATA_SET:
-	case MID_P_LOG_ANNOUNCE_INTERVAL:
-	case MID_P_ANNOUNCE_RECEIPT_TIMEOUT:
-	case MID_P_LOG_SYNC_INTERVAL:
-	case MID_P_VERSION_NUMBER:
-	case MID_P_ENABLE_PORT:
-	case MID_P_DISABLE_PORT:
-	case MID_P_UNICAST_NEGOTIATION_ENABLE:
-	case MID_P_UNICAST_MASTER_TABLE:
-	case MID_P_UNICAST_MASTER_MAX_TABLE_SIZE:
-	case MID_P_ACCEPTABLE_MASTER_TABLE_ENABLED:
-	case MID_P_ALTERNATE_MASTER:
-	case MID_P_MASTER_ONLY:
-	case MID_P_TRANSPARENT_CLOCK_PORT_DATA_SET:
-	case MID_P_DELAY_MECHANISM:
-	case MID_P_LOG_MIN_PDELAY_REQ_INTERVAL:
+	if (port_management_unsupported(mgt->id)) {
 		port_management_send_error(p, ingress, msg, MID_E_NOT_SUPPORTED);
-		break;
-	default:
-		port_management_send_error(p, ingress, msg, MID_E_NO_SUCH_ID);
-		return -1;
+		return 1;
 	}
-	return 1;
+	port_management_send_error(p, ingress, msg, MID_E_NO_SUCH_ID);
+	return -1;
+}
+
+int port_management_append_error(struct ptp_message *rsp, int id,
+				 Enumeration16 error_id)
+{
+	struct management_error_status *mes;
+	struct tlv_extra *extra;
+
+	extra = msg_tlv_append(rsp, sizeof(*mes));
+	if (!extra) {
+		return -ENOMEM;
+	}
+	mes = (struct management_error_status *) extra->tlv;
+	mes->type = TLV_MANAGEMENT_ERROR_STATUS;
+	mes->length = 8;
+	mes->error = error_id;
+	mes->id = id;
+	return 0;
 }
 
 int port_management_error(struct PortIdentity pid, struct port *ingress,
 			  struct ptp_message *req, Enumeration16 error_id)
 {
-	struct management_error_status *mes;
 	struct management_tlv *mgt;
 	struct ptp_message *msg;
-	struct tlv_extra *extra;
 	int err = 0;
 
 	mgt = (struct management_tlv *) req->management.suffix;
@@ -3441,16 +3648,11 @@ int port_management_error(struct PortIdentity pid, struct port *ingress,
 		return -1;
 	}
 
-	extra = msg_tlv_append(msg, sizeof(*mes));
-	if (!extra) {
+	err = port_management_append_error(msg, mgt->id, error_id);
+	if (err) {
 		msg_put(msg);
-		return -ENOMEM;
+		return err;
 	}
-	mes = (struct management_error_status *) extra->tlv;
-	mes->type = TLV_MANAGEMENT_ERROR_STATUS;
-	mes->length = 8;
-	mes->error = error_id;
-	mes->id = mgt->id;
 
 	err = port_prepare_and_send(ingress, msg, TRANS_GENERAL);
 	msg_put(msg);
@@ -3789,6 +3991,11 @@ int port_state_update(struct port *p, enum fsm_event event, int mdiff)
 {
 	enum port_state next = p->state_machine(p->state, event, mdiff);
 
+	if (event == EV_FAULT_DETECTED) {
+		evlog_event(EVLOG_FAULT, portnum(p), p->state, next,
+			    last_fault_type(p), 0, NULL);
+	}
+
 	if (PS_FAULTY == next) {
 		struct fault_interval i;
 		fault_interval(p, last_fault_type(p), &i);
@@ -31,6 +31,7 @@
 /* forward declarations */
 struct interface;
 struct clock;
+struct unicast_master_table;
 
 /** Opaque type. */
 struct port;
@@ -103,6 +104,20 @@ int port_forward(struct port *p, struct ptp_message *msg);
  */
 int port_forward_to(struct port *p, struct ptp_message *msg);
 
+/**
+ * Forward a batch of copies of a message on a given port, each to its
+ * own address.
+ * @param port    A pointer previously obtained via port_open().
+ * @param msg     The message being sent, used for the statistics.
+ * @param msgvec  The copies to send. Must be in network byte order.
+ * @param vlen    The number of entries in 'msgvec'.
+ * @return        The number of copies sent, which is less than 'vlen'
+ *                when some of them failed, or a negative errno value
+ *                when none could be sent.
+ */
+int port_forward_many(struct port *p, struct ptp_message *msg,
+		      struct mmsghdr *msgvec, unsigned int vlen);
+
 /**
  * Prepare message for transmission and send it to a given port. Note that
  * a single message cannot be sent several times using this function, that
@@ -129,6 +144,36 @@ struct PortIdentity port_identity(struct port *p);
  */
 int port_number(struct port *p);
 
+/**
+ * Obtain a copy of a port's message and service counters.
+ * @param p              A port instance.
+ * @param stats          Buffer receiving the message counters.
+ * @param service_stats  Buffer receiving the service counters.
+ */
+void port_get_stats(struct port *p, struct PortStats *stats,
+		    struct PortServiceStats *service_stats);
+
+/**
+ * Obtain the name of a port's network interface.
+ * @param p        A port instance.
+ * @return         The interface name of 'p'.
+ */
+const char *port_name(struct port *p);
+
+/**
+ * Obtain the port following a given one in its clock's list of ports.
+ * @param p        A port instance.
+ * @return         The next port, or NULL if 'p' is the last one.
+ */
+struct port *port_next(struct port *p);
+
+/**
+ * Obtain a port's table of unicast masters.
+ * @param p        A port instance.
+ * @return         The table, or NULL if the port has none.
+ */
+struct unicast_master_table *port_unicast_master_table(struct port *p);
+
 /**
  * Obtain a port's name for logging purposes.
  * @param p        A port instance.
@@ -153,6 +198,49 @@ int port_link_status_get(struct port *p);
  */
 int port_manage(struct port *p, struct port *ingress, struct ptp_message *msg);
 
+/*
+ * Responses to a bulk GET are limited so that they fit into a single
+ * datagram on a standard Ethernet MTU, and every TLV of fixed length
+ * is at most MGMT_BULK_TLV_MAX bytes long.
+ */
+#define MGMT_BULK_MAX_LEN	1400
+#define MGMT_BULK_TLV_MAX	320
+
+/**
+ * Test whether another management TLV may be appended to a bulk response.
+ * @param rsp  A response under construction.
+ * @param id   The management ID of the next TLV.
+ * @return     One if the TLV may be appended, zero if 'rsp' must be
+ *             sent first.
+ */
+int port_management_bulk_fits(struct ptp_message *rsp, int id);
+
+/**
+ * Answer the port level IDs of a bulk GET request, which lists
+ * several management TLVs in a single message. The responses carry
+ * as many TLVs as fit. An ID that cannot be answered gets a management
+ * error status TLV instead, and an ID that no port knows is removed
+ * from 'ids' so that only the first port reports it.
+ * @param p        A port instance.
+ * @param ingress  The port on which 'req' was received.
+ * @param req      A management GET request.
+ * @param ids      The management IDs to answer.
+ * @param n_ids    The number of elements in 'ids', updated on return.
+ * @return         The number of TLVs sent.
+ */
+int port_manage_bulk(struct port *p, struct port *ingress,
+		     struct ptp_message *req, int *ids, int *n_ids);
+
+/**
+ * Append a management error status TLV to a response.
+ * @param rsp       A management response under construction.
+ * @param id        The management ID which caused the error.
+ * @param error_id  One of the management error ID values.
+ * @return          Zero on success, non-zero otherwise.
+ */
+int port_management_append_error(struct ptp_message *rsp, int id,
+				 Enumeration16 error_id);
+
 /**
  * Send a management error status message.
  * @param pid       The id of the responding port.
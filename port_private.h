@@ -82,6 +82,9 @@ struct port {
 	struct ptp_message *last_syncfup;
 #define DELAY_RESP_TIMEOUT 5 // seconds
 	TAILQ_HEAD(delay_req, ptp_message) delay_req;
+	/* Delay_Resp template and its buffer, for the master. */
+	struct ptp_message *delay_resp_tmpl;
+	struct ptp_message *delay_resp_buf;
 	struct ptp_message *peer_delay_req;
 	struct ptp_message *peer_delay_resp;
 	struct ptp_message *peer_delay_fup;
@@ -156,6 +156,10 @@ int process_signaling(struct port *p, struct ptp_message *m)
 		return 0;
 	}
 
+	if (msg_tlv_decode(m)) {
+		pr_err("%s: bad message", p->log_name);
+		return 0;
+	}
 	TAILQ_FOREACH(extra, &m->tlv_list, list) {
 		switch (extra->tlv->type) {
 		case TLV_REQUEST_UNICAST_TRANSMISSION:
@@ -16,19 +16,55 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "print.h"
 
+#define PRINT_BUF_SIZE 1024
+#define PRINT_QUEUE_MAX 1024
+
+struct print_record {
+	struct timespec ts;
+	int level;
+	char buf[PRINT_BUF_SIZE];
+};
+
+/*
+ * Single producer ring of formatted records. Only the thread which
+ * enabled the queue writes into the ring, all other threads fall back
+ * to synchronous output. The head is advanced by the producer and the
+ * tail by the writer thread. The producer only wakes the writer when
+ * the ring goes from empty to non-empty. Both indices are stored and
+ * reread with sequential consistency, so that either the writer sees
+ * the new head or the producer sees the ring drained and posts.
+ */
+struct print_queue {
+	struct print_record *ring;
+	unsigned int mask;
+	unsigned int head;
+	unsigned int tail;
+	unsigned long dropped;
+	int running;
+	pthread_t owner;
+	pthread_t writer;
+	sem_t pending;
+};
+
 static int verbose = 0;
 int print_level = LOG_INFO;
 static int use_syslog = 1;
 static const char *progname;
 static const char *message_tag;
+static struct print_queue queue;
 
 void print_set_progname(const char *name)
 {
@@ -55,23 +91,12 @@ void print_set_verbose(int value)
 	verbose = value ? 1 : 0;
 }
 
-void print(int level, char const *format, ...)
+static void print_emit(int level, struct timespec *ts, const char *buf)
 {
-	char buf[1024], tag[128], *s;
-	struct timespec ts;
+	char tag[128], *s;
 	const char *v;
-	va_list ap;
 	FILE *f;
 
-	if (level > print_level)
-		return;
-
-	do_clock_gettime(CLOCK_MONOTONIC, &ts);
-
-	va_start(ap, format);
-	vsnprintf(buf, sizeof(buf), format, ap);
-	va_end(ap);
-
 	if (message_tag) {
 		snprintf(tag, sizeof(tag), "%s ", message_tag);
 		v = "{level}";
@@ -88,11 +113,164 @@ void print(int level, char const *format, ...)
 		f = level >= LOG_NOTICE ? stdout : stderr;
 		fprintf(f, "%s[%lld.%03ld]: %s%s\n",
 			progname ? progname : "",
-			(long long)ts.tv_sec, ts.tv_nsec / 1000000, tag, buf);
+			(long long)ts->tv_sec, ts->tv_nsec / 1000000, tag, buf);
 		fflush(f);
 	}
 	if (use_syslog) {
 		syslog(level, "[%lld.%03ld] %s%s",
-		       (long long)ts.tv_sec, ts.tv_nsec / 1000000, tag, buf);
+		       (long long)ts->tv_sec, ts->tv_nsec / 1000000, tag, buf);
+	}
+}
+
+static void print_drain(void)
+{
+	struct print_record *rec;
+	unsigned int head, tail;
+	struct timespec ts;
+	unsigned long dropped;
+	char buf[64];
+
+	tail = queue.tail;
+	while (tail != (head = __atomic_load_n(&queue.head, __ATOMIC_SEQ_CST))) {
+		for (; tail != head; tail++) {
+			rec = &queue.ring[tail & queue.mask];
+			print_emit(rec->level, &rec->ts, rec->buf);
+			__atomic_store_n(&queue.tail, tail + 1, __ATOMIC_SEQ_CST);
+		}
+	}
+
+	dropped = __atomic_exchange_n(&queue.dropped, 0, __ATOMIC_RELAXED);
+	if (dropped) {
+		do_clock_gettime(CLOCK_MONOTONIC, &ts);
+		snprintf(buf, sizeof(buf), "log queue full, dropped %lu messages",
+			 dropped);
+		print_emit(LOG_WARNING, &ts, buf);
+	}
+}
+
+static void *print_writer(void *arg)
+{
+	while (1) {
+		if (sem_wait(&queue.pending)) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		print_drain();
+		if (!__atomic_load_n(&queue.running, __ATOMIC_ACQUIRE)) {
+			print_drain();
+			break;
+		}
+	}
+	return NULL;
+}
+
+int print_set_queue_size(int size)
+{
+	sigset_t all, old;
+	unsigned int n;
+	int err;
+
+	if (queue.ring || size <= 0) {
+		return 0;
+	}
+	if (size > PRINT_QUEUE_MAX) {
+		size = PRINT_QUEUE_MAX;
 	}
+	for (n = 1; n < size; n <<= 1)
+		;
+
+	queue.ring = calloc(n, sizeof(*queue.ring));
+	if (!queue.ring) {
+		return -1;
+	}
+	queue.mask = n - 1;
+	queue.head = 0;
+	queue.tail = 0;
+	queue.dropped = 0;
+	queue.running = 1;
+	queue.owner = pthread_self();
+	if (sem_init(&queue.pending, 0, 0)) {
+		goto no_sem;
+	}
+
+	/* Leave the signal handling to the main thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	err = pthread_create(&queue.writer, NULL, print_writer, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err) {
+		goto no_thread;
+	}
+	return 0;
+
+no_thread:
+	sem_destroy(&queue.pending);
+no_sem:
+	free(queue.ring);
+	queue.ring = NULL;
+	return -1;
+}
+
+void print_cleanup(void)
+{
+	struct print_record *ring = queue.ring;
+
+	if (!ring || !pthread_equal(pthread_self(), queue.owner)) {
+		return;
+	}
+	__atomic_store_n(&queue.running, 0, __ATOMIC_RELEASE);
+	sem_post(&queue.pending);
+	pthread_join(queue.writer, NULL);
+	sem_destroy(&queue.pending);
+	queue.ring = NULL;
+	free(ring);
+}
+
+static void print_enqueue(int level, struct timespec *ts,
+			  char const *format, va_list ap)
+{
+	struct print_record *rec;
+	unsigned int head, tail;
+
+	head = queue.head;
+	tail = __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE);
+	if (head - tail > queue.mask) {
+		__atomic_add_fetch(&queue.dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	rec = &queue.ring[head & queue.mask];
+	rec->ts = *ts;
+	rec->level = level;
+	vsnprintf(rec->buf, sizeof(rec->buf), format, ap);
+	__atomic_store_n(&queue.head, head + 1, __ATOMIC_SEQ_CST);
+
+	/* Only wake up the writer if it may have seen an empty ring. */
+	if (__atomic_load_n(&queue.tail, __ATOMIC_SEQ_CST) == head) {
+		sem_post(&queue.pending);
+	}
+}
+
+void print(int level, char const *format, ...)
+{
+	char buf[PRINT_BUF_SIZE];
+	struct timespec ts;
+	va_list ap;
+
+	if (level > print_level)
+		return;
+
+	do_clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	va_start(ap, format);
+	if (queue.ring && pthread_equal(pthread_self(), queue.owner)) {
+		print_enqueue(level, &ts, format, ap);
+		va_end(ap);
+		return;
+	}
+	vsnprintf(buf, sizeof(buf), format, ap);
+	va_end(ap);
+
+	print_emit(level, &ts, buf);
 }
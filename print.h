@@ -40,6 +40,16 @@ void print_set_syslog(int value);
 void print_set_level(int level);
 void print_set_verbose(int value);
 
+/*
+ * Queue messages from the calling thread in a ring of 'size' records
+ * and write them out from a background thread. A size of zero keeps
+ * the output synchronous.
+ */
+int print_set_queue_size(int size);
+
+/* Flush any queued messages and stop the background writer. */
+void print_cleanup(void);
+
 /*
  * Better check print log level before execution of print itself.
  * Otherwise all arguments are evaluated and slow down the system.
@@ -25,6 +25,7 @@
 
 #include "clock.h"
 #include "config.h"
+#include "evlog.h"
 #include "ntpshm.h"
 #include "pi.h"
 #include "print.h"
@@ -225,6 +226,17 @@ int main(int argc, char *argv[])
 	print_set_verbose(config_get_int(cfg, NULL, "verbose"));
 	print_set_syslog(config_get_int(cfg, NULL, "use_syslog"));
 	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+	if (print_set_queue_size(config_get_int(cfg, NULL, "log_queue_size"))) {
+		fprintf(stderr, "failed to start the log writer\n");
+		goto out;
+	}
+
+	if (*config_get_string(cfg, NULL, "event_log") &&
+	    evlog_open(config_get_string(cfg, NULL, "event_log"),
+		       config_get_int(cfg, NULL, "event_log_size"))) {
+		fprintf(stderr, "failed to open the event log\n");
+		goto out;
+	}
 
 	assume_two_step = config_get_int(cfg, NULL, "assume_two_step");
 	sk_check_fupsync = config_get_int(cfg, NULL, "check_fup_sync");
@@ -302,6 +314,8 @@ out:
 	if (clock)
 		clock_destroy(clock);
 	sad_destroy(cfg);
+	evlog_close();
+	print_cleanup();
 	config_destroy(cfg);
 	return err;
 }
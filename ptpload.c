@@ -0,0 +1,713 @@
+/**
+ * @file ptpload.c
+ * @brief Simulates many unicast slaves to load a master
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "address.h"
+#include "config.h"
+#include "ddt.h"
+#include "msg.h"
+#include "print.h"
+#include "stats.h"
+#include "tlv.h"
+#include "util.h"
+#include "version.h"
+
+#define EVENT_PORT		319
+#define GENERAL_PORT		320
+/* Outstanding Delay_Req messages remembered per slave. */
+#define PTPLOAD_SLOTS		16
+/* Seconds before a denied or unanswered request is repeated. */
+#define PTPLOAD_RETRY		1
+/* Seconds over which the first requests of the slaves are spread. */
+#define PTPLOAD_SPREAD		1
+
+enum {
+	SLAVE_EVENT,
+	SLAVE_GENERAL,
+	SLAVE_NFD
+};
+
+struct delay_slot {
+	struct timespec sent;
+	UInteger16 seq;
+	int pending;
+};
+
+struct slave {
+	struct PortIdentity pid;
+	struct in_addr addr;
+	int fd[SLAVE_NFD];
+	UInteger16 seq_delay;
+	UInteger16 seq_signaling;
+	/* Message types granted by the master. */
+	unsigned int granted;
+	/* Whether a reply to the last request was seen. */
+	int answered;
+	struct timespec next_request;
+	struct timespec next_delay;
+	struct delay_slot slot[PTPLOAD_SLOTS];
+};
+
+struct counters {
+	unsigned int requests;
+	unsigned int grants;
+	unsigned int denials;
+	unsigned int shortened;
+	unsigned int cancels;
+	unsigned int delay_req;
+	unsigned int delay_resp;
+	unsigned int lost;
+	unsigned int unmatched;
+	unsigned int sync;
+	unsigned int follow_up;
+	unsigned int announce;
+	unsigned int errors;
+};
+
+struct ptpload {
+	struct config *cfg;
+	struct slave *slaves;
+	struct pollfd *pfd;
+	int n_slaves;
+	struct sockaddr_in master[SLAVE_NFD];
+	UInteger8 domain;
+	UInteger8 transport_specific;
+	int log_announce;
+	int log_sync;
+	int log_delay;
+	unsigned int duration;
+	int storm;
+	struct stats *latency;
+	struct counters cnt;
+};
+
+static const struct PortIdentity all_ports = {
+	.clockIdentity = {
+		{0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}
+	},
+	.portNumber = 0xffff,
+};
+
+static void ts_add_ns(struct timespec *ts, int64_t ns)
+{
+	int64_t t = ts->tv_sec * NS_PER_SEC + ts->tv_nsec + ns;
+
+	ts->tv_sec = t / NS_PER_SEC;
+	ts->tv_nsec = t % NS_PER_SEC;
+}
+
+static int64_t ts_diff_ns(struct timespec *a, struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * NS_PER_SEC + a->tv_nsec - b->tv_nsec;
+}
+
+static int64_t log_to_ns(int log_period)
+{
+	return log_period < 0 ? NS_PER_SEC >> -log_period :
+		NS_PER_SEC << log_period;
+}
+
+static int open_socket(struct in_addr addr, short port)
+{
+	struct sockaddr_in sa;
+	int fd, on = 1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr = addr;
+	sa.sin_port = htons(port);
+
+	fd = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0) {
+		pr_err("socket failed: %m");
+		return -1;
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on))) {
+		pr_err("setsockopt SO_REUSEADDR failed: %m");
+		goto failed;
+	}
+	if (bind(fd, (struct sockaddr *) &sa, sizeof(sa))) {
+		pr_err("bind to %s failed: %m", inet_ntoa(addr));
+		goto failed;
+	}
+	return fd;
+failed:
+	close(fd);
+	return -1;
+}
+
+static struct ptp_message *ptpload_construct(struct ptpload *pl,
+					     struct slave *s, uint8_t type,
+					     int length, UInteger16 seq)
+{
+	struct ptp_message *msg;
+
+	msg = msg_allocate();
+	if (!msg) {
+		return NULL;
+	}
+	msg->header.tsmt               = type | pl->transport_specific;
+	msg->header.ver                = PTP_VERSION;
+	msg->header.messageLength      = length;
+	msg->header.domainNumber       = pl->domain;
+	msg->header.flagField[0]       = UNICAST;
+	msg->header.sourcePortIdentity = s->pid;
+	msg->header.sequenceId         = seq;
+	msg->header.logMessageInterval = 0x7f;
+	return msg;
+}
+
+static int ptpload_send(struct ptpload *pl, struct slave *s, int event,
+			struct ptp_message *msg)
+{
+	int cnt, len;
+
+	if (msg_pre_send(msg)) {
+		return -1;
+	}
+	len = ntohs(msg->header.messageLength);
+	cnt = sendto(s->fd[event], msg, len, 0,
+		     (struct sockaddr *) &pl->master[event],
+		     sizeof(pl->master[event]));
+	if (cnt != len) {
+		pl->cnt.errors++;
+		pr_debug("sendto failed: %m");
+		return -1;
+	}
+	return 0;
+}
+
+static int append_request(struct ptp_message *msg, uint8_t type,
+			  int log_period, unsigned int duration)
+{
+	struct request_unicast_xmit_tlv *req;
+	struct tlv_extra *extra;
+
+	extra = msg_tlv_append(msg, sizeof(*req));
+	if (!extra) {
+		return -1;
+	}
+	req = (struct request_unicast_xmit_tlv *) extra->tlv;
+	req->type = TLV_REQUEST_UNICAST_TRANSMISSION;
+	req->length = sizeof(*req) - sizeof(req->type) - sizeof(req->length);
+	req->message_type = type << 4;
+	req->logInterMessagePeriod = log_period;
+	req->durationField = duration;
+	return 0;
+}
+
+/* Requests Announce, Sync and Delay_Resp service in one message. */
+static int ptpload_request(struct ptpload *pl, struct slave *s)
+{
+	struct ptp_message *msg;
+	int err;
+
+	msg = ptpload_construct(pl, s, SIGNALING, sizeof(struct signaling_msg),
+				s->seq_signaling++);
+	if (!msg) {
+		return -1;
+	}
+	msg->signaling.targetPortIdentity = all_ports;
+
+	err = append_request(msg, ANNOUNCE, pl->log_announce, pl->duration) ||
+	      append_request(msg, SYNC, pl->log_sync, pl->duration) ||
+	      append_request(msg, DELAY_RESP, pl->log_delay, pl->duration);
+	if (!err) {
+		err = ptpload_send(pl, s, SLAVE_GENERAL, msg);
+	}
+	if (!err) {
+		pl->cnt.requests++;
+	}
+	msg_put(msg);
+	return err;
+}
+
+static int ptpload_delay_req(struct ptpload *pl, struct slave *s,
+			     struct timespec *now)
+{
+	struct delay_slot *slot;
+	struct ptp_message *msg;
+	int err;
+
+	msg = ptpload_construct(pl, s, DELAY_REQ, sizeof(struct delay_req_msg),
+				s->seq_delay);
+	if (!msg) {
+		return -1;
+	}
+	slot = &s->slot[s->seq_delay % PTPLOAD_SLOTS];
+	if (slot->pending) {
+		pl->cnt.lost++;
+	}
+	slot->seq = s->seq_delay++;
+	slot->sent = *now;
+	slot->pending = 1;
+
+	err = ptpload_send(pl, s, SLAVE_EVENT, msg);
+	if (err) {
+		slot->pending = 0;
+	} else {
+		pl->cnt.delay_req++;
+	}
+	msg_put(msg);
+	return err;
+}
+
+static void ptpload_grant(struct ptpload *pl, struct slave *s,
+			  struct ptp_message *msg, struct timespec *now)
+{
+	struct grant_unicast_xmit_tlv *g;
+	struct cancel_unicast_xmit_tlv *c;
+	unsigned int renew = pl->duration;
+	struct tlv_extra *extra;
+	struct timespec tmo;
+	int last = 0, seen = 0;
+	uint8_t type;
+
+	TAILQ_FOREACH(extra, &msg->tlv_list, list) {
+		switch (extra->tlv->type) {
+		case TLV_GRANT_UNICAST_TRANSMISSION:
+			g = (struct grant_unicast_xmit_tlv *) extra->tlv;
+			type = g->message_type >> 4;
+			seen = 1;
+			/* The Delay_Resp service is the last one requested. */
+			if (type == DELAY_RESP) {
+				last = 1;
+			}
+			if (!g->durationField) {
+				pl->cnt.denials++;
+				s->granted &= ~(1 << type);
+				renew = PTPLOAD_RETRY;
+				break;
+			}
+			pl->cnt.grants++;
+			if (g->durationField < pl->duration) {
+				pl->cnt.shortened++;
+			}
+			if (g->durationField / 2 < renew) {
+				renew = g->durationField / 2;
+			}
+			if (type == DELAY_RESP &&
+			    !(s->granted & (1 << DELAY_RESP))) {
+				s->next_delay = *now;
+			}
+			s->granted |= 1 << type;
+			break;
+		case TLV_CANCEL_UNICAST_TRANSMISSION:
+			c = (struct cancel_unicast_xmit_tlv *) extra->tlv;
+			pl->cnt.cancels++;
+			seen = 1;
+			s->granted &= ~(1 << (c->message_type_flags >> 4));
+			renew = PTPLOAD_RETRY;
+			break;
+		}
+	}
+	if (!seen) {
+		return;
+	}
+	/* The master replies to each request separately. */
+	tmo = *now;
+	tmo.tv_sec += renew ? renew : PTPLOAD_RETRY;
+	if (pl->storm && last) {
+		tmo = *now;
+	}
+	if (!s->answered || ts_diff_ns(&tmo, &s->next_request) < 0) {
+		s->next_request = tmo;
+	}
+	s->answered = 1;
+}
+
+static void ptpload_delay_resp(struct ptpload *pl, struct slave *s,
+			       struct ptp_message *msg, struct timespec *now)
+{
+	struct delay_resp_msg *rsp = &msg->delay_resp;
+	struct delay_slot *slot;
+
+	slot = &s->slot[rsp->hdr.sequenceId % PTPLOAD_SLOTS];
+	if (!pid_eq(&rsp->requestingPortIdentity, &s->pid) ||
+	    !slot->pending || slot->seq != rsp->hdr.sequenceId) {
+		pl->cnt.unmatched++;
+		return;
+	}
+	slot->pending = 0;
+	pl->cnt.delay_resp++;
+	stats_add_value(pl->latency, ts_diff_ns(now, &slot->sent) / 1e3);
+}
+
+static void ptpload_recv(struct ptpload *pl, struct slave *s, int fd)
+{
+	struct ptp_message *msg;
+	struct timespec now;
+	int cnt;
+
+	while (1) {
+		msg = msg_allocate();
+		if (!msg) {
+			return;
+		}
+		cnt = recv(fd, msg, sizeof(msg->data), MSG_DONTWAIT);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (cnt <= 0) {
+			if (cnt < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				pl->cnt.errors++;
+			}
+			msg_put(msg);
+			return;
+		}
+		if (msg_post_recv(msg, cnt)) {
+			pl->cnt.errors++;
+			msg_put(msg);
+			continue;
+		}
+		switch (msg_type(msg)) {
+		case SYNC:
+			pl->cnt.sync++;
+			break;
+		case FOLLOW_UP:
+			pl->cnt.follow_up++;
+			break;
+		case ANNOUNCE:
+			pl->cnt.announce++;
+			break;
+		case DELAY_RESP:
+			ptpload_delay_resp(pl, s, msg, &now);
+			break;
+		case SIGNALING:
+			ptpload_grant(pl, s, msg, &now);
+			break;
+		default:
+			break;
+		}
+		msg_put(msg);
+	}
+}
+
+/* Performs the due actions of the slaves, returning the next due time. */
+static void ptpload_run(struct ptpload *pl, struct timespec *now,
+			struct timespec *next)
+{
+	int64_t period = log_to_ns(pl->log_delay);
+	struct slave *s;
+	int i;
+
+	for (i = 0; i < pl->n_slaves; i++) {
+		s = &pl->slaves[i];
+		if (ts_diff_ns(now, &s->next_request) >= 0) {
+			ptpload_request(pl, s);
+			s->answered = 0;
+			/* Repeated unless answered. */
+			s->next_request = *now;
+			s->next_request.tv_sec += PTPLOAD_RETRY;
+		}
+		if (ts_diff_ns(&s->next_request, next) < 0) {
+			*next = s->next_request;
+		}
+		if (!(s->granted & (1 << DELAY_RESP))) {
+			continue;
+		}
+		if (ts_diff_ns(now, &s->next_delay) >= 0) {
+			ptpload_delay_req(pl, s, now);
+			ts_add_ns(&s->next_delay, period);
+			if (ts_diff_ns(now, &s->next_delay) >= 0) {
+				/* Fell behind, do not catch up. */
+				s->next_delay = *now;
+				ts_add_ns(&s->next_delay, period);
+			}
+		}
+		if (ts_diff_ns(&s->next_delay, next) < 0) {
+			*next = s->next_delay;
+		}
+	}
+}
+
+static void ptpload_report(struct ptpload *pl, double elapsed)
+{
+	struct stats_result res;
+	unsigned int granted = 0;
+	int i;
+
+	for (i = 0; i < pl->n_slaves; i++) {
+		if (pl->slaves[i].granted & (1 << DELAY_RESP)) {
+			granted++;
+		}
+	}
+	if (stats_get_result(pl->latency, &res)) {
+		memset(&res, 0, sizeof(res));
+	}
+	pr_info("%.1f s: slaves %u/%d granted, requests %u grants %u "
+		"denials %u shortened %u cancels %u, delay req %u resp %u "
+		"lost %u unmatched %u, latency min %.1f mean %.1f max %.1f "
+		"stddev %.1f us, sync %u fup %u announce %u, errors %u",
+		elapsed, granted, pl->n_slaves, pl->cnt.requests,
+		pl->cnt.grants, pl->cnt.denials, pl->cnt.shortened,
+		pl->cnt.cancels, pl->cnt.delay_req, pl->cnt.delay_resp,
+		pl->cnt.lost, pl->cnt.unmatched, res.min, res.mean, res.max,
+		res.stddev, pl->cnt.sync, pl->cnt.follow_up, pl->cnt.announce,
+		pl->cnt.errors);
+	memset(&pl->cnt, 0, sizeof(pl->cnt));
+	stats_reset(pl->latency);
+}
+
+static void ptpload_close(struct ptpload *pl)
+{
+	int i, j;
+
+	for (i = 0; i < pl->n_slaves; i++) {
+		for (j = 0; j < SLAVE_NFD; j++) {
+			if (pl->slaves[i].fd[j] >= 0) {
+				close(pl->slaves[i].fd[j]);
+			}
+		}
+	}
+	free(pl->slaves);
+	free(pl->pfd);
+	if (pl->latency) {
+		stats_destroy(pl->latency);
+	}
+}
+
+static int ptpload_open(struct ptpload *pl, struct config *cfg,
+			const char *master, const char *first, int n,
+			int storm)
+{
+	struct in_addr addr, base;
+	int64_t period, spread;
+	struct timespec now;
+	struct slave *s;
+	uint32_t a;
+	int i, j;
+
+	if (!inet_aton(master, &addr)) {
+		pr_err("bad master address %s", master);
+		return -1;
+	}
+	if (!inet_aton(first, &base)) {
+		pr_err("bad slave address %s", first);
+		return -1;
+	}
+	for (i = 0; i < SLAVE_NFD; i++) {
+		pl->master[i].sin_family = AF_INET;
+		pl->master[i].sin_addr = addr;
+	}
+	pl->master[SLAVE_EVENT].sin_port = htons(EVENT_PORT);
+	pl->master[SLAVE_GENERAL].sin_port = htons(GENERAL_PORT);
+
+	pl->cfg = cfg;
+	pl->domain = config_get_int(cfg, NULL, "domainNumber");
+	pl->transport_specific =
+		config_get_int(cfg, NULL, "transportSpecific") << 4;
+	pl->log_announce = config_get_int(cfg, NULL, "logAnnounceInterval");
+	pl->log_sync = config_get_int(cfg, NULL, "logSyncInterval");
+	pl->log_delay = config_get_int(cfg, NULL, "logMinDelayReqInterval");
+	pl->duration = config_get_int(cfg, NULL, "unicast_req_duration");
+	pl->storm = storm;
+
+	pl->latency = stats_create();
+	pl->slaves = calloc(n, sizeof(*pl->slaves));
+	pl->pfd = calloc(n * SLAVE_NFD, sizeof(*pl->pfd));
+	if (!pl->latency || !pl->slaves || !pl->pfd) {
+		pr_err("low memory");
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	period = log_to_ns(pl->log_delay);
+	spread = storm ? 0 : PTPLOAD_SPREAD * NS_PER_SEC;
+
+	for (i = 0; i < n; i++) {
+		s = &pl->slaves[i];
+		s->fd[SLAVE_EVENT] = s->fd[SLAVE_GENERAL] = -1;
+		pl->n_slaves++;
+
+		a = ntohl(base.s_addr) + i;
+		s->addr.s_addr = htonl(a);
+		/* The slave address makes up the clock identity. */
+		s->pid.clockIdentity.id[0] = 'p';
+		s->pid.clockIdentity.id[1] = 'l';
+		s->pid.clockIdentity.id[2] = 0xff;
+		s->pid.clockIdentity.id[3] = 0xfe;
+		memcpy(&s->pid.clockIdentity.id[4], &s->addr.s_addr, 4);
+		s->pid.portNumber = 1;
+
+		s->fd[SLAVE_EVENT] = open_socket(s->addr, EVENT_PORT);
+		s->fd[SLAVE_GENERAL] = open_socket(s->addr, GENERAL_PORT);
+		if (s->fd[SLAVE_EVENT] < 0 || s->fd[SLAVE_GENERAL] < 0) {
+			return -1;
+		}
+		for (j = 0; j < SLAVE_NFD; j++) {
+			pl->pfd[i * SLAVE_NFD + j].fd = s->fd[j];
+			pl->pfd[i * SLAVE_NFD + j].events = POLLIN | POLLPRI;
+		}
+		/* Spread the slaves over the start and the period. */
+		s->next_request = now;
+		ts_add_ns(&s->next_request, spread * i / n);
+		s->next_delay = now;
+		ts_add_ns(&s->next_delay, period * i / n);
+	}
+	return 0;
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\nusage: %s [options] master-address\n\n"
+		" -a [addr] address of the first slave, default 127.0.0.2\n"
+		" -f [file] read configuration from 'file'\n"
+		" -h        prints this message and exits\n"
+		" -n [num]  number of slaves, default 1\n"
+		" -r [sec]  seconds between reports, default 1\n"
+		" -s        storm: start all slaves at once and repeat each\n"
+		"           request as soon as it is answered\n"
+		" -t [sec]  seconds to run, default 0 (until interrupted)\n"
+		" -v        prints the software version and exits\n"
+		"\n",
+		progname);
+}
+
+int main(int argc, char *argv[])
+{
+	char *config = NULL, *first = "127.0.0.2", *progname;
+	int c, cnt, err = -1, i, index, n = 1, report = 1, run = 0, storm = 0;
+	struct timespec now, next, start, last;
+	struct ptpload pl = {0};
+	struct option *opts;
+	struct config *cfg;
+	int64_t tmo;
+
+	if (handle_term_signals()) {
+		return -1;
+	}
+	cfg = config_create();
+	if (!cfg) {
+		return -1;
+	}
+	opts = config_long_options(cfg);
+	print_set_verbose(1);
+	print_set_syslog(0);
+
+	/* Process the command line arguments. */
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1+progname : argv[0];
+	while (EOF != (c = getopt_long(argc, argv, "a:f:hn:r:st:v", opts, &index))) {
+		switch (c) {
+		case 0:
+			if (config_parse_option(cfg, opts[index].name, optarg)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 'a':
+			first = optarg;
+			break;
+		case 'f':
+			config = optarg;
+			break;
+		case 'n':
+			if (get_arg_val_i(c, optarg, &n, 1, INT_MAX)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 'r':
+			if (get_arg_val_i(c, optarg, &report, 1, INT_MAX)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 's':
+			storm = 1;
+			break;
+		case 't':
+			if (get_arg_val_i(c, optarg, &run, 0, INT_MAX)) {
+				config_destroy(cfg);
+				return -1;
+			}
+			break;
+		case 'v':
+			version_show(stdout);
+			config_destroy(cfg);
+			return 0;
+		case 'h':
+			usage(progname);
+			config_destroy(cfg);
+			return 0;
+		case '?':
+		default:
+			usage(progname);
+			config_destroy(cfg);
+			return -1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(progname);
+		config_destroy(cfg);
+		return -1;
+	}
+
+	if (config && config_read(config, cfg)) {
+		goto out;
+	}
+
+	print_set_progname(progname);
+	print_set_tag(config_get_string(cfg, NULL, "message_tag"));
+	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+
+	if (ptpload_open(&pl, cfg, argv[optind], first, n, storm)) {
+		goto close;
+	}
+	pr_info("simulating %d slaves from %s%s", n, first,
+		storm ? " in a request storm" : "");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	last = start;
+	err = 0;
+
+	while (is_running()) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (run && now.tv_sec - start.tv_sec >= run) {
+			break;
+		}
+		if (now.tv_sec - last.tv_sec >= report) {
+			ptpload_report(&pl, ts_diff_ns(&now, &start) / 1e9);
+			last = now;
+		}
+		next = last;
+		next.tv_sec += report;
+		ptpload_run(&pl, &now, &next);
+
+		tmo = ts_diff_ns(&next, &now) / 1000000;
+		cnt = poll(pl.pfd, pl.n_slaves * SLAVE_NFD, tmo > 0 ? tmo : 0);
+		if (cnt < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			pr_emerg("poll failed");
+			err = -1;
+			break;
+		}
+		for (i = 0; cnt > 0 && i < pl.n_slaves * SLAVE_NFD; i++) {
+			if (pl.pfd[i].revents & (POLLIN | POLLPRI)) {
+				ptpload_recv(&pl, &pl.slaves[i / SLAVE_NFD],
+					     pl.pfd[i].fd);
+				cnt--;
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ptpload_report(&pl, ts_diff_ns(&now, &start) / 1e9);
+close:
+	ptpload_close(&pl);
+out:
+	config_destroy(cfg);
+	return err;
+}
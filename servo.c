@@ -173,7 +173,18 @@ void servo_leap(struct servo *servo, int leap)
 		servo->leap(servo, leap);
 }
 
+void servo_warm_start(struct servo *servo, double freq)
+{
+	if (servo->warm_start)
+		servo->warm_start(servo, freq);
+}
+
 int servo_offset_threshold(struct servo *servo)
 {
 	return servo->offset_threshold;
 }
+
+double servo_max_freq(struct servo *servo)
+{
+	return servo->max_frequency;
+}
@@ -130,6 +130,14 @@ double servo_rate_ratio(struct servo *servo);
  */
 void servo_leap(struct servo *servo, int leap);
 
+/**
+ * Seed a clock servo with the frequency learned in a previous run, so
+ * that it locks on the next sample instead of estimating the frequency.
+ * @param servo   Pointer to a servo obtained via @ref servo_create().
+ * @param freq    The frequency adjustment of the servo in ppb.
+ */
+void servo_warm_start(struct servo *servo, double freq);
+
 /**
  * Get the offset threshold for triggering the interval change request.
  * @param servo   Pointer to a servo obtained via @ref servo_create().
@@ -137,4 +145,11 @@ void servo_leap(struct servo *servo, int leap);
  */
 int servo_offset_threshold(struct servo *servo);
 
+/**
+ * Get the largest frequency adjustment a clock servo may apply.
+ * @param servo   Pointer to a servo obtained via @ref servo_create().
+ * @return        The limit of the frequency adjustment in ppb.
+ */
+double servo_max_freq(struct servo *servo);
+
 #endif
@@ -46,6 +46,8 @@ struct servo {
 	double (*rate_ratio)(struct servo *servo);
 
 	void (*leap)(struct servo *servo, int leap);
+
+	void (*warm_start)(struct servo *servo, double freq);
 };
 
 #endif
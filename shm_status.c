@@ -0,0 +1,188 @@
+/**
+ * @file shm_status.c
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "print.h"
+#include "shm_status.h"
+
+#define READ_RETRIES 100
+/* Reads of an idle or busy page between two checks of its writer. */
+#define WRITER_CHECK_READS 16
+
+struct shm_status {
+	struct shm_status_page *page;
+	char *name;
+	int writer;
+	uint32_t last_seq;
+	unsigned int stale_reads;
+};
+
+static struct shm_status *shm_status_map(const char *name, int writer)
+{
+	struct shm_status *s;
+	int fd, prot;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		return NULL;
+	}
+	s->name = strdup(name);
+	if (!s->name) {
+		goto no_name;
+	}
+	s->writer = writer;
+
+	if (writer) {
+		fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	} else {
+		fd = shm_open(name, O_RDONLY, 0);
+	}
+	if (fd < 0) {
+		/* Readers poll for the page until ptp4l creates it. */
+		if (writer) {
+			pr_err("failed to open shared memory %s: %m", name);
+		} else {
+			pr_debug("failed to open shared memory %s: %m", name);
+		}
+		goto no_fd;
+	}
+	if (writer && ftruncate(fd, sizeof(*s->page))) {
+		pr_err("failed to resize shared memory %s: %m", name);
+		goto no_map;
+	}
+	prot = writer ? PROT_READ | PROT_WRITE : PROT_READ;
+	s->page = mmap(NULL, sizeof(*s->page), prot, MAP_SHARED, fd, 0);
+	if (s->page == MAP_FAILED) {
+		pr_err("failed to map shared memory %s: %m", name);
+		goto no_map;
+	}
+	close(fd);
+	return s;
+
+no_map:
+	close(fd);
+	if (writer) {
+		shm_unlink(name);
+	}
+no_fd:
+	free(s->name);
+no_name:
+	free(s);
+	return NULL;
+}
+
+struct shm_status *shm_status_create(const char *name)
+{
+	struct shm_status *s;
+
+	s = shm_status_map(name, 1);
+	if (!s) {
+		return NULL;
+	}
+	memset(s->page, 0, sizeof(*s->page));
+	s->page->version = SHM_STATUS_VERSION;
+	s->page->pid = getpid();
+	__atomic_store_n(&s->page->magic, SHM_STATUS_MAGIC, __ATOMIC_RELEASE);
+	return s;
+}
+
+struct shm_status *shm_status_open(const char *name)
+{
+	struct shm_status *s;
+
+	s = shm_status_map(name, 0);
+	if (!s) {
+		return NULL;
+	}
+	/* Force the first read to copy the page. */
+	s->last_seq = ~__atomic_load_n(&s->page->seq, __ATOMIC_ACQUIRE);
+	return s;
+}
+
+void shm_status_destroy(struct shm_status *s)
+{
+	if (s->writer) {
+		__atomic_store_n(&s->page->magic, 0, __ATOMIC_RELEASE);
+		shm_unlink(s->name);
+	}
+	munmap(s->page, sizeof(*s->page));
+	free(s->name);
+	free(s);
+}
+
+struct shm_status_page *shm_status_write_begin(struct shm_status *s)
+{
+	uint32_t seq = s->page->seq;
+
+	__atomic_store_n(&s->page->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return s->page;
+}
+
+void shm_status_write_end(struct shm_status *s)
+{
+	uint32_t seq = s->page->seq;
+
+	__atomic_store_n(&s->page->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * A writer which crashed leaves the magic in place and possibly an odd
+ * sequence number. Once the page looked idle or busy for a number of
+ * reads, make sure that its writer still exists, so that polling an
+ * idle page costs a system call only every so often. Only ESRCH counts,
+ * as EPERM means that the process is alive but owned by another user.
+ */
+static int shm_status_writer_gone(struct shm_status *s)
+{
+	pid_t pid;
+
+	if (++s->stale_reads < WRITER_CHECK_READS) {
+		return 0;
+	}
+	s->stale_reads = 0;
+	pid = __atomic_load_n(&s->page->pid, __ATOMIC_RELAXED);
+
+	return pid <= 0 || (kill(pid, 0) && errno == ESRCH);
+}
+
+int shm_status_read(struct shm_status *s, struct shm_status_page *page)
+{
+	uint32_t seq1, seq2;
+	int i;
+
+	for (i = 0; i < READ_RETRIES; i++) {
+		if (__atomic_load_n(&s->page->magic, __ATOMIC_ACQUIRE) !=
+		    SHM_STATUS_MAGIC) {
+			return -ENODEV;
+		}
+		seq1 = __atomic_load_n(&s->page->seq, __ATOMIC_ACQUIRE);
+		if (seq1 & 1) {
+			continue;
+		}
+		if (seq1 == s->last_seq) {
+			return shm_status_writer_gone(s) ? -ESRCH : 1;
+		}
+		memcpy(page, s->page, sizeof(*page));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&s->page->seq, __ATOMIC_RELAXED);
+		if (seq1 == seq2) {
+			if (page->version != SHM_STATUS_VERSION) {
+				return -EPROTO;
+			}
+			s->last_seq = seq1;
+			s->stale_reads = 0;
+			return 0;
+		}
+	}
+	return shm_status_writer_gone(s) ? -ESRCH : -EBUSY;
+}
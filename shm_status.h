@@ -0,0 +1,97 @@
+/**
+ * @file shm_status.h
+ * @brief Publishes the clock status in a shared memory page.
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#ifndef HAVE_SHM_STATUS_H
+#define HAVE_SHM_STATUS_H
+
+#include <stdint.h>
+
+#include "ddt.h"
+#include "ds.h"
+
+#define SHM_STATUS_MAGIC	0x50545053 /* "PTPS" */
+#define SHM_STATUS_VERSION	1
+#define SHM_STATUS_MAX_PORTS	64
+
+struct shm_status_port {
+	struct PortIdentity portIdentity;
+	uint8_t port_state;
+	uint8_t reserved;
+	struct PortStats stats;
+	struct PortServiceStats service_stats;
+};
+
+/**
+ * Layout of the shared page. The writer increments 'seq' before and
+ * after each update, so that an odd value means an update is under
+ * way and a changed value means the snapshot was torn. The 'pid' of
+ * the writer lets readers detect a page left behind by a crash.
+ */
+struct shm_status_page {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;
+	uint32_t num_ports;
+	int32_t servo_state;
+	int32_t pid;
+	struct defaultDS dds;
+	struct currentDS cur;
+	struct parentDS pds;
+	struct timePropertiesDS tds;
+	struct shm_status_port port[SHM_STATUS_MAX_PORTS];
+};
+
+struct shm_status;
+
+/**
+ * Create the shared status page for writing.
+ * @param name  The POSIX shared memory name, for example "/ptp4l".
+ * @return A pointer to a new instance on success, NULL otherwise.
+ */
+struct shm_status *shm_status_create(const char *name);
+
+/**
+ * Open an existing shared status page for reading.
+ * @param name  The POSIX shared memory name.
+ * @return A pointer to a new instance on success, NULL otherwise.
+ */
+struct shm_status *shm_status_open(const char *name);
+
+/**
+ * Destroy an instance. When created for writing, the page is marked
+ * as invalid and removed.
+ * @param s  Pointer obtained via @ref shm_status_create() or
+ *           @ref shm_status_open().
+ */
+void shm_status_destroy(struct shm_status *s);
+
+/**
+ * Start an update of the page.
+ * @param s  Pointer obtained via @ref shm_status_create().
+ * @return   The page to be filled in by the caller.
+ */
+struct shm_status_page *shm_status_write_begin(struct shm_status *s);
+
+/**
+ * Complete an update started with @ref shm_status_write_begin().
+ * @param s  Pointer obtained via @ref shm_status_create().
+ */
+void shm_status_write_end(struct shm_status *s);
+
+/**
+ * Copy a consistent snapshot of the page. Only when the page stayed
+ * idle or busy for several calls does one of them check with kill()
+ * whether the writer still exists; all other calls make no system call.
+ * @param s     Pointer obtained via @ref shm_status_open().
+ * @param page  Buffer receiving the snapshot.
+ * @return      Zero when a new snapshot was copied, one when the page
+ *              did not change since the last successful call, -ESRCH
+ *              when the writer no longer exists, -EBUSY when the writer
+ *              kept the page busy, and another negative error code when
+ *              the page is not valid.
+ */
+int shm_status_read(struct shm_status *s, struct shm_status_page *page);
+
+#endif
@@ -41,16 +41,32 @@ static int64_t pctns(struct ptp_clock_time *t)
 	return t->sec * NS_PER_SEC + t->nsec;
 }
 
-static int sysoff_precise(int fd, int64_t *result, uint64_t *ts)
+/*
+ * The layout of struct ptp_sys_offset_extended since Linux 6.12, where
+ * the first reserved word selects the system clock. Older kernels only
+ * accept zero there, which is CLOCK_REALTIME.
+ */
+struct sysoff_extended {
+	unsigned int n_samples;
+	clockid_t clockid;
+	unsigned int rsv[2];
+	struct ptp_clock_time ts[PTP_MAX_SAMPLES][3];
+};
+
+static int sysoff_precise(int fd, clockid_t clkid, int64_t *result,
+			  uint64_t *ts)
 {
 	struct ptp_sys_offset_precise pso;
+	struct ptp_clock_time *sys;
 	memset(&pso, 0, sizeof(pso));
 	if (ioctl(fd, PTP_SYS_OFFSET_PRECISE, &pso)) {
 		print_ioctl_error("PTP_SYS_OFFSET_PRECISE");
 		return -errno;
 	}
-	*result = pctns(&pso.sys_realtime) - pctns(&pso.device);
-	*ts = pctns(&pso.sys_realtime);
+	sys = clkid == CLOCK_MONOTONIC_RAW ?
+		&pso.sys_monoraw : &pso.sys_realtime;
+	*result = pctns(sys) - pctns(&pso.device);
+	*ts = pctns(sys);
 	return 0;
 }
 
@@ -99,13 +115,19 @@ static int64_t sysoff_estimate(struct ptp_clock_time *pct, int extended,
 	return best_offset;
 }
 
-static int sysoff_extended(int fd, int n_samples,
+static int sysoff_extended(int fd, clockid_t clkid, int n_samples,
 			   int64_t *result, uint64_t *ts, int64_t *delay)
 {
-	struct ptp_sys_offset_extended pso;
+	struct sysoff_extended pso;
 	memset(&pso, 0, sizeof(pso));
 	pso.n_samples = n_samples;
+	pso.clockid = clkid;
 	if (ioctl(fd, PTP_SYS_OFFSET_EXTENDED, &pso)) {
+		if (errno == EINVAL && clkid != CLOCK_REALTIME) {
+			pr_debug("ioctl PTP_SYS_OFFSET_EXTENDED: "
+				 "clock %d not supported", clkid);
+			return -EOPNOTSUPP;
+		}
 		print_ioctl_error("PTP_SYS_OFFSET_EXTENDED");
 		return -errno;
 	}
@@ -133,15 +155,30 @@ int sysoff_measure(int fd, int method, int n_samples,
 	switch (method) {
 	case SYSOFF_PRECISE:
 		*delay = 0;
-		return sysoff_precise(fd, result, ts);
+		return sysoff_precise(fd, CLOCK_REALTIME, result, ts);
 	case SYSOFF_EXTENDED:
-		return sysoff_extended(fd, n_samples, result, ts, delay);
+		return sysoff_extended(fd, CLOCK_REALTIME, n_samples,
+				       result, ts, delay);
 	case SYSOFF_BASIC:
 		return sysoff_basic(fd, n_samples, result, ts, delay);
 	}
 	return -EOPNOTSUPP;
 }
 
+int sysoff_measure_raw(int fd, int method, int n_samples,
+		       int64_t *result, uint64_t *ts, int64_t *delay)
+{
+	switch (method) {
+	case SYSOFF_PRECISE:
+		*delay = 0;
+		return sysoff_precise(fd, CLOCK_MONOTONIC_RAW, result, ts);
+	case SYSOFF_EXTENDED:
+		return sysoff_extended(fd, CLOCK_MONOTONIC_RAW, n_samples,
+				       result, ts, delay);
+	}
+	return -EOPNOTSUPP;
+}
+
 int sysoff_probe(int fd, int n_samples)
 {
 	int64_t junk, delay;
@@ -169,3 +206,18 @@ int sysoff_probe(int fd, int n_samples)
 
 	return SYSOFF_RUN_TIME_MISSING;
 }
+
+int sysoff_probe_raw(int fd, int method, int n_samples)
+{
+	int64_t junk, delay;
+	uint64_t ts;
+	int i, err;
+
+	for (i = 0; i < 3; i++) {
+		err = sysoff_measure_raw(fd, method, n_samples, &junk, &ts,
+					 &delay);
+		if (err != -EBUSY)
+			break;
+	}
+	return !err;
+}
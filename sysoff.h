@@ -48,3 +48,27 @@ int sysoff_probe(int fd, int n_samples);
  */
 int sysoff_measure(int fd, int method, int n_samples,
 		   int64_t *result, uint64_t *ts, int64_t *delay);
+
+/**
+ * Check whether a PHC can be measured against CLOCK_MONOTONIC_RAW.
+ * @param fd         An open file descriptor to a PHC device.
+ * @param method     A non-negative SYSOFF_ value returned by sysoff_probe().
+ * @param n_samples  The number of consecutive readings to make.
+ * @return  One if @ref sysoff_measure_raw() works, zero otherwise.
+ */
+int sysoff_probe_raw(int fd, int method, int n_samples);
+
+/**
+ * Measure the offset between a PHC and CLOCK_MONOTONIC_RAW, which unlike
+ * the system time is neither slewed nor stepped. This needs the PRECISE
+ * method, or the EXTENDED one on Linux 6.12 or later.
+ * @param fd         An open file descriptor to a PHC device.
+ * @param method     A non-negative SYSOFF_ value returned by sysoff_probe().
+ * @param n_samples  The number of consecutive readings to make.
+ * @param result     The estimated offset in nanoseconds.
+ * @param ts         The CLOCK_MONOTONIC_RAW time corresponding to 'result'.
+ * @param delay      The delay in reading of the clock in nanoseconds.
+ * @return  Zero on success, negative error code otherwise.
+ */
+int sysoff_measure_raw(int fd, int method, int n_samples,
+		       int64_t *result, uint64_t *ts, int64_t *delay);
@@ -0,0 +1,332 @@
+/**
+ * @file test_tlv.c
+ * @brief Round trip test of the management TLV conversion
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Each management data set of a fixed layout is filled with random
+ * data of every length up to TEST_MAX_LEN bytes and converted with
+ * tlv_post_recv().  Whether it is accepted and the bytes it yields
+ * must match the field by field conversion below, and tlv_pre_send()
+ * must restore the original bytes.
+ */
+#include <arpa/inet.h>
+#include <asm/byteorder.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "msg.h"
+#include "tlv.h"
+
+#define TEST_MAX_LEN	400
+#define TEST_RUNS	3
+
+struct test_buf {
+	struct management_tlv mgt;
+	uint8_t data[TEST_MAX_LEN + 2];
+} PACKED;
+
+static const int test_ids[] = {
+	MID_C_DEFAULT_DATA_SET,
+	MID_C_CURRENT_DATA_SET,
+	MID_C_PARENT_DATA_SET,
+	MID_C_TIME_PROPERTIES_DATA_SET,
+	MID_P_PORT_DATA_SET,
+	MID_C_ALTERNATE_TIME_OFFSET_PROPERTIES,
+	MID_C_TIME_STATUS_NP,
+	MID_C_GRANDMASTER_SETTINGS_NP,
+	MID_P_PORT_DATA_SET_NP,
+	MID_C_SUBSCRIBE_EVENTS_NP,
+	MID_P_PORT_STATS_NP,
+	MID_P_PORT_SERVICE_STATS_NP,
+	MID_P_UNICAST_SERVICE_LOAD_NP,
+	MID_P_PORT_HWCLOCK_NP,
+	MID_P_POWER_PROFILE_SETTINGS_NP,
+	MID_P_CMLDS_INFO_NP,
+	MID_C_EXTERNAL_GRANDMASTER_PROPERTIES_NP,
+	MID_P_PORT_CORRECTIONS_NP,
+};
+
+/* The data set must fill the TLV, which is padded to an even length. */
+static int ref_padded(int data_len, int size)
+{
+	return data_len < size || size + size % 2 != data_len;
+}
+
+/* The conversion of each data set, written out field by field. */
+static int ref_post_recv(int id, uint8_t *data, int data_len)
+{
+	struct external_grandmaster_properties_np *egpn;
+	struct alternate_time_offset_properties *atop;
+	struct ieee_c37_238_settings_np *pwr;
+	struct grandmaster_settings_np *gsn;
+	struct port_service_stats_np *pssn;
+	struct unicast_service_load_np *usln;
+	struct subscribe_events_np *sen;
+	struct port_hwclock_np *phn;
+	struct timePropertiesDS *tp;
+	struct cmlds_info_np *cmlds;
+	struct time_status_np *tsn;
+	struct port_stats_np *psn;
+	struct port_ds_np *pdsnp;
+	struct currentDS *cds;
+	struct defaultDS *dds;
+	struct parentDS *pds;
+	struct portDS *p;
+	int i;
+
+	if (!data_len) {
+		return 0;
+	}
+	switch (id) {
+	case MID_C_DEFAULT_DATA_SET:
+		if (data_len != sizeof(*dds))
+			return -1;
+		dds = (struct defaultDS *) data;
+		dds->numberPorts = ntohs(dds->numberPorts);
+		dds->clockQuality.offsetScaledLogVariance =
+			ntohs(dds->clockQuality.offsetScaledLogVariance);
+		break;
+	case MID_C_CURRENT_DATA_SET:
+		if (data_len != sizeof(*cds))
+			return -1;
+		cds = (struct currentDS *) data;
+		cds->stepsRemoved = ntohs(cds->stepsRemoved);
+		cds->offsetFromMaster = net2host64(cds->offsetFromMaster);
+		cds->meanPathDelay = net2host64(cds->meanPathDelay);
+		break;
+	case MID_C_PARENT_DATA_SET:
+		if (data_len != sizeof(*pds))
+			return -1;
+		pds = (struct parentDS *) data;
+		pds->parentPortIdentity.portNumber =
+			ntohs(pds->parentPortIdentity.portNumber);
+		pds->observedParentOffsetScaledLogVariance =
+			ntohs(pds->observedParentOffsetScaledLogVariance);
+		pds->observedParentClockPhaseChangeRate =
+			ntohl(pds->observedParentClockPhaseChangeRate);
+		pds->grandmasterClockQuality.offsetScaledLogVariance =
+			ntohs(pds->grandmasterClockQuality.offsetScaledLogVariance);
+		break;
+	case MID_C_TIME_PROPERTIES_DATA_SET:
+		if (data_len != sizeof(*tp))
+			return -1;
+		tp = (struct timePropertiesDS *) data;
+		tp->currentUtcOffset = ntohs(tp->currentUtcOffset);
+		break;
+	case MID_P_PORT_DATA_SET:
+		if (data_len != sizeof(*p))
+			return -1;
+		p = (struct portDS *) data;
+		p->portIdentity.portNumber = ntohs(p->portIdentity.portNumber);
+		p->peerMeanPathDelay = net2host64(p->peerMeanPathDelay);
+		break;
+	case MID_C_ALTERNATE_TIME_OFFSET_PROPERTIES:
+		if (data_len != sizeof(*atop))
+			return -1;
+		atop = (struct alternate_time_offset_properties *) data;
+		atop->currentOffset = ntohl(atop->currentOffset);
+		atop->jumpSeconds = ntohl(atop->jumpSeconds);
+		atop->timeOfNextJump.seconds_msb =
+			ntohs(atop->timeOfNextJump.seconds_msb);
+		atop->timeOfNextJump.seconds_lsb =
+			ntohl(atop->timeOfNextJump.seconds_lsb);
+		break;
+	case MID_C_TIME_STATUS_NP:
+		if (data_len != sizeof(*tsn))
+			return -1;
+		tsn = (struct time_status_np *) data;
+		tsn->master_offset = net2host64(tsn->master_offset);
+		tsn->ingress_time = net2host64(tsn->ingress_time);
+		tsn->cumulativeScaledRateOffset =
+			ntohl(tsn->cumulativeScaledRateOffset);
+		tsn->scaledLastGmPhaseChange = ntohl(tsn->scaledLastGmPhaseChange);
+		tsn->gmTimeBaseIndicator = ntohs(tsn->gmTimeBaseIndicator);
+		tsn->lastGmPhaseChange.nanoseconds_msb =
+			ntohs(tsn->lastGmPhaseChange.nanoseconds_msb);
+		tsn->lastGmPhaseChange.nanoseconds_lsb =
+			net2host64(tsn->lastGmPhaseChange.nanoseconds_lsb);
+		tsn->lastGmPhaseChange.fractional_nanoseconds =
+			ntohs(tsn->lastGmPhaseChange.fractional_nanoseconds);
+		tsn->gmPresent = ntohl(tsn->gmPresent);
+		break;
+	case MID_C_GRANDMASTER_SETTINGS_NP:
+		if (data_len != sizeof(*gsn))
+			return -1;
+		gsn = (struct grandmaster_settings_np *) data;
+		gsn->clockQuality.offsetScaledLogVariance =
+			ntohs(gsn->clockQuality.offsetScaledLogVariance);
+		gsn->utc_offset = ntohs(gsn->utc_offset);
+		break;
+	case MID_P_PORT_DATA_SET_NP:
+		if (data_len != sizeof(*pdsnp))
+			return -1;
+		pdsnp = (struct port_ds_np *) data;
+		pdsnp->neighborPropDelayThresh =
+			ntohl(pdsnp->neighborPropDelayThresh);
+		pdsnp->asCapable = ntohl(pdsnp->asCapable);
+		break;
+	case MID_C_SUBSCRIBE_EVENTS_NP:
+		if (data_len != sizeof(*sen))
+			return -1;
+		sen = (struct subscribe_events_np *) data;
+		sen->duration = ntohs(sen->duration);
+		break;
+	case MID_P_PORT_STATS_NP:
+		if (ref_padded(data_len, sizeof(*psn)))
+			return -1;
+		psn = (struct port_stats_np *) data;
+		psn->portIdentity.portNumber = ntohs(psn->portIdentity.portNumber);
+		for (i = 0; i < MAX_MESSAGE_TYPES; i++) {
+			psn->stats.rxMsgType[i] =
+				__le64_to_cpu(psn->stats.rxMsgType[i]);
+			psn->stats.txMsgType[i] =
+				__le64_to_cpu(psn->stats.txMsgType[i]);
+		}
+		break;
+	case MID_P_PORT_SERVICE_STATS_NP:
+		if (ref_padded(data_len, sizeof(*pssn)))
+			return -1;
+		pssn = (struct port_service_stats_np *) data;
+		pssn->portIdentity.portNumber =
+			ntohs(pssn->portIdentity.portNumber);
+		pssn->stats.announce_timeout =
+			__le64_to_cpu(pssn->stats.announce_timeout);
+		pssn->stats.sync_timeout =
+			__le64_to_cpu(pssn->stats.sync_timeout);
+		pssn->stats.delay_timeout =
+			__le64_to_cpu(pssn->stats.delay_timeout);
+		pssn->stats.unicast_service_timeout =
+			__le64_to_cpu(pssn->stats.unicast_service_timeout);
+		pssn->stats.unicast_request_timeout =
+			__le64_to_cpu(pssn->stats.unicast_request_timeout);
+		pssn->stats.master_announce_timeout =
+			__le64_to_cpu(pssn->stats.master_announce_timeout);
+		pssn->stats.master_sync_timeout =
+			__le64_to_cpu(pssn->stats.master_sync_timeout);
+		pssn->stats.qualification_timeout =
+			__le64_to_cpu(pssn->stats.qualification_timeout);
+		pssn->stats.sync_mismatch =
+			__le64_to_cpu(pssn->stats.sync_mismatch);
+		pssn->stats.followup_mismatch =
+			__le64_to_cpu(pssn->stats.followup_mismatch);
+		break;
+	case MID_P_UNICAST_SERVICE_LOAD_NP:
+		if (ref_padded(data_len, sizeof(*usln)))
+			return -1;
+		usln = (struct unicast_service_load_np *) data;
+		usln->portIdentity.portNumber =
+			ntohs(usln->portIdentity.portNumber);
+		usln->clients = ntohl(usln->clients);
+		usln->max_packet_rate = ntohl(usln->max_packet_rate);
+		usln->packet_rate = ntohl(usln->packet_rate);
+		usln->max_ts_rate = ntohl(usln->max_ts_rate);
+		usln->ts_rate = ntohl(usln->ts_rate);
+		usln->denied = ntohl(usln->denied);
+		usln->shortened = ntohl(usln->shortened);
+		break;
+	case MID_P_PORT_HWCLOCK_NP:
+		if (ref_padded(data_len, sizeof(*phn)))
+			return -1;
+		phn = (struct port_hwclock_np *) data;
+		phn->portIdentity.portNumber = ntohs(phn->portIdentity.portNumber);
+		phn->phc_index = ntohl(phn->phc_index);
+		break;
+	case MID_P_POWER_PROFILE_SETTINGS_NP:
+		if (data_len < sizeof(*pwr))
+			return -1;
+		pwr = (struct ieee_c37_238_settings_np *) data;
+		pwr->version = ntohs(pwr->version);
+		pwr->grandmasterID = ntohs(pwr->grandmasterID);
+		pwr->grandmasterTimeInaccuracy =
+			ntohl(pwr->grandmasterTimeInaccuracy);
+		pwr->networkTimeInaccuracy = ntohl(pwr->networkTimeInaccuracy);
+		pwr->totalTimeInaccuracy = ntohl(pwr->totalTimeInaccuracy);
+		break;
+	case MID_P_CMLDS_INFO_NP:
+		if (data_len < sizeof(*cmlds))
+			return -1;
+		cmlds = (struct cmlds_info_np *) data;
+		cmlds->meanLinkDelay = net2host64(cmlds->meanLinkDelay);
+		cmlds->scaledNeighborRateRatio =
+			ntohl(cmlds->scaledNeighborRateRatio);
+		cmlds->as_capable = ntohl(cmlds->as_capable);
+		break;
+	case MID_C_EXTERNAL_GRANDMASTER_PROPERTIES_NP:
+		if (data_len != sizeof(*egpn))
+			return -1;
+		egpn = (struct external_grandmaster_properties_np *) data;
+		egpn->stepsRemoved = ntohs(egpn->stepsRemoved);
+		break;
+	case MID_P_PORT_CORRECTIONS_NP:
+		/* The fields travel in host byte order. */
+		if (data_len != sizeof(struct port_corrections_np))
+			return -1;
+		break;
+	}
+	return 0;
+}
+
+static int test_one(int id, int len)
+{
+	struct test_buf buf, orig, ref;
+	struct tlv_extra extra;
+	int err, i, ref_err;
+
+	for (i = 0; i < sizeof(buf); i++) {
+		((uint8_t *) &buf)[i] = random();
+	}
+	buf.mgt.type = TLV_MANAGEMENT;
+	buf.mgt.length = sizeof(buf.mgt.id) + len;
+	buf.mgt.id = htons(id);
+	orig = buf;
+	ref = buf;
+
+	memset(&extra, 0, sizeof(extra));
+	extra.tlv = (struct TLV *) &buf;
+	err = tlv_post_recv(&extra);
+	ref_err = ref_post_recv(id, ref.mgt.data, len);
+
+	if (!err != !ref_err) {
+		fprintf(stderr, "0x%04x length %d: %s, expected %s\n",
+			id, len, err ? "rejected" : "accepted",
+			ref_err ? "rejected" : "accepted");
+		return -1;
+	}
+	if (err) {
+		return 0;
+	}
+	if (memcmp(buf.mgt.data, ref.mgt.data, len)) {
+		fprintf(stderr, "0x%04x length %d: wrong host byte order\n",
+			id, len);
+		return -1;
+	}
+	tlv_pre_send(extra.tlv, &extra);
+	if (memcmp(buf.mgt.data, orig.mgt.data, len)) {
+		fprintf(stderr, "0x%04x length %d: round trip differs\n",
+			id, len);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int failed = 0, i, len, run, tests = 0;
+
+	srandom(1);
+	for (i = 0; i < sizeof(test_ids) / sizeof(test_ids[0]); i++) {
+		for (len = 0; len <= TEST_MAX_LEN; len++) {
+			for (run = 0; run < TEST_RUNS; run++) {
+				if (test_one(test_ids[i], len)) {
+					failed++;
+				}
+				tests++;
+			}
+		}
+	}
+	printf("%d management TLV tests, %d failed\n", tests, failed);
+	return failed ? 1 : 0;
+}
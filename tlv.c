@@ -17,11 +17,15 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <arpa/inet.h>
+#include <byteswap.h>
+#include <endian.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "contain.h"
 #include "port.h"
 #include "tlv.h"
 #include "msg.h"
@@ -158,35 +162,217 @@ static void alttime_offset_pre_send(struct tlv_extra *extra)
 	host2net32_unaligned(&atoi->timeOfNextJump.seconds_lsb);
 }
 
+/*
+ * The management TLVs of a fixed layout are converted according to the
+ * tables below, which list the multi-byte fields of each data set. A
+ * byte swap is its own inverse, so a table serves both directions.
+ * Consecutive fields of the same width form a single entry, converted
+ * in one loop.
+ */
+struct mgt_field {
+	uint16_t offset;
+	uint8_t width;
+	uint8_t le;	/* little endian on the wire */
+	uint16_t count;
+};
+
+enum mgt_length {
+	MGT_LEN_EXACT,	/* the data is exactly the size of the data set */
+	MGT_LEN_PADDED,	/* as above, padded to an even length */
+	MGT_LEN_MIN,	/* the data holds at least the data set */
+};
+
+#define MGT_MAX_FIELDS 8
+
+struct mgt_layout {
+	int id;
+	uint16_t size;
+	enum mgt_length length;
+	struct mgt_field field[MGT_MAX_FIELDS];
+};
+
+#define BE(s, m, w)	   { offsetof(struct s, m), w, 0, 1 }
+#define BE_RUN(s, m, w, n) { offsetof(struct s, m), w, 0, n }
+#define LE_RUN(s, m, w, n) { offsetof(struct s, m), w, 1, n }
+
+static const struct mgt_layout mgt_layouts[] = {
+	{ MID_C_DEFAULT_DATA_SET, sizeof(struct defaultDS), MGT_LEN_EXACT, {
+		BE(defaultDS, numberPorts, 2),
+		BE(defaultDS, clockQuality.offsetScaledLogVariance, 2),
+	} },
+	{ MID_C_CURRENT_DATA_SET, sizeof(struct currentDS), MGT_LEN_EXACT, {
+		BE(currentDS, stepsRemoved, 2),
+		BE_RUN(currentDS, offsetFromMaster, 8, 2),
+	} },
+	{ MID_C_PARENT_DATA_SET, sizeof(struct parentDS), MGT_LEN_EXACT, {
+		BE(parentDS, parentPortIdentity.portNumber, 2),
+		BE(parentDS, observedParentOffsetScaledLogVariance, 2),
+		BE(parentDS, observedParentClockPhaseChangeRate, 4),
+		BE(parentDS, grandmasterClockQuality.offsetScaledLogVariance, 2),
+	} },
+	{ MID_C_TIME_PROPERTIES_DATA_SET, sizeof(struct timePropertiesDS), MGT_LEN_EXACT, {
+		BE(timePropertiesDS, currentUtcOffset, 2),
+	} },
+	{ MID_P_PORT_DATA_SET, sizeof(struct portDS), MGT_LEN_EXACT, {
+		BE(portDS, portIdentity.portNumber, 2),
+		BE(portDS, peerMeanPathDelay, 8),
+	} },
+	/* Message alignment broken by design. */
+	{ MID_C_ALTERNATE_TIME_OFFSET_PROPERTIES,
+	  sizeof(struct alternate_time_offset_properties), MGT_LEN_EXACT, {
+		BE_RUN(alternate_time_offset_properties, currentOffset, 4, 2),
+		BE(alternate_time_offset_properties, timeOfNextJump.seconds_msb, 2),
+		BE(alternate_time_offset_properties, timeOfNextJump.seconds_lsb, 4),
+	} },
+	{ MID_C_TIME_STATUS_NP, sizeof(struct time_status_np), MGT_LEN_EXACT, {
+		BE_RUN(time_status_np, master_offset, 8, 2),
+		BE_RUN(time_status_np, cumulativeScaledRateOffset, 4, 2),
+		BE(time_status_np, gmTimeBaseIndicator, 2),
+		BE(time_status_np, lastGmPhaseChange.nanoseconds_msb, 2),
+		BE(time_status_np, lastGmPhaseChange.nanoseconds_lsb, 8),
+		BE(time_status_np, lastGmPhaseChange.fractional_nanoseconds, 2),
+		BE(time_status_np, gmPresent, 4),
+	} },
+	{ MID_C_GRANDMASTER_SETTINGS_NP, sizeof(struct grandmaster_settings_np), MGT_LEN_EXACT, {
+		BE(grandmaster_settings_np, clockQuality.offsetScaledLogVariance, 2),
+		BE(grandmaster_settings_np, utc_offset, 2),
+	} },
+	{ MID_P_PORT_DATA_SET_NP, sizeof(struct port_ds_np), MGT_LEN_EXACT, {
+		BE_RUN(port_ds_np, neighborPropDelayThresh, 4, 2),
+	} },
+	{ MID_C_SUBSCRIBE_EVENTS_NP, sizeof(struct subscribe_events_np), MGT_LEN_EXACT, {
+		BE(subscribe_events_np, duration, 2),
+	} },
+	{ MID_P_PORT_STATS_NP, sizeof(struct port_stats_np), MGT_LEN_PADDED, {
+		BE(port_stats_np, portIdentity.portNumber, 2),
+		LE_RUN(port_stats_np, stats, 8,
+		       sizeof(struct PortStats) / sizeof(uint64_t)),
+	} },
+	{ MID_P_PORT_SERVICE_STATS_NP, sizeof(struct port_service_stats_np), MGT_LEN_PADDED, {
+		BE(port_service_stats_np, portIdentity.portNumber, 2),
+		LE_RUN(port_service_stats_np, stats, 8,
+		       sizeof(struct PortServiceStats) / sizeof(uint64_t)),
+	} },
+	{ MID_P_UNICAST_SERVICE_LOAD_NP, sizeof(struct unicast_service_load_np), MGT_LEN_PADDED, {
+		BE(unicast_service_load_np, portIdentity.portNumber, 2),
+		BE_RUN(unicast_service_load_np, clients, 4, 7),
+	} },
+	{ MID_P_PORT_HWCLOCK_NP, sizeof(struct port_hwclock_np), MGT_LEN_PADDED, {
+		BE(port_hwclock_np, portIdentity.portNumber, 2),
+		BE(port_hwclock_np, phc_index, 4),
+	} },
+	{ MID_P_POWER_PROFILE_SETTINGS_NP, sizeof(struct ieee_c37_238_settings_np), MGT_LEN_MIN, {
+		BE_RUN(ieee_c37_238_settings_np, version, 2, 2),
+		BE_RUN(ieee_c37_238_settings_np, grandmasterTimeInaccuracy, 4, 3),
+	} },
+	{ MID_P_CMLDS_INFO_NP, sizeof(struct cmlds_info_np), MGT_LEN_MIN, {
+		BE(cmlds_info_np, meanLinkDelay, 8),
+		BE_RUN(cmlds_info_np, scaledNeighborRateRatio, 4, 2),
+	} },
+	{ MID_C_EXTERNAL_GRANDMASTER_PROPERTIES_NP,
+	  sizeof(struct external_grandmaster_properties_np), MGT_LEN_EXACT, {
+		BE(external_grandmaster_properties_np, stepsRemoved, 2),
+	} },
+};
+
+static const struct mgt_layout *mgt_layout_find(int id)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(mgt_layouts); i++) {
+		if (mgt_layouts[i].id == id) {
+			return &mgt_layouts[i];
+		}
+	}
+	return NULL;
+}
+
+static void mgt_field_flip(uint8_t *p, const struct mgt_field *f)
+{
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+	int i;
+
+	/* Only the fields in the other byte order need swapping. */
+	if (f->le == (__BYTE_ORDER == __LITTLE_ENDIAN)) {
+		return;
+	}
+	switch (f->width) {
+	case 2:
+		for (i = 0; i < f->count; i++, p += sizeof(v16)) {
+			memcpy(&v16, p, sizeof(v16));
+			v16 = bswap_16(v16);
+			memcpy(p, &v16, sizeof(v16));
+		}
+		break;
+	case 4:
+		for (i = 0; i < f->count; i++, p += sizeof(v32)) {
+			memcpy(&v32, p, sizeof(v32));
+			v32 = bswap_32(v32);
+			memcpy(p, &v32, sizeof(v32));
+		}
+		break;
+	case 8:
+		for (i = 0; i < f->count; i++, p += sizeof(v64)) {
+			memcpy(&v64, p, sizeof(v64));
+			v64 = bswap_64(v64);
+			memcpy(p, &v64, sizeof(v64));
+		}
+		break;
+	}
+}
+
+/* The same swap converts a data set to host order and back. */
+static void mgt_layout_flip(const struct mgt_layout *layout, uint8_t *data)
+{
+	const struct mgt_field *f;
+
+	for (f = layout->field; f < layout->field + MGT_MAX_FIELDS && f->count; f++) {
+		mgt_field_flip(data + f->offset, f);
+	}
+}
+
+static int mgt_layout_post_recv(const struct mgt_layout *layout,
+				struct management_tlv *m, uint16_t data_len)
+{
+	switch (layout->length) {
+	case MGT_LEN_EXACT:
+		if (data_len != layout->size)
+			return -EBADMSG;
+		break;
+	case MGT_LEN_PADDED:
+		if (data_len != layout->size + layout->size % 2)
+			return -EBADMSG;
+		break;
+	case MGT_LEN_MIN:
+		if (data_len < layout->size)
+			return -EBADMSG;
+		break;
+	}
+	mgt_layout_flip(layout, m->data);
+	return 0;
+}
+
 static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 			 struct tlv_extra *extra)
 {
-	struct external_grandmaster_properties_np *egpn;
-	struct alternate_time_offset_properties *atop;
 	struct alternate_time_offset_name *aton;
-	struct ieee_c37_238_settings_np *pwr;
 	struct unicast_master_table_np *umtn;
-	struct grandmaster_settings_np *gsn;
-	struct port_service_stats_np *pssn;
+	const struct mgt_layout *layout;
 	struct mgmt_clock_description *cd;
 	struct unicast_master_entry *ume;
-	struct subscribe_events_np *sen;
 	struct port_corrections_np *pcn;
 	struct port_properties_np *ppn;
-	struct port_hwclock_np *phn;
-	struct timePropertiesDS *tp;
-	struct cmlds_info_np *cmlds;
-	struct time_status_np *tsn;
-	struct port_stats_np *psn;
 	int extra_len = 0, i, len;
-	struct port_ds_np *pdsnp;
-	struct currentDS *cds;
-	struct defaultDS *dds;
-	struct parentDS *pds;
-	struct portDS *p;
 	uint8_t *buf;
 	uint16_t u16;
 
+	layout = mgt_layout_find(m->id);
+	if (layout) {
+		return mgt_layout_post_recv(layout, m, data_len);
+	}
+
 	switch (m->id) {
 	case MID_P_CLOCK_DESCRIPTION:
 		cd = &extra->cd;
@@ -294,48 +480,6 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 		extra_len = sizeof(struct PTPText);
 		extra_len += extra->cd.userDescription->length;
 		break;
-	case MID_C_DEFAULT_DATA_SET:
-		if (data_len != sizeof(struct defaultDS))
-			goto bad_length;
-		dds = (struct defaultDS *) m->data;
-		dds->numberPorts = ntohs(dds->numberPorts);
-		dds->clockQuality.offsetScaledLogVariance =
-			ntohs(dds->clockQuality.offsetScaledLogVariance);
-		break;
-	case MID_C_CURRENT_DATA_SET:
-		if (data_len != sizeof(struct currentDS))
-			goto bad_length;
-		cds = (struct currentDS *) m->data;
-		cds->stepsRemoved = ntohs(cds->stepsRemoved);
-		cds->offsetFromMaster = net2host64(cds->offsetFromMaster);
-		cds->meanPathDelay = net2host64(cds->meanPathDelay);
-		break;
-	case MID_C_PARENT_DATA_SET:
-		if (data_len != sizeof(struct parentDS))
-			goto bad_length;
-		pds = (struct parentDS *) m->data;
-		pds->parentPortIdentity.portNumber =
-			ntohs(pds->parentPortIdentity.portNumber);
-		pds->observedParentOffsetScaledLogVariance =
-			ntohs(pds->observedParentOffsetScaledLogVariance);
-		pds->observedParentClockPhaseChangeRate =
-			ntohl(pds->observedParentClockPhaseChangeRate);
-		pds->grandmasterClockQuality.offsetScaledLogVariance =
-			ntohs(pds->grandmasterClockQuality.offsetScaledLogVariance);
-		break;
-	case MID_C_TIME_PROPERTIES_DATA_SET:
-		if (data_len != sizeof(struct timePropertiesDS))
-			goto bad_length;
-		tp = (struct timePropertiesDS *) m->data;
-		tp->currentUtcOffset = ntohs(tp->currentUtcOffset);
-		break;
-	case MID_P_PORT_DATA_SET:
-		if (data_len != sizeof(struct portDS))
-			goto bad_length;
-		p = (struct portDS *) m->data;
-		p->portIdentity.portNumber = ntohs(p->portIdentity.portNumber);
-		p->peerMeanPathDelay = net2host64(p->peerMeanPathDelay);
-		break;
 	case MID_C_ALTERNATE_TIME_OFFSET_NAME:
 		aton = (struct alternate_time_offset_name *) m->data;
 		if (data_len < sizeof(*aton)) {
@@ -344,50 +488,6 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 		extra_len = sizeof(*aton);
 		extra_len += aton->displayName.length;
 		break;
-	case MID_C_ALTERNATE_TIME_OFFSET_PROPERTIES:
-		atop = (struct alternate_time_offset_properties *) m->data;
-		if (data_len != sizeof(*atop)) {
-			goto bad_length;
-		}
-		/* Message alignment broken by design. */
-		net2host32_unaligned(&atop->currentOffset);
-		net2host32_unaligned(&atop->jumpSeconds);
-		flip16(&atop->timeOfNextJump.seconds_msb);
-		net2host32_unaligned(&atop->timeOfNextJump.seconds_lsb);
-		break;
-	case MID_C_TIME_STATUS_NP:
-		if (data_len != sizeof(struct time_status_np))
-			goto bad_length;
-		tsn = (struct time_status_np *) m->data;
-		tsn->master_offset = net2host64(tsn->master_offset);
-		tsn->ingress_time = net2host64(tsn->ingress_time);
-		tsn->cumulativeScaledRateOffset = ntohl(tsn->cumulativeScaledRateOffset);
-		tsn->scaledLastGmPhaseChange = ntohl(tsn->scaledLastGmPhaseChange);
-		tsn->gmTimeBaseIndicator = ntohs(tsn->gmTimeBaseIndicator);
-		scaled_ns_n2h(&tsn->lastGmPhaseChange);
-		tsn->gmPresent = ntohl(tsn->gmPresent);
-		break;
-	case MID_C_GRANDMASTER_SETTINGS_NP:
-		if (data_len != sizeof(struct grandmaster_settings_np))
-			goto bad_length;
-		gsn = (struct grandmaster_settings_np *) m->data;
-		gsn->clockQuality.offsetScaledLogVariance =
-			ntohs(gsn->clockQuality.offsetScaledLogVariance);
-		gsn->utc_offset = ntohs(gsn->utc_offset);
-		break;
-	case MID_P_PORT_DATA_SET_NP:
-		if (data_len != sizeof(struct port_ds_np))
-			goto bad_length;
-		pdsnp = (struct port_ds_np *) m->data;
-		pdsnp->neighborPropDelayThresh = ntohl(pdsnp->neighborPropDelayThresh);
-		pdsnp->asCapable = ntohl(pdsnp->asCapable);
-		break;
-	case MID_C_SUBSCRIBE_EVENTS_NP:
-		if (data_len != sizeof(struct subscribe_events_np))
-			goto bad_length;
-		sen = (struct subscribe_events_np *)m->data;
-		sen->duration = ntohs(sen->duration);
-		break;
 	case MID_P_PORT_PROPERTIES_NP:
 		if (data_len < sizeof(struct port_properties_np))
 			goto bad_length;
@@ -396,46 +496,6 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 		extra_len = sizeof(struct port_properties_np);
 		extra_len += ppn->interface.length;
 		break;
-	case MID_P_PORT_STATS_NP:
-		if (data_len < sizeof(struct port_stats_np))
-			goto bad_length;
-		psn = (struct port_stats_np *)m->data;
-		psn->portIdentity.portNumber =
-			ntohs(psn->portIdentity.portNumber);
-		for (i = 0 ; i < MAX_MESSAGE_TYPES; i++) {
-			psn->stats.rxMsgType[i] = __le64_to_cpu(psn->stats.rxMsgType[i]);
-			psn->stats.txMsgType[i] = __le64_to_cpu(psn->stats.txMsgType[i]);
-		}
-		extra_len = sizeof(struct port_stats_np);
-		break;
-	case MID_P_PORT_SERVICE_STATS_NP:
-		if (data_len < sizeof(struct port_service_stats_np))
-			goto bad_length;
-		pssn = (struct port_service_stats_np *)m->data;
-		pssn->portIdentity.portNumber =
-			htons(pssn->portIdentity.portNumber);
-		pssn->stats.announce_timeout =
-			__le64_to_cpu(pssn->stats.announce_timeout);
-		pssn->stats.sync_timeout =
-			__le64_to_cpu(pssn->stats.sync_timeout);
-		pssn->stats.delay_timeout =
-			__le64_to_cpu(pssn->stats.delay_timeout);
-		pssn->stats.unicast_service_timeout =
-			__le64_to_cpu(pssn->stats.unicast_service_timeout);
-		pssn->stats.unicast_request_timeout =
-			__le64_to_cpu(pssn->stats.unicast_request_timeout);
-		pssn->stats.master_announce_timeout =
-			__le64_to_cpu(pssn->stats.master_announce_timeout);
-		pssn->stats.master_sync_timeout =
-			__le64_to_cpu(pssn->stats.master_sync_timeout);
-		pssn->stats.qualification_timeout =
-			__le64_to_cpu(pssn->stats.qualification_timeout);
-		pssn->stats.sync_mismatch =
-			__le64_to_cpu(pssn->stats.sync_mismatch);
-		pssn->stats.followup_mismatch =
-			__le64_to_cpu(pssn->stats.followup_mismatch);
-		extra_len = sizeof(struct port_service_stats_np);
-		break;
 	case MID_P_UNICAST_MASTER_TABLE_NP:
 		if (data_len < sizeof(struct unicast_master_table_np))
 			goto bad_length;
@@ -463,38 +523,6 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 			buf += sizeof(*ume) + ume->address.addressLength;
 		}
 		break;
-	case MID_P_PORT_HWCLOCK_NP:
-		if (data_len < sizeof(struct port_hwclock_np))
-			goto bad_length;
-		phn = (struct port_hwclock_np *)m->data;
-		phn->portIdentity.portNumber = ntohs(phn->portIdentity.portNumber);
-		phn->phc_index = ntohl(phn->phc_index);
-		extra_len = sizeof(struct port_hwclock_np);
-		break;
-	case MID_P_POWER_PROFILE_SETTINGS_NP:
-		if (data_len < sizeof(struct ieee_c37_238_settings_np))
-			goto bad_length;
-		pwr = (struct ieee_c37_238_settings_np *)m->data;
-		NTOHS(pwr->version);
-		NTOHS(pwr->grandmasterID);
-		NTOHL(pwr->grandmasterTimeInaccuracy);
-		NTOHL(pwr->networkTimeInaccuracy);
-		NTOHL(pwr->totalTimeInaccuracy);
-		break;
-	case MID_P_CMLDS_INFO_NP:
-		if (data_len < sizeof(struct cmlds_info_np))
-			goto bad_length;
-		cmlds = (struct cmlds_info_np *)m->data;
-		net2host64_unaligned(&cmlds->meanLinkDelay);
-		NTOHL(cmlds->scaledNeighborRateRatio);
-		NTOHL(cmlds->as_capable);
-		break;
-	case MID_C_EXTERNAL_GRANDMASTER_PROPERTIES_NP:
-		if (data_len != sizeof(struct external_grandmaster_properties_np))
-			goto bad_length;
-		egpn = (struct external_grandmaster_properties_np *) m->data;
-		NTOHS(egpn->stepsRemoved);
-		break;
 	case MID_P_PORT_CORRECTIONS_NP:
 		if (data_len != sizeof(struct port_corrections_np))
 			goto bad_length;
@@ -526,30 +554,21 @@ bad_length:
 
 static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 {
-	struct external_grandmaster_properties_np *egpn;
-	struct alternate_time_offset_properties *atop;
-	struct ieee_c37_238_settings_np *pwr;
 	struct unicast_master_table_np *umtn;
-	struct grandmaster_settings_np *gsn;
-	struct port_service_stats_np *pssn;
+	const struct mgt_layout *layout;
 	struct mgmt_clock_description *cd;
 	struct unicast_master_entry *ume;
-	struct subscribe_events_np *sen;
 	struct port_corrections_np *pcn;
 	struct port_properties_np *ppn;
-	struct port_hwclock_np *phn;
-	struct cmlds_info_np *cmlds;
-	struct timePropertiesDS *tp;
-	struct time_status_np *tsn;
-	struct port_stats_np *psn;
-	struct port_ds_np *pdsnp;
-	struct defaultDS *dds;
-	struct currentDS *cds;
-	struct parentDS *pds;
-	struct portDS *p;
 	uint8_t *buf;
 	int i;
 
+	layout = mgt_layout_find(m->id);
+	if (layout) {
+		mgt_layout_flip(layout, m->data);
+		return;
+	}
+
 	switch (m->id) {
 	case MID_P_CLOCK_DESCRIPTION:
 		if (extra) {
@@ -560,111 +579,12 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 			flip16(&cd->protocolAddress->addressLength);
 		}
 		break;
-	case MID_C_DEFAULT_DATA_SET:
-		dds = (struct defaultDS *) m->data;
-		dds->numberPorts = htons(dds->numberPorts);
-		dds->clockQuality.offsetScaledLogVariance =
-			htons(dds->clockQuality.offsetScaledLogVariance);
-		break;
-	case MID_C_CURRENT_DATA_SET:
-		cds = (struct currentDS *) m->data;
-		cds->stepsRemoved = htons(cds->stepsRemoved);
-		cds->offsetFromMaster = host2net64(cds->offsetFromMaster);
-		cds->meanPathDelay = host2net64(cds->meanPathDelay);
-		break;
-	case MID_C_PARENT_DATA_SET:
-		pds = (struct parentDS *) m->data;
-		pds->parentPortIdentity.portNumber =
-			htons(pds->parentPortIdentity.portNumber);
-		pds->observedParentOffsetScaledLogVariance =
-			htons(pds->observedParentOffsetScaledLogVariance);
-		pds->observedParentClockPhaseChangeRate =
-			htonl(pds->observedParentClockPhaseChangeRate);
-		pds->grandmasterClockQuality.offsetScaledLogVariance =
-			htons(pds->grandmasterClockQuality.offsetScaledLogVariance);
-		break;
-	case MID_C_TIME_PROPERTIES_DATA_SET:
-		tp = (struct timePropertiesDS *) m->data;
-		tp->currentUtcOffset = htons(tp->currentUtcOffset);
-		break;
-	case MID_P_PORT_DATA_SET:
-		p = (struct portDS *) m->data;
-		p->portIdentity.portNumber = htons(p->portIdentity.portNumber);
-		p->peerMeanPathDelay = host2net64(p->peerMeanPathDelay);
-		break;
 	case MID_C_ALTERNATE_TIME_OFFSET_NAME:
 		break;
-	case MID_C_ALTERNATE_TIME_OFFSET_PROPERTIES:
-		atop = (struct alternate_time_offset_properties *) m->data;
-		/* Message alignment broken by design. */
-		host2net32_unaligned(&atop->currentOffset);
-		host2net32_unaligned(&atop->jumpSeconds);
-		flip16(&atop->timeOfNextJump.seconds_msb);
-		host2net32_unaligned(&atop->timeOfNextJump.seconds_lsb);
-		break;
-	case MID_C_TIME_STATUS_NP:
-		tsn = (struct time_status_np *) m->data;
-		tsn->master_offset = host2net64(tsn->master_offset);
-		tsn->ingress_time = host2net64(tsn->ingress_time);
-		tsn->cumulativeScaledRateOffset = htonl(tsn->cumulativeScaledRateOffset);
-		tsn->scaledLastGmPhaseChange = htonl(tsn->scaledLastGmPhaseChange);
-		tsn->gmTimeBaseIndicator = htons(tsn->gmTimeBaseIndicator);
-		scaled_ns_h2n(&tsn->lastGmPhaseChange);
-		tsn->gmPresent = htonl(tsn->gmPresent);
-		break;
-	case MID_C_GRANDMASTER_SETTINGS_NP:
-		gsn = (struct grandmaster_settings_np *) m->data;
-		gsn->clockQuality.offsetScaledLogVariance =
-			htons(gsn->clockQuality.offsetScaledLogVariance);
-		gsn->utc_offset = htons(gsn->utc_offset);
-		break;
-	case MID_P_PORT_DATA_SET_NP:
-		pdsnp = (struct port_ds_np *) m->data;
-		pdsnp->neighborPropDelayThresh = htonl(pdsnp->neighborPropDelayThresh);
-		pdsnp->asCapable = htonl(pdsnp->asCapable);
-		break;
-	case MID_C_SUBSCRIBE_EVENTS_NP:
-		sen = (struct subscribe_events_np *)m->data;
-		sen->duration = htons(sen->duration);
-		break;
 	case MID_P_PORT_PROPERTIES_NP:
 		ppn = (struct port_properties_np *)m->data;
 		ppn->portIdentity.portNumber = htons(ppn->portIdentity.portNumber);
 		break;
-	case MID_P_PORT_STATS_NP:
-		psn = (struct port_stats_np *)m->data;
-		psn->portIdentity.portNumber =
-			htons(psn->portIdentity.portNumber);
-		for (i = 0 ; i < MAX_MESSAGE_TYPES; i++) {
-			psn->stats.rxMsgType[i] = __cpu_to_le64(psn->stats.rxMsgType[i]);
-			psn->stats.txMsgType[i] = __cpu_to_le64(psn->stats.txMsgType[i]);
-		}
-		break;
-	case MID_P_PORT_SERVICE_STATS_NP:
-		pssn = (struct port_service_stats_np *)m->data;
-		pssn->portIdentity.portNumber =
-			htons(pssn->portIdentity.portNumber);
-		pssn->stats.announce_timeout =
-			__cpu_to_le64(pssn->stats.announce_timeout);
-		pssn->stats.sync_timeout =
-			__cpu_to_le64(pssn->stats.sync_timeout);
-		pssn->stats.delay_timeout =
-			__cpu_to_le64(pssn->stats.delay_timeout);
-		pssn->stats.unicast_service_timeout =
-			__cpu_to_le64(pssn->stats.unicast_service_timeout);
-		pssn->stats.unicast_request_timeout =
-			__cpu_to_le64(pssn->stats.unicast_request_timeout);
-		pssn->stats.master_announce_timeout =
-			__cpu_to_le64(pssn->stats.master_announce_timeout);
-		pssn->stats.master_sync_timeout =
-			__cpu_to_le64(pssn->stats.master_sync_timeout);
-		pssn->stats.qualification_timeout =
-			__cpu_to_le64(pssn->stats.qualification_timeout);
-		pssn->stats.sync_mismatch =
-			__cpu_to_le64(pssn->stats.sync_mismatch);
-		pssn->stats.followup_mismatch =
-			__cpu_to_le64(pssn->stats.followup_mismatch);
-		break;
 	case MID_P_UNICAST_MASTER_TABLE_NP:
 		umtn = (struct unicast_master_table_np *)m->data;
 		buf = (uint8_t *) umtn->unicast_masters;
@@ -684,29 +604,6 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 		umtn->actual_table_size =
 			htons(umtn->actual_table_size);
 		break;
-	case MID_P_PORT_HWCLOCK_NP:
-		phn = (struct port_hwclock_np *)m->data;
-		phn->portIdentity.portNumber = htons(phn->portIdentity.portNumber);
-		phn->phc_index = htonl(phn->phc_index);
-		break;
-	case MID_P_POWER_PROFILE_SETTINGS_NP:
-		pwr = (struct ieee_c37_238_settings_np *)m->data;
-		HTONS(pwr->version);
-		HTONS(pwr->grandmasterID);
-		HTONL(pwr->grandmasterTimeInaccuracy);
-		HTONL(pwr->networkTimeInaccuracy);
-		HTONL(pwr->totalTimeInaccuracy);
-		break;
-	case MID_P_CMLDS_INFO_NP:
-		cmlds = (struct cmlds_info_np *)m->data;
-		host2net64_unaligned(&cmlds->meanLinkDelay);
-		HTONL(cmlds->scaledNeighborRateRatio);
-		HTONL(cmlds->as_capable);
-		break;
-	case MID_C_EXTERNAL_GRANDMASTER_PROPERTIES_NP:
-		egpn = (struct external_grandmaster_properties_np *)m->data;
-		HTONS(egpn->stepsRemoved);
-		break;
 	case MID_P_PORT_CORRECTIONS_NP:
 		pcn = (struct port_corrections_np *)m->data;
 		host2net64(pcn->egressLatency);
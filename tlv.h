@@ -145,6 +145,7 @@ enum management_action {
     _(P_CMLDS_INFO_NP, 0xC00B) \
     _(P_PORT_CORRECTIONS_NP, 0xC00C) \
     _(C_EXTERNAL_GRANDMASTER_PROPERTIES_NP, 0xC00D) \
+    _(P_UNICAST_SERVICE_LOAD_NP, 0xC00E) \
 
 
 typedef enum {
@@ -468,6 +469,17 @@ struct port_hwclock_np {
     uint8_t reserved;
 } PACKED;
 
+struct unicast_service_load_np {
+    struct PortIdentity portIdentity;
+    UInteger32 clients;
+    UInteger32 max_packet_rate;
+    UInteger32 packet_rate;
+    UInteger32 max_ts_rate;
+    UInteger32 ts_rate;
+    UInteger32 denied;
+    UInteger32 shortened;
+} PACKED;
+
 struct port_stats_np {
     struct PortIdentity portIdentity;
     struct PortStats stats;
@@ -500,6 +512,8 @@ struct mgmt_clock_description {
 struct tlv_extra {
     TAILQ_ENTRY(tlv_extra) list;
     struct TLV *tlv;
+    /* The value is still in network byte order, see msg_tlv_decode(). */
+    int raw;
     union {
         struct mgmt_clock_description cd;
         struct nsm_resp_tlv_foot *foot;
@@ -18,6 +18,7 @@
  */
 
 #include <arpa/inet.h>
+#include <errno.h>
 
 #include "transport.h"
 #include "transport_private.h"
@@ -66,6 +67,15 @@ int transport_sendto(struct transport *t, struct fdarray *fda,
 	return t->send(t, fda, event, 0, msg, len, &msg->address, &msg->hwts);
 }
 
+int transport_sendmany(struct transport *t, struct fdarray *fda,
+		       struct mmsghdr *msgvec, unsigned int vlen)
+{
+	if (!t->sendmany) {
+		return -EOPNOTSUPP;
+	}
+	return t->sendmany(t, fda, msgvec, vlen);
+}
+
 int transport_txts(struct fdarray *fda,
 		   struct ptp_message *msg)
 {
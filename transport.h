@@ -101,6 +101,21 @@ int transport_peer(struct transport *t, struct fdarray *fda,
 int transport_sendto(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, struct ptp_message *msg);
 
+/**
+ * Sends a batch of general messages with a single system call. Each entry
+ * carries its own destination address and data. Only the transports which
+ * need no framing of their own support this. An entry which can not be
+ * sent does not keep the following ones from being sent.
+ * @param t	 The transport.
+ * @param fda	 The array of descriptors filled in by transport_open.
+ * @param msgvec The messages to send, in network byte order.
+ * @param vlen	 The number of entries in 'msgvec'.
+ * @return	 Number of messages sent, or negative value in case of an
+ *		 error when none was sent.
+ */
+int transport_sendmany(struct transport *t, struct fdarray *fda,
+		       struct mmsghdr *msgvec, unsigned int vlen);
+
 /**
  * Fetches the transmit time stamp for a PTP message that was sent
  * with the TRANS_DEFER_EVENT flag.
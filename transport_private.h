@@ -42,6 +42,9 @@ struct transport {
 		    enum transport_event event, int peer, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	int (*sendmany)(struct transport *t, struct fdarray *fda,
+			struct mmsghdr *msgvec, unsigned int vlen);
+
 	void (*release)(struct transport *t);
 
 	int (*physical_addr)(struct transport *t, uint8_t *addr);
@@ -15,6 +15,7 @@
 
 #include "clockadj.h"
 #include "config.h"
+#include "holdover.h"
 #include "contain.h"
 #include "interface.h"
 #include "phc.h"
@@ -22,21 +23,41 @@
 #include "sad.h"
 #include "ts2phc.h"
 #include "version.h"
+#include "workers.h"
 
 #define NS_PER_SEC		1000000000LL
 #define SAMPLE_WEIGHT		1.0
 
+/* Time stamps of one edge arrive within half a period of each other. */
+#define EDGE_WINDOW		(NS_PER_SEC / 2)
+/* Without a new edge for this long, the clocks enter holdover. */
+#define EDGE_TIMEOUT		(3 * NS_PER_SEC / 2)
+
 struct interface {
 	STAILQ_ENTRY(interface) list;
 };
 
+/* The adjustment of one clock for the current edge. */
+struct ts2phc_adjustment {
+	struct ts2phc_clock *clock;
+	bool pending;
+	int64_t offset;
+	double adj;
+	int err;
+	uint64_t done;
+};
+
 static void ts2phc_cleanup(struct ts2phc_private *priv)
 {
 	struct ts2phc_port *p, *tmp;
 
+	if (priv->workers)
+		workers_destroy(priv->workers);
+	free(priv->adjustments);
 	ts2phc_pps_sink_cleanup(priv);
 	if (priv->src)
 		ts2phc_pps_source_destroy(priv->src);
+	print_cleanup();
 	if (priv->cfg) {
 		sad_destroy(priv->cfg);
 		config_destroy(priv->cfg);
@@ -144,28 +165,73 @@ static struct servo *ts2phc_servo_create(struct ts2phc_private *priv,
 	return servo;
 }
 
+static uint64_t ts2phc_monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
 void ts2phc_clock_add_tstamp(struct ts2phc_clock *clock, tmv_t t)
 {
 	struct timespec ts = tmv_to_timespec(t);
+	struct ts2phc_tstamp *e;
 
 	pr_debug("adding tstamp %ld.%09ld to clock %s",
 		 ts.tv_sec, ts.tv_nsec, clock->name);
-	clock->last_ts = t;
-	clock->is_ts_available = true;
+
+	if (clock->n_tstamps == TS2PHC_TSTAMP_QUEUE) {
+		pr_debug("%s: dropping oldest tstamp", clock->name);
+		clock->tstamp_head = (clock->tstamp_head + 1) %
+				     TS2PHC_TSTAMP_QUEUE;
+		clock->n_tstamps--;
+	}
+	e = &clock->tstamps[(clock->tstamp_head + clock->n_tstamps) %
+			    TS2PHC_TSTAMP_QUEUE];
+	e->ts = t;
+	e->arrival = ts2phc_monotonic_ns();
+	clock->n_tstamps++;
 }
 
-static int ts2phc_clock_get_tstamp(struct ts2phc_clock *clock, tmv_t *ts)
+/* Take the newest time stamp of a clock and drop the older ones. */
+static int ts2phc_clock_get_tstamp(struct ts2phc_clock *clock,
+				   struct ts2phc_tstamp *tstamp)
 {
-	if (!clock->is_ts_available)
+	if (!clock->n_tstamps)
 		return 0;
-	clock->is_ts_available = false;
-	*ts = clock->last_ts;
+	*tstamp = clock->tstamps[(clock->tstamp_head + clock->n_tstamps - 1) %
+				 TS2PHC_TSTAMP_QUEUE];
+	clock->tstamp_head = 0;
+	clock->n_tstamps = 0;
 	return 1;
 }
 
-static void ts2phc_clock_flush_tstamp(struct ts2phc_clock *clock)
+/*
+ * Take the time stamp of a clock which arrived with a given edge. Older
+ * time stamps belong to edges which are gone and are dropped, while
+ * newer ones are kept for the next edge.
+ */
+static int ts2phc_clock_match_tstamp(struct ts2phc_clock *clock,
+				     const struct ts2phc_tstamp *edge,
+				     tmv_t *ts)
 {
-	clock->is_ts_available = false;
+	struct ts2phc_tstamp *e;
+
+	while (clock->n_tstamps) {
+		e = &clock->tstamps[clock->tstamp_head];
+		if (e->arrival > edge->arrival + EDGE_WINDOW)
+			return 0;
+		clock->tstamp_head = (clock->tstamp_head + 1) %
+				     TS2PHC_TSTAMP_QUEUE;
+		clock->n_tstamps--;
+		if (e->arrival + EDGE_WINDOW >= edge->arrival) {
+			*ts = e->ts;
+			return 1;
+		}
+		pr_debug("%s: dropping tstamp of a past edge", clock->name);
+	}
+	return 0;
 }
 
 struct ts2phc_clock *ts2phc_clock_add(struct ts2phc_private *priv,
@@ -174,6 +240,8 @@ struct ts2phc_clock *ts2phc_clock_add(struct ts2phc_private *priv,
 	clockid_t clkid = CLOCK_INVALID;
 	struct ts2phc_clock *c;
 	int phc_index = -1;
+	const char *path;
+	char *file;
 	int err;
 
 	clkid = posix_clock_open(device, &phc_index);
@@ -205,6 +273,21 @@ struct ts2phc_clock *ts2phc_clock_add(struct ts2phc_private *priv,
 		posix_clock_close(clkid);
 		return NULL;
 	}
+	path = config_get_string(priv->cfg, NULL, "holdover_file");
+	if (!c->no_adj && *path) {
+		/* Every clock keeps its calibration in a file of its own. */
+		if (asprintf(&file, "%s.ptp%d", path, phc_index) >= 0) {
+			c->holdover = holdover_create(file,
+						      servo_max_freq(c->servo));
+			free(file);
+		}
+		if (!c->holdover) {
+			free(c->name);
+			free(c);
+			posix_clock_close(clkid);
+			return NULL;
+		}
+	}
 
 	LIST_INSERT_HEAD(&priv->clocks, c, list);
 	return c;
@@ -212,6 +295,8 @@ struct ts2phc_clock *ts2phc_clock_add(struct ts2phc_private *priv,
 
 void ts2phc_clock_destroy(struct ts2phc_clock *c)
 {
+	if (c->holdover)
+		holdover_destroy(c->holdover);
 	servo_destroy(c->servo);
 	posix_clock_close(c->clkid);
 	free(c->name);
@@ -439,27 +524,141 @@ static int ts2phc_pps_source_implicit_tstamp(struct ts2phc_private *priv,
 	return 0;
 }
 
+static void ts2phc_apply_adjustment(void *arg)
+{
+	struct ts2phc_adjustment *a = arg;
+	struct ts2phc_clock *c = a->clock;
+
+	if (!a->pending)
+		return;
+
+	a->err = clockadj_set_freq(c->clkid, -a->adj);
+	if (!a->err && c->servo_state == SERVO_JUMP)
+		a->err = clockadj_step(c->clkid, -a->offset);
+	a->done = ts2phc_monotonic_ns();
+}
+
+static void ts2phc_apply_adjustments(struct ts2phc_private *priv)
+{
+	uint64_t first = UINT64_MAX, last = 0;
+	struct ts2phc_adjustment *a;
+	unsigned int i, n = 0;
+
+	if (priv->workers) {
+		workers_run(priv->workers, ts2phc_apply_adjustment,
+			    priv->adjustments, sizeof(*priv->adjustments),
+			    priv->n_clocks);
+	} else {
+		for (i = 0; i < priv->n_clocks; i++)
+			ts2phc_apply_adjustment(&priv->adjustments[i]);
+	}
+
+	for (i = 0; i < priv->n_clocks; i++) {
+		a = &priv->adjustments[i];
+		if (!a->pending)
+			continue;
+		if (a->err) {
+			servo_reset(a->clock->servo);
+			a->clock->servo_state = SERVO_UNLOCKED;
+			continue;
+		}
+		if (a->clock->holdover &&
+		    (a->clock->servo_state == SERVO_LOCKED ||
+		     a->clock->servo_state == SERVO_LOCKED_STABLE))
+			holdover_learn(a->clock->holdover, -a->adj);
+		if (a->done < first)
+			first = a->done;
+		if (a->done > last)
+			last = a->done;
+		n++;
+	}
+	if (n > 1)
+		pr_debug("adjusted %u clocks within %" PRIu64 " ns",
+			n, last - first);
+}
+
+static int ts2phc_adjustments_init(struct ts2phc_private *priv)
+{
+	char cpus[WORKERS_MAX * 12] = "", *pos = cpus;
+	struct config *cfg = priv->cfg;
+	struct ts2phc_clock *c;
+	int cpu, n_cpus = 0;
+	unsigned int i = 0;
+
+	LIST_FOREACH(c, &priv->clocks, list)
+		priv->n_clocks++;
+
+	priv->adjustments = calloc(priv->n_clocks,
+				   sizeof(*priv->adjustments));
+	if (!priv->adjustments) {
+		pr_err("low memory");
+		return -1;
+	}
+	LIST_FOREACH(c, &priv->clocks, list)
+		priv->adjustments[i++].clock = c;
+
+	if (!config_get_int(cfg, NULL, "ts2phc.parallel_adjust"))
+		return 0;
+	if (priv->n_clocks > WORKERS_MAX) {
+		pr_err("too many clocks for parallel adjustment");
+		return -1;
+	}
+
+	/* Thread i adjusts clock i, on the CPU configured for that clock. */
+	LIST_FOREACH(c, &priv->clocks, list) {
+		cpu = config_get_int(cfg, c->name, "ts2phc.adjust_cpu");
+		if (cpu < 0)
+			continue;
+		pos += sprintf(pos, "%s%d", n_cpus ? "," : "", cpu);
+		n_cpus++;
+	}
+	if (n_cpus && n_cpus != priv->n_clocks) {
+		pr_err("ts2phc.adjust_cpu must be set for all clocks or none");
+		return -1;
+	}
+
+	priv->workers = workers_create(priv->n_clocks, cpus,
+			config_get_int(cfg, NULL, "ts2phc.adjust_priority"));
+	return priv->workers ? 0 : -1;
+}
+
 static void ts2phc_synchronize_clocks(struct ts2phc_private *priv, int autocfg)
 {
 	struct timespec source_ts, now;
+	struct ts2phc_tstamp tstamp;
+	struct ts2phc_adjustment *a;
 	tmv_t source_tmv;
 	struct ts2phc_clock *c;
 	int holdover, valid;
+	unsigned int i = 0;
 
+	/*
+	 * The sinks are serviced as their events arrive, so this runs
+	 * several times per edge. The edge is remembered and each sink
+	 * time stamp is matched with the edge it arrived with.
+	 */
 	if (autocfg) {
 		if (!priv->ref_clock) {
 			pr_debug("no reference clock, skipping");
 			return;
 		}
-		valid = ts2phc_clock_get_tstamp(priv->ref_clock, &source_tmv);
-		if (!valid) {
-			pr_err("reference clock (%s) timestamp not valid, skipping",
-				priv->ref_clock->name);
-			return;
+		if (ts2phc_clock_get_tstamp(priv->ref_clock, &tstamp)) {
+			priv->edge = tstamp;
+			priv->edge_valid = true;
 		}
-	} else {
-		valid = !ts2phc_pps_source_implicit_tstamp(priv, &source_tmv);
+	} else if (!ts2phc_pps_source_implicit_tstamp(priv, &source_tmv)) {
+		priv->edge.ts = source_tmv;
+		priv->edge.arrival = ts2phc_monotonic_ns();
+		priv->edge_valid = true;
 	}
+	valid = priv->edge_valid &&
+		ts2phc_monotonic_ns() < priv->edge.arrival + EDGE_TIMEOUT;
+	if (!valid && autocfg) {
+		pr_err("reference clock (%s) timestamp not valid, skipping",
+		       priv->ref_clock->name);
+		return;
+	}
+	source_tmv = priv->edge.ts;
 
 	if (valid) {
 		priv->holdover_start = 0;
@@ -474,15 +673,27 @@ static void ts2phc_synchronize_clocks(struct ts2phc_private *priv, int autocfg)
 		holdover = 1;
 	}
 
+	/*
+	 * Run all the servos first, and then adjust the clocks together
+	 * so that they are as close to each other as possible.
+	 */
 	LIST_FOREACH(c, &priv->clocks, list) {
 		int64_t offset;
 		double adj;
 		tmv_t ts;
 
+		a = &priv->adjustments[i++];
+		a->pending = false;
+
 		if (!c->is_target)
 			continue;
 
-		valid = ts2phc_clock_get_tstamp(c, &ts);
+		if (holdover) {
+			valid = ts2phc_clock_get_tstamp(c, &tstamp);
+			ts = tstamp.ts;
+		} else {
+			valid = ts2phc_clock_match_tstamp(c, &priv->edge, &ts);
+		}
 		if (!valid) {
 			pr_debug("%s timestamp not valid, skipping", c->name);
 			continue;
@@ -505,6 +716,8 @@ static void ts2phc_synchronize_clocks(struct ts2phc_private *priv, int autocfg)
 				offset);
 			continue;
 		}
+		if (c->holdover)
+			holdover_reference(c->holdover, offset);
 
 		adj = servo_sample(c->servo, offset, tmv_to_nanoseconds(ts),
 				   SAMPLE_WEIGHT, &c->servo_state);
@@ -519,29 +732,30 @@ static void ts2phc_synchronize_clocks(struct ts2phc_private *priv, int autocfg)
 			c->name, offset, c->servo_state, adj,
 			holdover ? " holdover" : "");
 
-		switch (c->servo_state) {
-		case SERVO_UNLOCKED:
-			break;
-		case SERVO_JUMP:
-			if (clockadj_set_freq(c->clkid, -adj)) {
-				goto servo_unlock;
-			}
-			if (clockadj_step(c->clkid, -offset)) {
-				goto servo_unlock;
-			}
-			break;
-		case SERVO_LOCKED:
-		case SERVO_LOCKED_STABLE:
-			if (clockadj_set_freq(c->clkid, -adj)) {
-				goto servo_unlock;
-			}
-			break;
+		if (c->servo_state != SERVO_UNLOCKED) {
+			a->pending = true;
+			a->offset = offset;
+			a->adj = adj;
 		}
-		continue;
+	}
 
-servo_unlock:
-		servo_reset(c->servo);
-		c->servo_state = SERVO_UNLOCKED;
+	ts2phc_apply_adjustments(priv);
+}
+
+/* Steer the clocks which lost their edges by their frequency models. */
+static void ts2phc_holdover(struct ts2phc_private *priv)
+{
+	struct ts2phc_clock *c;
+	double freq;
+
+	LIST_FOREACH(c, &priv->clocks, list) {
+		if (!c->is_target || !c->holdover)
+			continue;
+		if (!holdover_update(c->holdover, &freq))
+			continue;
+		if (clockadj_set_freq(c->clkid, freq))
+			pr_err("%s: failed to apply the holdover frequency",
+			       c->name);
 	}
 }
 
@@ -697,6 +911,11 @@ int main(int argc, char *argv[])
 	print_set_verbose(config_get_int(cfg, NULL, "verbose"));
 	print_set_syslog(config_get_int(cfg, NULL, "use_syslog"));
 	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+	if (print_set_queue_size(config_get_int(cfg, NULL, "log_queue_size"))) {
+		fprintf(stderr, "failed to start the log writer\n");
+		ts2phc_cleanup(&priv);
+		return -1;
+	}
 
 	STAILQ_INIT(&priv.sinks);
 
@@ -716,6 +935,14 @@ int main(int argc, char *argv[])
 			ts2phc_cleanup(&priv);
 			return -1;
 		}
+		if (*config_get_string(cfg, NULL, "status_shm")) {
+			err = pmc_agent_attach_status(priv.agent,
+				config_get_string(cfg, NULL, "status_shm"));
+			if (err) {
+				ts2phc_cleanup(&priv);
+				return -1;
+			}
+		}
 		err = ts2phc_auto_init_ports(&priv);
 		if (err) {
 			ts2phc_cleanup(&priv);
@@ -786,12 +1013,16 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	if (ts2phc_adjustments_init(&priv)) {
+		fprintf(stderr, "failed to initialize clock adjustments\n");
+		ts2phc_cleanup(&priv);
+		return -1;
+	}
+
 	priv.holdover_length = config_get_int(cfg, NULL, "ts2phc.holdover");
 	priv.holdover_start = 0;
 
 	while (is_running()) {
-		struct ts2phc_clock *clk;
-
 		if (autocfg) {
 			/* Collect updates from ptp4l */
 			err = pmc_agent_update(priv.agent);
@@ -804,9 +1035,6 @@ int main(int argc, char *argv[])
 				ts2phc_reconfigure(&priv);
 		}
 
-		LIST_FOREACH(clk, &priv.clocks, list)
-			ts2phc_clock_flush_tstamp(clk);
-
 		err = ts2phc_pps_sink_poll(&priv);
 		if (err < 0) {
 			pr_err("poll failed");
@@ -821,6 +1049,7 @@ int main(int argc, char *argv[])
 
 			ts2phc_synchronize_clocks(&priv, autocfg);
 		}
+		ts2phc_holdover(&priv);
 	}
 
 	ts2phc_cleanup(&priv);
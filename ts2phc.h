@@ -16,10 +16,19 @@
 #include "ts2phc_pps_source.h"
 #include "ts2phc_pps_sink.h"
 
+struct ts2phc_adjustment;
 struct ts2phc_sink_array;
 
 #define SERVO_SYNC_INTERVAL    1.0
 
+/* Time stamps kept per clock while waiting for their source edge. */
+#define TS2PHC_TSTAMP_QUEUE    8
+
+struct ts2phc_tstamp {
+	tmv_t ts;
+	uint64_t arrival;
+};
+
 struct ts2phc_clock {
 	LIST_ENTRY(ts2phc_clock) list;
 	clockid_t clkid;
@@ -29,11 +38,13 @@ struct ts2phc_clock {
 	enum port_state new_state;
 	struct servo *servo;
 	enum servo_state servo_state;
+	struct holdover *holdover;
 	char *name;
 	bool no_adj;
 	bool is_target;
-	bool is_ts_available;
-	tmv_t last_ts;
+	struct ts2phc_tstamp tstamps[TS2PHC_TSTAMP_QUEUE];
+	unsigned int tstamp_head;
+	unsigned int n_tstamps;
 };
 
 struct ts2phc_port {
@@ -57,6 +68,11 @@ struct ts2phc_private {
 	LIST_HEAD(clock_head, ts2phc_clock) clocks;
 	int holdover_length;
 	time_t holdover_start;
+	struct ts2phc_tstamp edge;
+	bool edge_valid;
+	struct ts2phc_adjustment *adjustments;
+	unsigned int n_clocks;
+	struct workers *workers;
 };
 
 struct ts2phc_clock *ts2phc_clock_add(struct ts2phc_private *priv,
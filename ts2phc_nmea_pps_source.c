@@ -25,21 +25,32 @@
 
 #define MAX_RMC_AGE	5000000000ULL
 #define NMEA_TMO	2000 /*milliseconds*/
+#define NMEA_READ_SIZE	4096
+/* A character on the serial line has a start and a stop bit. */
+#define NMEA_CHAR_BITS	10
+/* The parser statistics are reported after this many times of day. */
+#define NMEA_STATS_TOD	64
+
+struct nmea_state {
+	struct timespec local_monotime;
+	struct timespec local_utctime;
+	struct timespec rmc_utctime;
+	bool rmc_fix_valid;
+};
 
 struct ts2phc_nmea_pps_source {
 	struct ts2phc_pps_source pps_source;
 	struct config *config;
 	struct lstab *lstab;
 	pthread_t worker;
-	/* Protects anonymous struct fields, below, from concurrent access. */
-	pthread_mutex_t mutex;
 	tmv_t delay_correction;
-	struct {
-		struct timespec local_monotime;
-		struct timespec local_utctime;
-		struct timespec rmc_utctime;
-		bool rmc_fix_valid;
-	};
+	/*
+	 * The state is published by the worker with a sequence lock, so
+	 * that the PPS path never waits. The sequence is odd while the
+	 * state is being written.
+	 */
+	uint32_t seq;
+	struct nmea_state state;
 };
 
 static int open_nmea_connection(const char *host, const char *port,
@@ -61,15 +72,61 @@ static int open_nmea_connection(const char *host, const char *port,
 	return fd;
 }
 
+static void nmea_state_publish(struct ts2phc_nmea_pps_source *s,
+			       const struct nmea_state *state)
+{
+	uint32_t seq = s->seq;
+
+	__atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s->state = *state;
+	__atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void nmea_state_read(struct ts2phc_nmea_pps_source *s,
+			    struct nmea_state *state)
+{
+	uint32_t seq1, seq2;
+
+	do {
+		seq1 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		*state = s->state;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+	} while ((seq1 & 1) || seq1 != seq2);
+}
+
+/* Move a receive time back by the transmission time of 'chars'. */
+static void nmea_rxtime_adjust(struct timespec *ts, int64_t char_ns, int chars)
+{
+	tmv_t t = timespec_to_tmv(*ts);
+
+	t = tmv_sub(t, nanoseconds_to_tmv(char_ns * chars));
+	*ts = tmv_to_timespec(t);
+}
+
+static void nmea_fix_show(const struct nmea_status *status)
+{
+	pr_info("nmea: fix %s, quality %d mode %d, %d satellites, hdop %.2f pdop %.2f",
+		status->fix_valid ? "valid" : "lost", status->fix_quality,
+		status->fix_mode, status->satellites, status->hdop,
+		status->pdop);
+}
+
 static void *monitor_nmea_status(void *arg)
 {
 	struct timespec rxtime, rxtime_rt, tmo = { 2, 0 };
 	struct nmea_parser *np = nmea_parser_create();
 	struct pollfd pfd = { -1, POLLIN | POLLPRI };
-	char *host, input[256], *port, *ptr, *uart;
+	char *host, input[NMEA_READ_SIZE], *port, *ptr, *uart;
+	unsigned int n_reads = 0, n_bytes = 0, n_tod = 0;
 	struct ts2phc_nmea_pps_source *s = arg;
-	int cnt, num, parsed, baud;
-	struct nmea_rmc rmc;
+	int cnt, fix_valid = -1, num, parsed, baud, left;
+	struct timespec stats_start;
+	struct nmea_state state;
+	struct nmea_status status;
+	int64_t char_ns;
+	double elapsed;
 
 	if (!np) {
 		pr_err("failed to create NMEA parser");
@@ -79,6 +136,9 @@ static void *monitor_nmea_status(void *arg)
 	port = config_get_string(s->config, NULL, "ts2phc.nmea_remote_port");
 	uart = config_get_string(s->config, NULL, "ts2phc.nmea_serialport");
 	baud = config_get_int(s->config, NULL, "ts2phc.nmea_baudrate");
+	/* Only a serial line has a known rate of arrival of the bytes. */
+	char_ns = host[0] && port[0] ? 0 : NMEA_CHAR_BITS * 1000000000LL / baud;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &stats_start);
 
 	while (is_running()) {
 		if (pfd.fd == -1) {
@@ -89,8 +149,6 @@ static void *monitor_nmea_status(void *arg)
 			}
 		}
 		num = poll(&pfd, 1, NMEA_TMO);
-		clock_gettime(CLOCK_MONOTONIC_RAW, &rxtime);
-		clock_gettime(CLOCK_REALTIME, &rxtime_rt);
 		if (num < 0) {
 			pr_err("poll failed");
 			break;
@@ -110,6 +168,12 @@ static void *monitor_nmea_status(void *arg)
 		if (!(pfd.revents & (POLLIN | POLLPRI))) {
 			continue;
 		}
+		/*
+		 * Everything in the buffer has arrived by the time of the
+		 * read, so take the receive time right before it.
+		 */
+		clock_gettime(CLOCK_MONOTONIC_RAW, &rxtime);
+		clock_gettime(CLOCK_REALTIME, &rxtime_rt);
 		cnt = read(pfd.fd, input, sizeof(input));
 		if (cnt <= 0) {
 			pr_err("failed to read from nmea source");
@@ -117,19 +181,46 @@ static void *monitor_nmea_status(void *arg)
 			pfd.fd = -1;
 			continue;
 		}
+		n_reads++;
+		n_bytes += cnt;
 		ptr = input;
+		left = cnt;
 		do {
-			if (!nmea_parse(np, ptr, cnt, &rmc, &parsed)) {
-				pthread_mutex_lock(&s->mutex);
-				s->local_monotime = rxtime;
-				s->local_utctime = rxtime_rt;
-				s->rmc_utctime = rmc.ts;
-				s->rmc_fix_valid = rmc.fix_valid;
-				pthread_mutex_unlock(&s->mutex);
+			if (!nmea_parse(np, ptr, left, &status, &parsed)) {
+				/*
+				 * The bytes after the end of the sentence
+				 * were still on the line when it arrived.
+				 */
+				state.local_monotime = rxtime;
+				state.local_utctime = rxtime_rt;
+				nmea_rxtime_adjust(&state.local_monotime,
+						   char_ns, left - parsed);
+				nmea_rxtime_adjust(&state.local_utctime,
+						   char_ns, left - parsed);
+				state.rmc_utctime = status.ts;
+				state.rmc_fix_valid = status.fix_valid;
+				nmea_state_publish(s, &state);
+				n_tod++;
+				if (fix_valid != status.fix_valid) {
+					fix_valid = status.fix_valid;
+					nmea_fix_show(&status);
+				}
 			}
-			cnt -= parsed;
+			left -= parsed;
 			ptr += parsed;
-		} while (cnt);
+		} while (left);
+
+		if (n_tod < NMEA_STATS_TOD)
+			continue;
+		elapsed = (rxtime.tv_sec - stats_start.tv_sec) +
+			(rxtime.tv_nsec - stats_start.tv_nsec) * 1e-9;
+		pr_info("nmea: %u reads %u bytes %u tod in %.1f s, %.2f tod/s, "
+			"%d satellites, hdop %.2f pdop %.2f",
+			n_reads, n_bytes, n_tod, elapsed,
+			elapsed > 0 ? n_tod / elapsed : 0.0,
+			status.satellites, status.hdop, status.pdop);
+		n_reads = n_bytes = n_tod = 0;
+		stats_start = rxtime;
 	}
 
 	nmea_parser_destroy(np);
@@ -144,7 +235,6 @@ static void ts2phc_nmea_pps_source_destroy(struct ts2phc_pps_source *src)
 	struct ts2phc_nmea_pps_source *s =
 		container_of(src, struct ts2phc_nmea_pps_source, pps_source);
 	pthread_join(s->worker, NULL);
-	pthread_mutex_destroy(&s->mutex);
 	lstab_destroy(s->lstab);
 	free(s);
 }
@@ -157,23 +247,20 @@ static int ts2phc_nmea_pps_source_getppstime(struct ts2phc_pps_source *src,
 	tmv_t delay_t1, delay_t2, duration_since_rmc, local_t1, local_t2, rmc;
 	int lstab_error = -1, tai_offset = 0;
 	enum lstab_result result;
+	struct nmea_state state;
 	struct timespec now;
 	int64_t utc_time;
-	bool fix_valid;
 
 	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
 	local_t2 = timespec_to_tmv(now);
 
-	pthread_mutex_lock(&m->mutex);
-
-	local_t1 = timespec_to_tmv(m->local_monotime);
-	delay_t2 = timespec_to_tmv(m->local_utctime);
-	rmc = timespec_to_tmv(m->rmc_utctime);
-	fix_valid = m->rmc_fix_valid;
+	nmea_state_read(m, &state);
 
-	pthread_mutex_unlock(&m->mutex);
+	local_t1 = timespec_to_tmv(state.local_monotime);
+	delay_t2 = timespec_to_tmv(state.local_utctime);
+	rmc = timespec_to_tmv(state.rmc_utctime);
 
-	if (!fix_valid) {
+	if (!state.rmc_fix_valid) {
 		pr_debug("nmea: no valid rmc fix");
 		return -1;
 	}
@@ -238,7 +325,6 @@ struct ts2phc_pps_source *ts2phc_nmea_pps_source_create(struct ts2phc_private *p
 	s->config = priv->cfg;
 	s->delay_correction = nanoseconds_to_tmv(
 			 config_get_int(priv->cfg, NULL, "ts2phc.nmea_delay"));
-	pthread_mutex_init(&s->mutex, NULL);
 	err = pthread_create(&s->worker, NULL, monitor_nmea_status, s);
 	if (err) {
 		pr_err("failed to create worker thread: %s", strerror(err));
@@ -21,9 +21,18 @@
 #include "phc.h"
 #include "print.h"
 #include "servo.h"
+#include "stats.h"
 #include "ts2phc.h"
 #include "util.h"
 
+#define NS_PER_SEC		1000000000LL
+
+/* The number of events read from a sink with a single read(). */
+#define EXTTS_BATCH		16
+
+/* The sink statistics are reported after this many edges. */
+#define SINK_STATS_EDGES	64
+
 struct ts2phc_pps_sink {
 	char *name;
 	STAILQ_ENTRY(ts2phc_pps_sink) list;
@@ -32,20 +41,17 @@ struct ts2phc_pps_sink {
 	tmv_t correction;
 	uint32_t pulsewidth;
 	struct ts2phc_clock *clock;
+	tmv_t last_event;
+	bool have_last_event;
+	unsigned int missed_edges;
+	struct stats *jitter;
 };
 
 struct ts2phc_sink_array {
 	struct ts2phc_pps_sink **sink;
-	int *collected_events;
 	struct pollfd *pfd;
 };
 
-enum extts_result {
-	EXTTS_ERROR	= -1,
-	EXTTS_OK	= 0,
-	EXTTS_IGNORE	= 1,
-};
-
 static int ts2phc_pps_sink_array_create(struct ts2phc_private *priv)
 {
 	struct ts2phc_sink_array *polling_array;
@@ -66,10 +72,6 @@ static int ts2phc_pps_sink_array_create(struct ts2phc_private *priv)
 	if (!polling_array->pfd)
 		goto err_alloc_pfd;
 
-	polling_array->collected_events = malloc(priv->n_sinks * sizeof(int));
-	if (!polling_array->collected_events)
-		goto err_alloc_events;
-
 	i = 0;
 	STAILQ_FOREACH(sink, &priv->sinks, list) {
 		polling_array->sink[i] = sink;
@@ -86,8 +88,6 @@ static int ts2phc_pps_sink_array_create(struct ts2phc_private *priv)
 
 	return 0;
 
-err_alloc_events:
-	free(polling_array->pfd);
 err_alloc_pfd:
 	free(polling_array->sink);
 err_alloc_sinks:
@@ -107,7 +107,6 @@ static void ts2phc_pps_sink_array_destroy(struct ts2phc_private *priv)
 	if (!priv->polling_array)
 		return;
 
-	free(polling_array->collected_events);
 	free(polling_array->sink);
 	free(polling_array->pfd);
 	free(polling_array);
@@ -177,6 +176,12 @@ static struct ts2phc_pps_sink *ts2phc_pps_sink_create(struct ts2phc_private *pri
 	if (sink->pulsewidth > 500000000)
 		sink->pulsewidth = 1000000000 - sink->pulsewidth;
 
+	sink->jitter = stats_create();
+	if (!sink->jitter) {
+		pr_err("low memory");
+		goto no_stats;
+	}
+
 	sink->clock = ts2phc_clock_add(priv, device);
 	if (!sink->clock) {
 		pr_err("failed to open clock");
@@ -219,6 +224,8 @@ no_ext_ts:
 no_pin_func:
 	ts2phc_clock_destroy(sink->clock);
 no_posix_clock:
+	stats_destroy(sink->jitter);
+no_stats:
 	free(sink->name);
 	free(sink);
 	return NULL;
@@ -235,6 +242,7 @@ static void ts2phc_pps_sink_destroy(struct ts2phc_pps_sink *sink)
 		pr_err(PTP_EXTTS_REQUEST_FAILED);
 	}
 	ts2phc_clock_destroy(sink->clock);
+	stats_destroy(sink->jitter);
 	free(sink->name);
 	free(sink);
 }
@@ -261,54 +269,88 @@ static bool ts2phc_pps_sink_ignore(struct ts2phc_private *priv,
 	       source_ts.tv_nsec < ignore_upper;
 }
 
-static enum extts_result ts2phc_pps_sink_event(struct ts2phc_private *priv,
-					       struct ts2phc_pps_sink *sink)
+/*
+ * Count the edges missing since the previous event of the sink, and
+ * record how far the event is from a whole number of periods after it.
+ */
+static void ts2phc_pps_sink_account(struct ts2phc_pps_sink *sink, tmv_t ts)
 {
-	enum extts_result result = EXTTS_OK;
-	struct ptp_extts_event event;
+	struct stats_result jitter;
+	int64_t interval, periods;
+
+	if (sink->have_last_event) {
+		interval = tmv_to_nanoseconds(tmv_sub(ts, sink->last_event));
+		periods = (interval + NS_PER_SEC / 2) / NS_PER_SEC;
+		if (periods > 1) {
+			sink->missed_edges += periods - 1;
+			pr_warning("%s missed %" PRId64 " edge(s), %u in total",
+				   sink->name, periods - 1, sink->missed_edges);
+		}
+		if (periods > 0)
+			stats_add_value(sink->jitter,
+					interval - periods * NS_PER_SEC);
+	}
+	sink->last_event = ts;
+	sink->have_last_event = true;
+
+	if (stats_get_num_values(sink->jitter) < SINK_STATS_EDGES)
+		return;
+	stats_get_result(sink->jitter, &jitter);
+	pr_info("%s jitter rms %4.0f max %4.0f missed edges %u",
+		sink->name, jitter.rms, jitter.max_abs, sink->missed_edges);
+	stats_reset(sink->jitter);
+}
+
+/*
+ * Read all pending events of a sink at once and queue their time
+ * stamps on the sink's clock. Returns the number of queued time stamps
+ * or a negative error code.
+ */
+static int ts2phc_pps_sink_events(struct ts2phc_private *priv,
+				  struct ts2phc_pps_sink *sink)
+{
+	struct ptp_extts_event event[EXTTS_BATCH];
 	struct timespec source_ts;
-	int err, cnt;
+	int cnt, i, n, queued = 0;
 	tmv_t ts;
 
-	cnt = read(sink->clock->fd, &event, sizeof(event));
-	if (cnt != sizeof(event)) {
+	cnt = read(sink->clock->fd, event, sizeof(event));
+	if (cnt < 0 || cnt % sizeof(event[0])) {
 		pr_err("read extts event failed: %m");
-		result = EXTTS_ERROR;
-		goto out;
-	}
-	if (event.index != sink->pin_desc.chan) {
-		pr_err("extts on unexpected channel");
-		result = EXTTS_ERROR;
-		goto out;
+		return -EIO;
 	}
+	n = cnt / sizeof(event[0]);
 
-	if (sink->polarity == (PTP_RISING_EDGE | PTP_FALLING_EDGE)) {
-		err = ts2phc_pps_source_getppstime(priv->src, &source_ts);
-		if (err < 0) {
-			pr_debug("source ts not valid");
-			return 0;
+	for (i = 0; i < n; i++) {
+		if (event[i].index != sink->pin_desc.chan) {
+			pr_err("extts on unexpected channel");
+			return -EIO;
 		}
 
-		if (ts2phc_pps_sink_ignore(priv, sink, source_ts)) {
-			pr_debug("%s SKIP extts index %u at %lld.%09u src %" PRIi64 ".%ld",
-				 sink->name, event.index, event.t.sec,
-				 event.t.nsec, (int64_t)source_ts.tv_sec,
-				 source_ts.tv_nsec);
-
-			result = EXTTS_IGNORE;
-			goto out;
+		if (sink->polarity == (PTP_RISING_EDGE | PTP_FALLING_EDGE)) {
+			if (ts2phc_pps_source_getppstime(priv->src,
+							 &source_ts) < 0) {
+				pr_debug("source ts not valid");
+				continue;
+			}
+			if (ts2phc_pps_sink_ignore(priv, sink, source_ts)) {
+				pr_debug("%s SKIP extts index %u at %lld.%09u src %" PRIi64 ".%ld",
+					 sink->name, event[i].index,
+					 event[i].t.sec, event[i].t.nsec,
+					 (int64_t)source_ts.tv_sec,
+					 source_ts.tv_nsec);
+				continue;
+			}
 		}
-	}
-
-out:
-	if (result == EXTTS_ERROR || result == EXTTS_IGNORE)
-		return result;
 
-	ts = pct_to_tmv(event.t);
-	ts = tmv_add(ts, sink->correction);
-	ts2phc_clock_add_tstamp(sink->clock, ts);
+		ts = pct_to_tmv(event[i].t);
+		ts = tmv_add(ts, sink->correction);
+		ts2phc_pps_sink_account(sink, ts);
+		ts2phc_clock_add_tstamp(sink->clock, ts);
+		queued++;
+	}
 
-	return EXTTS_OK;
+	return queued;
 }
 
 /* public methods */
@@ -381,75 +423,44 @@ void ts2phc_pps_sink_cleanup(struct ts2phc_private *priv)
 int ts2phc_pps_sink_poll(struct ts2phc_private *priv)
 {
 	struct ts2phc_sink_array *polling_array = priv->polling_array;
-	bool all_sinks_have_events = false;
-	bool ignore_any = false;
+	struct ts2phc_pps_sink *sink;
+	int cnt, queued = 0;
 	unsigned int i;
-	int cnt;
-
-	for (i = 0; i < priv->n_sinks; i++)
-		polling_array->collected_events[i] = 0;
-
-	while (!all_sinks_have_events) {
-		struct ts2phc_pps_sink *sink;
 
-		if (!is_running())
-			return 0;
-
-		cnt = poll(polling_array->pfd, priv->n_sinks, 2000);
-		if (cnt < 0) {
-			if (errno == EINTR) {
-				return 0;
-			} else {
-				pr_emerg("poll failed");
-				return -1;
-			}
-		} else if (!cnt) {
-			pr_debug("poll returns zero, no events");
+	/*
+	 * Service each sink as soon as it has events, rather than waiting
+	 * for all of them, so that a sink which misses a pulse does not
+	 * hold up the others. The time stamps wait in the queue of each
+	 * sink's clock until they are matched with their source edge.
+	 */
+	cnt = poll(polling_array->pfd, priv->n_sinks, 2000);
+	if (cnt < 0) {
+		if (errno == EINTR) {
 			return 0;
+		} else {
+			pr_emerg("poll failed");
+			return -1;
 		}
+	} else if (!cnt) {
+		pr_debug("poll returns zero, no events");
+		return 0;
+	}
 
-		for (i = 0; i < priv->n_sinks; i++) {
-			if (polling_array->pfd[i].revents & POLLERR) {
-				sink = polling_array->sink[i];
-
-				pr_err("%s: error polling on pfd[%d]\n",
-				       sink->name, i);
-				return -EIO;
-			}
-
-			if (polling_array->pfd[i].revents & (POLLIN|POLLPRI)) {
-				enum extts_result result;
-
-				sink = polling_array->sink[i];
-
-				result = ts2phc_pps_sink_event(priv, sink);
-				if (result == EXTTS_ERROR)
-					return -EIO;
-				if (result == EXTTS_IGNORE)
-					ignore_any = true;
+	for (i = 0; i < priv->n_sinks; i++) {
+		sink = polling_array->sink[i];
 
-				/*
-				 * Collect the events anyway, even if we'll
-				 * ignore this source edge later. We don't
-				 * want sink events from different edges
-				 * to pile up and mix.
-				 */
-				polling_array->collected_events[i]++;
-			}
+		if (polling_array->pfd[i].revents & POLLERR) {
+			pr_err("%s: error polling on pfd[%d]\n",
+			       sink->name, i);
+			return -EIO;
 		}
-
-		all_sinks_have_events = true;
-
-		for (i = 0; i < priv->n_sinks; i++) {
-			if (!polling_array->collected_events[i]) {
-				all_sinks_have_events = false;
-				break;
-			}
+		if (polling_array->pfd[i].revents & (POLLIN|POLLPRI)) {
+			cnt = ts2phc_pps_sink_events(priv, sink);
+			if (cnt < 0)
+				return cnt;
+			queued += cnt;
 		}
 	}
 
-	if (ignore_any)
-		return 0;
-
-	return 1;
+	return queued;
 }
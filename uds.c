@@ -135,6 +135,36 @@ static int uds_send(struct transport *t, struct fdarray *fda,
 	return cnt;
 }
 
+/*
+ * sendmmsg() stops at the first entry which fails, for example when a
+ * subscriber has closed its socket, and reports the error only when it
+ * sent nothing. Skip the failed entry and carry on with the rest.
+ */
+static int uds_sendmany(struct transport *t, struct fdarray *fda,
+			struct mmsghdr *msgvec, unsigned int vlen)
+{
+	int cnt, err = 0, fd = fda->fd[FD_GENERAL];
+	unsigned int i = 0, sent = 0;
+
+	while (i < vlen) {
+		cnt = sendmmsg(fd, msgvec + i, vlen - i, 0);
+		if (cnt < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			err = -errno;
+			i++;
+			continue;
+		}
+		if (!cnt) {
+			break;
+		}
+		i += cnt;
+		sent += cnt;
+	}
+	return sent || !err ? sent : err;
+}
+
 static void uds_release(struct transport *t)
 {
 	struct uds *uds = container_of(t, struct uds, t);
@@ -151,6 +181,7 @@ struct transport *uds_transport_create(void)
 	uds->t.open    = uds_open;
 	uds->t.recv    = uds_recv;
 	uds->t.send    = uds_send;
+	uds->t.sendmany = uds_sendmany;
 	uds->t.release = uds_release;
 	return &uds->t;
 }
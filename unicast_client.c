@@ -19,6 +19,7 @@
  */
 #include <stdlib.h>
 
+#include "evlog.h"
 #include "port.h"
 #include "port_private.h"
 #include "print.h"
@@ -444,6 +445,9 @@ void unicast_client_grant(struct port *p, struct ptp_message *m,
 	g = (struct grant_unicast_xmit_tlv *) extra->tlv;
 	mtype = g->message_type >> 4;
 
+	evlog_event(EVLOG_GRANT_RX, portnum(p), 0, 0, mtype, g->durationField,
+		    &m->header.sourcePortIdentity.clockIdentity);
+
 	if (!g->durationField) {
 		pr_warning("%s: unicast grant of %s rejected",
 			   p->log_name, msg_type_string(mtype));
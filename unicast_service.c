@@ -17,12 +17,14 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
  */
+#include <math.h>
 #include <stdlib.h>
 #include <sys/queue.h>
 #include <time.h>
 
 #include "address.h"
 #include "clock.h"
+#include "evlog.h"
 #include "missing.h"
 #include "port.h"
 #include "port_private.h"
@@ -32,9 +34,55 @@
 #include "util.h"
 
 #define QUEUE_LEN 16
+/* Number of buckets in the index of client addresses, a power of two. */
+#define PEER_HASH_SIZE 1024
+/* The clients of an interval are spread over this many phases, */
+#define UNICAST_PHASES 16
+/* as long as the phases are at least this far apart. */
+#define UNICAST_PHASE_MIN_NS 1000000LL
+/* Seconds between the reports of the transmission statistics. */
+#define UNICAST_STATS_INTERVAL 60
+/* Above this share of the capacity, grants are shortened ... */
+#define UNICAST_SHORTEN_LOAD 0.9
+/* ... to at most this many seconds. */
+#define UNICAST_SHORT_DURATION 60
+
+/* The message types which are granted to clients. */
+enum {
+	SERVICE_ANNOUNCE,
+	SERVICE_SYNC,
+	N_SERVICES
+};
+
+static const uint8_t service_mtype[N_SERVICES] = { ANNOUNCE, SYNC };
+
+/* The response contracts, which are served on demand. */
+enum {
+	RESP_DELAY,
+	RESP_PDELAY,
+	N_RESPONSES
+};
+
+/*
+ * A client address in the index, which points to the record serving
+ * each message type. Each type is served by at most one interval.
+ * The response contracts are only kept for the capacity accounting.
+ */
+struct unicast_peer {
+	LIST_ENTRY(unicast_peer) list;
+	struct address addr;
+	struct unicast_client_address *record[N_SERVICES];
+	unsigned int resp_types;
+	int resp_period[N_RESPONSES];
+	time_t resp_tmo[N_RESPONSES];
+};
 
 struct unicast_client_address {
 	LIST_ENTRY(unicast_client_address) list;
+	struct unicast_service_interval *interval;
+	struct unicast_peer *peer;
+	int phase;
+	unsigned int round;
 	struct PortIdentity portIdentity;
 	struct {
 		UInteger16 announce;
@@ -45,17 +93,54 @@ struct unicast_client_address {
 	time_t grant_tmo;
 };
 
+/*
+ * The timer of an interval expires once per phase, and serves the
+ * clients of that phase. A client is served once per round, that is
+ * once per period.
+ */
 struct unicast_service_interval {
-	LIST_HEAD(uca, unicast_client_address) clients;
+	LIST_HEAD(uca, unicast_client_address) clients[UNICAST_PHASES];
+	unsigned int n_clients[UNICAST_PHASES];
+	unsigned int total;
 	LIST_ENTRY(unicast_service_interval) list;
 	struct timespec incr;
+	struct timespec sched;
 	struct timespec tmo;
 	int log_period;
+	int n_phases;
+	int phase;
+	unsigned int round;
 };
 
 struct unicast_service {
 	LIST_HEAD(usi, unicast_service_interval) intervals;
+	LIST_HEAD(peer_bucket, unicast_peer) peers[PEER_HASH_SIZE];
 	struct pqueue *queue;
+	int n_clients;
+	/* Token bucket pacing the transmissions, unlimited at zero rate. */
+	double tx_rate;
+	double tx_burst;
+	double tokens;
+	struct timespec refill;
+	/* Transmission statistics. */
+	time_t stats_start;
+	unsigned int max_burst;
+	unsigned int n_bursts;
+	uint64_t sum_burst;
+	unsigned int paced;
+	unsigned int failed;
+	/*
+	 * The load of the granted contracts, in packets and in transmit
+	 * time stamps per second, against the capacity, unlimited at zero.
+	 */
+	int two_step;
+	double load_pkts;
+	double load_ts;
+	double max_pkts;
+	double max_ts;
+	time_t last_sweep;
+	unsigned int denied;
+	unsigned int shortened;
 };
 
 static struct timespec log_to_timespec(int log_seconds);
@@ -108,6 +193,254 @@ static int attach_interface_rate(struct ptp_message *msg,
 	return 0;
 }
 
+static int service_index(uint8_t mtype)
+{
+	return mtype == ANNOUNCE ? SERVICE_ANNOUNCE : SERVICE_SYNC;
+}
+
+static int resp_index(uint8_t mtype)
+{
+	return mtype == DELAY_RESP ? RESP_DELAY : RESP_PDELAY;
+}
+
+/* Returns the load of a contract for 'mtype' every 2^period seconds. */
+static void contract_load(struct unicast_service *s, uint8_t mtype, int period,
+			  double *pkts, double *ts)
+{
+	double rate = ldexp(1.0, -period);
+
+	*pkts = rate;
+	*ts = 0.0;
+	switch (mtype) {
+	case SYNC:
+	case PDELAY_RESP:
+		/* The event message carries a transmit time stamp, ... */
+		*ts = rate;
+		if (s->two_step) {
+			/* ... and is followed up when two step. */
+			*pkts += rate;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void load_update(struct unicast_service *s, uint8_t mtype, int period,
+			int sign)
+{
+	double pkts, ts;
+
+	contract_load(s, mtype, period, &pkts, &ts);
+	s->load_pkts += sign * pkts;
+	s->load_ts += sign * ts;
+	if (s->load_pkts < 1e-9) {
+		s->load_pkts = 0.0;
+	}
+	if (s->load_ts < 1e-9) {
+		s->load_ts = 0.0;
+	}
+}
+
+/*
+ * Checks whether a contract for 'mtype' every 2^period seconds fits
+ * within the capacity, after the release of the one every 2^old
+ * seconds, if any.
+ */
+static int admit(struct unicast_service *s, uint8_t mtype, int period,
+		 int replace, int old)
+{
+	double pkts, ts, old_pkts = 0.0, old_ts = 0.0;
+
+	contract_load(s, mtype, period, &pkts, &ts);
+	if (replace) {
+		contract_load(s, mtype, old, &old_pkts, &old_ts);
+	}
+	if ((s->max_pkts && pkts > old_pkts &&
+	     s->load_pkts - old_pkts + pkts > s->max_pkts) ||
+	    (s->max_ts && ts > old_ts &&
+	     s->load_ts - old_ts + ts > s->max_ts)) {
+		s->denied++;
+		return -1;
+	}
+	return 0;
+}
+
+/* Returns the largest share of the capacity in use. */
+static double utilization(struct unicast_service *s)
+{
+	double u = 0.0;
+
+	if (s->max_pkts) {
+		u = s->load_pkts / s->max_pkts;
+	}
+	if (s->max_ts && s->load_ts / s->max_ts > u) {
+		u = s->load_ts / s->max_ts;
+	}
+	return u;
+}
+
+/* Returns the part of an address which addreq() compares. */
+static int peer_key(enum transport_type type, struct address *a,
+		    unsigned char **key)
+{
+	switch (type) {
+	case TRANS_UDP_IPV4:
+		*key = (unsigned char *) &a->sin.sin_addr;
+		return sizeof(a->sin.sin_addr);
+	case TRANS_UDP_IPV6:
+		*key = (unsigned char *) &a->sin6.sin6_addr;
+		return sizeof(a->sin6.sin6_addr);
+	case TRANS_IEEE_802_3:
+		*key = a->sll.sll_addr;
+		return MAC_LEN;
+	default:
+		*key = NULL;
+		return 0;
+	}
+}
+
+static unsigned int peer_hash(enum transport_type type, struct address *a)
+{
+	uint32_t h = 2166136261U;
+	unsigned char *key;
+	int i, len;
+
+	/* FNV-1a */
+	len = peer_key(type, a, &key);
+	for (i = 0; i < len; i++) {
+		h ^= key[i];
+		h *= 16777619U;
+	}
+	return h & (PEER_HASH_SIZE - 1);
+}
+
+static struct unicast_peer *peer_lookup(struct port *p, struct address *a,
+					unsigned int *bucket)
+{
+	enum transport_type type = transport_type(p->trp);
+	struct unicast_peer *peer;
+
+	*bucket = peer_hash(type, a);
+	LIST_FOREACH(peer, &p->unicast_service->peers[*bucket], list) {
+		if (addreq(type, &peer->addr, a)) {
+			return peer;
+		}
+	}
+	return NULL;
+}
+
+/* Frees an address without any contract. Returns one if it was freed. */
+static int peer_release(struct unicast_peer *peer)
+{
+	int i;
+
+	if (peer->resp_types) {
+		return 0;
+	}
+	for (i = 0; i < N_SERVICES; i++) {
+		if (peer->record[i]) {
+			return 0;
+		}
+	}
+	LIST_REMOVE(peer, list);
+	free(peer);
+	return 1;
+}
+
+/*
+ * Clears the contracts in 'mask' from a client record. The record is
+ * freed when no contract is left, and its address when no record is.
+ */
+static void client_clear(struct unicast_service *s,
+			 struct unicast_client_address *client,
+			 unsigned int mask)
+{
+	struct unicast_peer *peer = client->peer;
+	int i;
+
+	for (i = 0; i < N_SERVICES; i++) {
+		if (client->message_types & mask & (1 << service_mtype[i])) {
+			load_update(s, service_mtype[i],
+				    client->interval->log_period, -1);
+		}
+	}
+	client->message_types &= ~mask;
+	for (i = 0; i < N_SERVICES; i++) {
+		if (peer->record[i] == client &&
+		    !(client->message_types & (1 << service_mtype[i]))) {
+			peer->record[i] = NULL;
+		}
+	}
+	if (client->message_types) {
+		return;
+	}
+	client->interval->n_clients[client->phase]--;
+	client->interval->total--;
+	LIST_REMOVE(client, list);
+	free(client);
+	s->n_clients--;
+
+	peer_release(peer);
+}
+
+/* Clears a response contract. Returns one if the address was freed. */
+static int resp_clear(struct unicast_service *s, struct unicast_peer *peer,
+		      uint8_t mtype)
+{
+	int idx = resp_index(mtype);
+
+	if (!(peer->resp_types & (1 << idx))) {
+		return 0;
+	}
+	load_update(s, mtype, peer->resp_period[idx], -1);
+	peer->resp_types &= ~(1 << idx);
+	return peer_release(peer);
+}
+
+/*
+ * Expires the response contracts, which are not visited by the
+ * timer, once per second.
+ */
+static void resp_expire(struct unicast_service *s, time_t now)
+{
+	static const uint8_t mtype[N_RESPONSES] = { DELAY_RESP, PDELAY_RESP };
+	struct unicast_peer *peer, *next;
+	int i, j;
+
+	if (now == s->last_sweep) {
+		return;
+	}
+	s->last_sweep = now;
+	for (i = 0; i < PEER_HASH_SIZE; i++) {
+		LIST_FOREACH_SAFE(peer, &s->peers[i], list, next) {
+			for (j = 0; j < N_RESPONSES; j++) {
+				if ((peer->resp_types & (1 << j)) &&
+				    now > peer->resp_tmo[j] &&
+				    resp_clear(s, peer, mtype[j])) {
+					break;
+				}
+			}
+		}
+	}
+}
+
+static void peers_clear(struct unicast_service *s)
+{
+	struct unicast_peer *peer;
+	int i;
+
+	for (i = 0; i < PEER_HASH_SIZE; i++) {
+		while ((peer = LIST_FIRST(&s->peers[i])) != NULL) {
+			LIST_REMOVE(peer, list);
+			free(peer);
+		}
+	}
+	s->n_clients = 0;
+	s->load_pkts = 0.0;
+	s->load_ts = 0.0;
+}
+
 static int compare_timeout(void *ain, void *bin)
 {
 	struct unicast_service_interval *a, *b;
@@ -121,19 +454,135 @@ static int compare_timeout(void *ain, void *bin)
 static void initialize_interval(struct unicast_service_interval *interval,
 				int log_period)
 {
-	LIST_INIT(&interval->clients);
-	interval->incr = log_to_timespec(log_period);
-	do_clock_gettime(CLOCK_MONOTONIC, &interval->tmo);
-	interval->tmo.tv_nsec += 10000000;
-	timespec_normalize(&interval->tmo);
+	struct timespec period = log_to_timespec(log_period);
+	int64_t ns = period.tv_sec * NS_PER_SEC + period.tv_nsec;
+	int i, n = UNICAST_PHASES;
+
+	while (n > 1 && ns / n < UNICAST_PHASE_MIN_NS) {
+		n--;
+	}
+	for (i = 0; i < UNICAST_PHASES; i++) {
+		LIST_INIT(&interval->clients[i]);
+	}
+	interval->n_phases = n;
+	interval->incr.tv_sec = ns / n / NS_PER_SEC;
+	interval->incr.tv_nsec = ns / n % NS_PER_SEC;
+	do_clock_gettime(CLOCK_MONOTONIC, &interval->sched);
+	interval->sched.tv_nsec += 10000000;
+	timespec_normalize(&interval->sched);
+	interval->tmo = interval->sched;
 	interval->log_period = log_period;
 }
 
+/* Adds a client to the phase with the fewest clients. */
+static void interval_add_client(struct unicast_service_interval *interval,
+				struct unicast_client_address *client)
+{
+	int i, phase = 0;
+
+	for (i = 1; i < interval->n_phases; i++) {
+		if (interval->n_clients[i] < interval->n_clients[phase]) {
+			phase = i;
+		}
+	}
+	client->interval = interval;
+	client->phase = phase;
+	client->round = interval->round - 1;
+	LIST_INSERT_HEAD(&interval->clients[phase], client, list);
+	interval->n_clients[phase]++;
+	interval->total++;
+}
+
 static void interval_increment(struct unicast_service_interval *i)
 {
-	i->tmo.tv_sec += i->incr.tv_sec;
-	i->tmo.tv_nsec += i->incr.tv_nsec;
-	timespec_normalize(&i->tmo);
+	i->sched.tv_sec += i->incr.tv_sec;
+	i->sched.tv_nsec += i->incr.tv_nsec;
+	timespec_normalize(&i->sched);
+	i->tmo = i->sched;
+	if (++i->phase == i->n_phases) {
+		i->phase = 0;
+		i->round++;
+	}
+}
+
+static void pacer_refill(struct unicast_service *s, struct timespec *now)
+{
+	double dt;
+
+	dt = (now->tv_sec - s->refill.tv_sec) +
+		(now->tv_nsec - s->refill.tv_nsec) / 1e9;
+	s->tokens += dt * s->tx_rate;
+	if (s->tokens > s->tx_burst) {
+		s->tokens = s->tx_burst;
+	}
+	s->refill = *now;
+}
+
+/*
+ * Takes the tokens for 'cost' packets. Otherwise returns the time at
+ * which enough tokens will be available in 'resume'.
+ */
+static int pacer_take(struct unicast_service *s, struct timespec *now,
+		      int cost, struct timespec *resume)
+{
+	int64_t ns;
+
+	if (!s->tx_rate) {
+		return 0;
+	}
+	if (s->tokens < cost) {
+		pacer_refill(s, now);
+	}
+	if (s->tokens >= cost) {
+		s->tokens -= cost;
+		return 0;
+	}
+	ns = (cost - s->tokens) / s->tx_rate * NS_PER_SEC + 1;
+	*resume = *now;
+	resume->tv_sec += ns / NS_PER_SEC;
+	resume->tv_nsec += ns % NS_PER_SEC;
+	timespec_normalize(resume);
+	return -1;
+}
+
+static int client_cost(struct unicast_service *s,
+		       struct unicast_client_address *client)
+{
+	int cost = 0;
+
+	if (client->message_types & (1 << ANNOUNCE)) {
+		cost++;
+	}
+	if (client->message_types & (1 << SYNC)) {
+		cost++;
+		if (s->two_step) {
+			/* Follow_Up */
+			cost++;
+		}
+	}
+	return cost;
+}
+
+static void unicast_service_stats(struct port *p, struct timespec *now)
+{
+	struct unicast_service *s = p->unicast_service;
+
+	if (now->tv_sec - s->stats_start < UNICAST_STATS_INTERVAL) {
+		return;
+	}
+	if (s->paced || s->failed) {
+		pr_info("%s: unicast tx burst max %u mean %.1f packets, "
+			"%u clients paced, %u transmissions failed",
+			p->log_name, s->max_burst,
+			s->n_bursts ? (double) s->sum_burst / s->n_bursts : 0.0,
+			s->paced, s->failed);
+	}
+	s->stats_start = now->tv_sec;
+	s->max_burst = 0;
+	s->n_bursts = 0;
+	s->sum_burst = 0;
+	s->paced = 0;
+	s->failed = 0;
 }
 
 static struct timespec log_to_timespec(int log_seconds)
@@ -185,42 +634,66 @@ static void timespec_normalize(struct timespec *ts)
 	}
 }
 
+/*
+ * Serves the clients in the current phase of an interval. Returns
+ * one in 'paced' when the pacer deferred some of them, in which case
+ * the timeout of the interval is set to resume them.
+ */
 static int unicast_service_clients(struct port *p,
-				   struct unicast_service_interval *interval)
+				   struct unicast_service_interval *interval,
+				   struct timespec *now, int *paced)
 {
 	struct unicast_client_address *client, *next;
-	struct timespec now;
-	int err = 0;
-
-	err = do_clock_gettime(CLOCK_MONOTONIC, &now);
-	if (err) {
-		pr_err("clock_gettime failed: %m");
-		return err;
-	}
-	LIST_FOREACH_SAFE(client, &interval->clients, list, next) {
+	struct unicast_service *s = p->unicast_service;
+	unsigned int burst = 0;
+	int cost, err = 0;
+
+	*paced = 0;
+	LIST_FOREACH_SAFE(client, &interval->clients[interval->phase], list,
+			  next) {
+		if (client->round == interval->round) {
+			/* Served before the pacer deferred the rest. */
+			continue;
+		}
 		pr_debug("%s wants 0x%x", pid2str(&client->portIdentity),
 			 client->message_types);
-		if (now.tv_sec > client->grant_tmo) {
+		if (now->tv_sec > client->grant_tmo) {
 			pr_debug("%s service of 0x%x expired",
 				 pid2str(&client->portIdentity),
 				 client->message_types);
-			LIST_REMOVE(client, list);
-			free(client);
+			client_clear(s, client, client->message_types);
 			continue;
 		}
+		cost = client_cost(s, client);
+		if (pacer_take(s, now, cost, &interval->tmo)) {
+			s->paced++;
+			*paced = 1;
+			break;
+		}
+		client->round = interval->round;
+		burst += cost;
 		if (client->message_types & (1 << ANNOUNCE)) {
 			if (port_tx_announce(p, &client->addr,
 					     client->seqnum.announce++)) {
+				s->failed++;
 				err = -1;
 			}
 		}
 		if (client->message_types & (1 << SYNC)) {
 			if (port_tx_sync(p, &client->addr,
 					 client->seqnum.sync++)) {
+				s->failed++;
 				err = -1;
 			}
 		}
 	}
+	if (burst) {
+		if (burst > s->max_burst) {
+			s->max_burst = burst;
+		}
+		s->sum_burst += burst;
+		s->n_bursts++;
+	}
 	return err;
 }
 
@@ -271,6 +744,9 @@ static int unicast_service_reply(struct port *p, struct ptp_message *dst,
 	struct ptp_message *msg;
 	int err;
 
+	evlog_event(EVLOG_GRANT_TX, portnum(p), 0, 0, req->message_type >> 4,
+		    duration, &dst->header.sourcePortIdentity.clockIdentity);
+
 	msg = port_signaling_uc_construct(p, &dst->address,
 					  &dst->header.sourcePortIdentity);
 	if (!msg) {
@@ -297,18 +773,69 @@ out:
 	return err;
 }
 
+/* Shortens a grant while the service runs close to its capacity. */
+static void unicast_service_shorten(struct unicast_service *s,
+				    struct request_unicast_xmit_tlv *req)
+{
+	if (req->durationField > UNICAST_SHORT_DURATION &&
+	    utilization(s) > UNICAST_SHORTEN_LOAD) {
+		req->durationField = UNICAST_SHORT_DURATION;
+		s->shortened++;
+	}
+}
+
+static int unicast_service_add_resp(struct port *p, struct ptp_message *m,
+				    struct request_unicast_xmit_tlv *req,
+				    struct timespec *now)
+{
+	struct unicast_service *s = p->unicast_service;
+	uint8_t mtype = req->message_type >> 4;
+	int held, idx = resp_index(mtype);
+	struct unicast_peer *peer;
+	unsigned int bucket;
+
+	peer = peer_lookup(p, &m->address, &bucket);
+	held = peer && (peer->resp_types & (1 << idx));
+	if (admit(s, mtype, req->logInterMessagePeriod, held,
+		  held ? peer->resp_period[idx] : 0)) {
+		return SERVICE_DENIED;
+	}
+	if (!peer) {
+		peer = calloc(1, sizeof(*peer));
+		if (!peer) {
+			return SERVICE_DENIED;
+		}
+		peer->addr = m->address;
+		LIST_INSERT_HEAD(&s->peers[bucket], peer, list);
+	}
+	if (held) {
+		load_update(s, mtype, peer->resp_period[idx], -1);
+	}
+	load_update(s, mtype, req->logInterMessagePeriod, 1);
+	peer->resp_types |= 1 << idx;
+	peer->resp_period[idx] = req->logInterMessagePeriod;
+	unicast_service_shorten(s, req);
+	peer->resp_tmo[idx] = now->tv_sec + req->durationField;
+	return SERVICE_GRANTED;
+}
+
 /* public methods */
 
 int unicast_service_add(struct port *p, struct ptp_message *m,
 			struct tlv_extra *extra)
 {
-	struct unicast_client_address *client = NULL, *ctmp, *next;
 	struct unicast_service_interval *interval = NULL, *itmp;
+	struct unicast_client_address *client = NULL;
+	struct unicast_peer *peer, *new_peer = NULL;
 	struct request_unicast_xmit_tlv *req;
-	unsigned int mask;
+	struct unicast_service *s;
+	unsigned int bucket, mask;
+	struct timespec now;
 	uint8_t mtype;
+	int i, idx;
 
-	if (!p->unicast_service) {
+	s = p->unicast_service;
+	if (!s) {
 		return SERVICE_DISABLED;
 	}
 
@@ -316,87 +843,109 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 	mtype = req->message_type >> 4;
 	mask = 1 << mtype;
 
+	if (abs(req->logInterMessagePeriod) > 30) {
+		return SERVICE_DENIED;
+	}
+	do_clock_gettime(CLOCK_MONOTONIC, &now);
+	resp_expire(s, now.tv_sec);
+
 	switch (mtype) {
 	case ANNOUNCE:
 	case SYNC:
 		break;
 	case DELAY_RESP:
 	case PDELAY_RESP:
-		return SERVICE_GRANTED;
+		return unicast_service_add_resp(p, m, req, &now);
 	default:
 		return SERVICE_DENIED;
 	}
 
-	if (abs(req->logInterMessagePeriod) > 30) {
+	idx = service_index(mtype);
+
+	peer = peer_lookup(p, &m->address, &bucket);
+	client = peer ? peer->record[idx] : NULL;
+	if (client &&
+	    client->interval->log_period == req->logInterMessagePeriod) {
+		/* Contract is unchanged. */
+		unicast_service_shorten(s, req);
+		unicast_service_extend(client, req);
+		return SERVICE_GRANTED;
+	}
+	/* A changed contract is denied in favor of the one in force. */
+	if (admit(s, mtype, req->logInterMessagePeriod, client != NULL,
+		  client ? client->interval->log_period : 0)) {
 		return SERVICE_DENIED;
 	}
-
-	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		/*
-		 * Remember the interval of interest.
-		 */
-		if (itmp->log_period == req->logInterMessagePeriod) {
-			interval = itmp;
-		}
-		/*
-		 * Find any client records, and remove any stale contract.
-		 */
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (interval == itmp) {
-				if (ctmp->message_types & mask) {
-					/* Contract is unchanged. */
-					unicast_service_extend(ctmp, req);
-					return SERVICE_GRANTED;
-				}
-				/* This is the one to use. */
-				client = ctmp;
-				continue;
-			}
-			/* Clear any stale contracts. */
-			ctmp->message_types &= ~mask;
-			if (!ctmp->message_types) {
-				LIST_REMOVE(ctmp, list);
-				free(ctmp);
-			}
-		}
+	if (client) {
+		/* Clear the stale contract, possibly freeing the peer. */
+		client_clear(s, client, mask);
+		peer = peer_lookup(p, &m->address, &bucket);
 	}
 
-	if (client) {
-		client->message_types |= mask;
-		unicast_service_extend(client, req);
-		return SERVICE_GRANTED;
+	/* A record in the requested interval may serve this type, too. */
+	for (i = 0; peer && i < N_SERVICES; i++) {
+		client = peer->record[i];
+		if (client &&
+		    client->interval->log_period == req->logInterMessagePeriod) {
+			client->message_types |= mask;
+			peer->record[idx] = client;
+			load_update(s, mtype, req->logInterMessagePeriod, 1);
+			unicast_service_shorten(s, req);
+			unicast_service_extend(client, req);
+			return SERVICE_GRANTED;
+		}
 	}
 
 	client = calloc(1, sizeof(*client));
 	if (!client) {
 		return SERVICE_DENIED;
 	}
+	if (!peer) {
+		peer = new_peer = calloc(1, sizeof(*peer));
+		if (!peer) {
+			free(client);
+			return SERVICE_DENIED;
+		}
+		peer->addr = m->address;
+	}
 	client->portIdentity = m->header.sourcePortIdentity;
 	client->message_types = mask;
 	client->addr = m->address;
-	unicast_service_extend(client, req);
+	client->peer = peer;
 
+	LIST_FOREACH(itmp, &s->intervals, list) {
+		if (itmp->log_period == req->logInterMessagePeriod) {
+			interval = itmp;
+			break;
+		}
+	}
 	if (!interval) {
 		interval = calloc(1, sizeof(*interval));
 		if (!interval) {
+			free(new_peer);
 			free(client);
 			return SERVICE_DENIED;
 		}
 		initialize_interval(interval, req->logInterMessagePeriod);
-		LIST_INSERT_HEAD(&p->unicast_service->intervals, interval, list);
-		if (pqueue_insert(p->unicast_service->queue, interval)) {
+		LIST_INSERT_HEAD(&s->intervals, interval, list);
+		if (pqueue_insert(s->queue, interval)) {
 			LIST_REMOVE(interval, list);
 			free(interval);
+			free(new_peer);
 			free(client);
 			return SERVICE_DENIED;
 		}
 		unicast_service_rearm_timer(p);
 	}
-	LIST_INSERT_HEAD(&interval->clients, client, list);
+	if (new_peer) {
+		LIST_INSERT_HEAD(&s->peers[bucket], new_peer, list);
+	}
+	peer->record[idx] = client;
+	interval_add_client(interval, client);
+	s->n_clients++;
+	load_update(s, mtype, req->logInterMessagePeriod, 1);
+	unicast_service_shorten(s, req);
+	unicast_service_extend(client, req);
 	return SERVICE_GRANTED;
 }
 
@@ -404,18 +953,22 @@ void unicast_service_cleanup(struct port *p)
 {
 	struct unicast_service_interval *itmp, *inext;
 	struct unicast_client_address *ctmp, *cnext;
+	int i;
 
 	if (!p->unicast_service) {
 		return;
 	}
 	LIST_FOREACH_SAFE(itmp, &p->unicast_service->intervals, list, inext) {
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, cnext) {
-			LIST_REMOVE(ctmp, list);
-			free(ctmp);
+		for (i = 0; i < UNICAST_PHASES; i++) {
+			LIST_FOREACH_SAFE(ctmp, &itmp->clients[i], list, cnext) {
+				LIST_REMOVE(ctmp, list);
+				free(ctmp);
+			}
 		}
 		LIST_REMOVE(itmp, list);
 		free(itmp);
 	}
+	peers_clear(p->unicast_service);
 	pqueue_destroy(p->unicast_service->queue);
 	free(p->unicast_service);
 }
@@ -441,6 +994,7 @@ int unicast_service_grant(struct port *p, struct ptp_message *m,
 int unicast_service_initialize(struct port *p)
 {
 	struct config *cfg = clock_config(p->clock);
+	int max_cost;
 
 	if (!config_get_int(cfg, p->name, "unicast_listen")) {
 		return 0;
@@ -462,17 +1016,38 @@ int unicast_service_initialize(struct port *p)
 	p->inhibit_multicast_service =
 		config_get_int(cfg, p->name, "inhibit_multicast_service");
 
+	p->unicast_service->tx_rate =
+		config_get_int(cfg, p->name, "unicast_tx_rate");
+	p->unicast_service->tx_burst =
+		config_get_int(cfg, p->name, "unicast_tx_burst");
+	p->unicast_service->two_step = p->timestamping != TS_ONESTEP &&
+		p->timestamping != TS_P2P1STEP;
+	/* A full bucket must admit any client, or it is deferred forever. */
+	max_cost = p->unicast_service->two_step ? 3 : 2;
+	if (p->unicast_service->tx_burst < max_cost) {
+		pr_warning("%s: raising unicast_tx_burst to %d",
+			   p->log_name, max_cost);
+		p->unicast_service->tx_burst = max_cost;
+	}
+	p->unicast_service->tokens = p->unicast_service->tx_burst;
+	p->unicast_service->max_pkts =
+		config_get_int(cfg, p->name, "unicast_max_packet_rate");
+	p->unicast_service->max_ts =
+		config_get_int(cfg, p->name, "unicast_max_ts_rate");
+	do_clock_gettime(CLOCK_MONOTONIC, &p->unicast_service->refill);
+	p->unicast_service->stats_start = p->unicast_service->refill.tv_sec;
+
 	return 0;
 }
 
 void unicast_service_remove(struct port *p, struct ptp_message *m,
 			    struct tlv_extra *extra)
 {
-	struct unicast_client_address *ctmp, *next;
 	struct cancel_unicast_xmit_tlv *cancel;
-	struct unicast_service_interval *itmp;
-	unsigned int mask;
+	struct unicast_peer *peer;
+	unsigned int bucket, mask;
 	uint8_t mtype;
+	int idx;
 
 	if (!p->unicast_service) {
 		return;
@@ -484,38 +1059,34 @@ void unicast_service_remove(struct port *p, struct ptp_message *m,
 	mtype = cancel->message_type_flags >> 4;
 	mask = 1 << mtype;
 
+	peer = peer_lookup(p, &m->address, &bucket);
+	if (!peer) {
+		return;
+	}
+
 	switch (mtype) {
 	case ANNOUNCE:
 	case SYNC:
 		break;
 	case DELAY_RESP:
 	case PDELAY_RESP:
+		resp_clear(p->unicast_service, peer, mtype);
+		return;
 	default:
 		return;
 	}
 
-	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (ctmp->message_types & mask) {
-				ctmp->message_types &= ~mask;
-				if (!ctmp->message_types) {
-					LIST_REMOVE(ctmp, list);
-					free(ctmp);
-				}
-				return;
-			}
-		}
+	idx = service_index(mtype);
+
+	if (peer->record[idx]) {
+		client_clear(p->unicast_service, peer->record[idx], mask);
 	}
 }
 
 int unicast_service_timer(struct port *p)
 {
 	struct unicast_service_interval *interval;
-	int err = 0, master = 0;
+	int err = 0, master = 0, paced;
 	struct timespec now;
 
 	if (!p->unicast_service) {
@@ -549,23 +1120,30 @@ int unicast_service_timer(struct port *p)
 		}
 		interval = pqueue_extract(p->unicast_service->queue);
 
-		if (master && unicast_service_clients(p, interval)) {
+		paced = 0;
+		if (master && unicast_service_clients(p, interval, &now,
+						      &paced)) {
 			err = -1;
 		}
 
-		if (LIST_EMPTY(&interval->clients)) {
+		if (!interval->total) {
 			pr_debug("retire interval 2^%d", interval->log_period);
 			LIST_REMOVE(interval, list);
 			free(interval);
 			continue;
 		}
 
-		interval_increment(interval);
+		if (!paced) {
+			interval_increment(interval);
+		}
 		pr_debug("next i={2^%d} tmo={%lld,%ld}", interval->log_period,
 			 (long long)interval->tmo.tv_sec, interval->tmo.tv_nsec);
 		pqueue_insert(p->unicast_service->queue, interval);
 	}
 
+	resp_expire(p->unicast_service, now.tv_sec);
+	unicast_service_stats(p, &now);
+
 	if (unicast_service_rearm_timer(p)) {
 		err = -1;
 	}
@@ -576,6 +1154,7 @@ void unicast_service_clear_clients(struct port *p)
 {
 	struct unicast_client_address *client, *temp;
 	struct unicast_service_interval *interval;
+	int i;
 
 	if (!p->unicast_service) {
 		return;
@@ -585,10 +1164,36 @@ void unicast_service_clear_clients(struct port *p)
 
 		LIST_REMOVE(interval, list);
 
-		LIST_FOREACH_SAFE(client, &interval->clients, list, temp) {
-			LIST_REMOVE(client, list);
-			free(client);
+		for (i = 0; i < UNICAST_PHASES; i++) {
+			LIST_FOREACH_SAFE(client, &interval->clients[i], list,
+					  temp) {
+				LIST_REMOVE(client, list);
+				free(client);
+			}
 		}
 		free(interval);
 	}
-}
\ No newline at end of file
+	peers_clear(p->unicast_service);
+}
+
+int unicast_service_count(struct port *p)
+{
+	return p->unicast_service ? p->unicast_service->n_clients : 0;
+}
+
+void unicast_service_load(struct port *p, struct unicast_service_load_np *l)
+{
+	struct unicast_service *s = p->unicast_service;
+
+	memset(l, 0, sizeof(*l));
+	if (!s) {
+		return;
+	}
+	l->clients = s->n_clients;
+	l->max_packet_rate = s->max_pkts;
+	l->packet_rate = ceil(s->load_pkts);
+	l->max_ts_rate = s->max_ts;
+	l->ts_rate = ceil(s->load_ts);
+	l->denied = s->denied;
+	l->shortened = s->shortened;
+}
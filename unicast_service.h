@@ -23,6 +23,7 @@
 struct port;
 struct ptp_message;
 struct tlv_extra;
+struct unicast_service_load_np;
 
 #define SERVICE_GRANTED   0
 #define SERVICE_DENIED    1
@@ -93,4 +94,20 @@ int unicast_service_timer(struct port *p);
  */
 void unicast_service_clear_clients(struct port *p);
 
+/**
+ * Counts the active unicast grants on a given port. A client holding
+ * grants at different message rates is counted once per rate.
+ * @param p      The port in question.
+ * @return       The number of granted client entries.
+ */
+int unicast_service_count(struct port *p);
+
+/**
+ * Reports the load of the granted contracts on a given port. The rates
+ * are rounded up to whole packets and time stamps per second.
+ * @param p      The port in question.
+ * @param load   Returns the load, all zero when the service is disabled.
+ */
+void unicast_service_load(struct port *p, struct unicast_service_load_np *load);
+
 #endif
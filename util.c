@@ -31,12 +31,30 @@
 #include "sk.h"
 #include "util.h"
 
+#if USE_KTIME
+#include <ktime.h>
+#endif
+
 #define NS_PER_SEC 1000000000LL
 #define NS_PER_HOUR (3600 * NS_PER_SEC)
 #define NS_PER_DAY (24 * NS_PER_HOUR)
 
 static int running = 1;
 
+int do_clock_gettime(clockid_t clk_id, struct timespec *tp)
+{
+#if USE_KTIME
+	if (clk_id == CLOCK_MONOTONIC) {
+		*tp = ktime_mono_time();
+	} else if (clk_id == CLOCK_REALTIME) {
+		*tp = ktime_real_time();
+	}
+	return 0;
+#else
+	return clock_gettime(clk_id, tp);
+#endif
+}
+
 const char *ps_str[] = {
 	"NONE",
 	"INITIALIZING",
@@ -145,6 +145,14 @@ void posix_clock_close(clockid_t clock);
  */
 clockid_t posix_clock_open(const char *device, int *phc_index);
 
+/**
+ * Reads a clock, through the ktime library when built with it.
+ * @param clk_id  The clock to read.
+ * @param tp      Returns the time of the clock.
+ * @return        Zero on success, non-zero otherwise.
+ */
+int do_clock_gettime(clockid_t clk_id, struct timespec *tp);
+
 /**
  * Compare two port identities for equality.
  *
@@ -0,0 +1,168 @@
+/**
+ * @file warmstart.c
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "print.h"
+#include "warmstart.h"
+
+#define WARMSTART_LINE	256
+
+struct warmstart_entry {
+	STAILQ_ENTRY(warmstart_entry) list;
+	char *key;
+	char *value;
+};
+
+struct warmstart {
+	STAILQ_HEAD(warmstart_head, warmstart_entry) entries;
+	char *path;
+};
+
+static struct warmstart_entry *warmstart_find(struct warmstart *ws,
+					      const char *key)
+{
+	struct warmstart_entry *e;
+
+	STAILQ_FOREACH(e, &ws->entries, list) {
+		if (!strcmp(e->key, key)) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static int warmstart_store(struct warmstart *ws, const char *key,
+			   const char *value)
+{
+	struct warmstart_entry *e;
+	char *copy;
+
+	copy = strdup(value);
+	if (!copy) {
+		return -1;
+	}
+	e = warmstart_find(ws, key);
+	if (e) {
+		free(e->value);
+		e->value = copy;
+		return 0;
+	}
+	e = calloc(1, sizeof(*e));
+	if (!e) {
+		free(copy);
+		return -1;
+	}
+	e->key = strdup(key);
+	if (!e->key) {
+		free(copy);
+		free(e);
+		return -1;
+	}
+	e->value = copy;
+	STAILQ_INSERT_TAIL(&ws->entries, e, list);
+	return 0;
+}
+
+static void warmstart_load(struct warmstart *ws)
+{
+	char line[WARMSTART_LINE], *key, *value, *save;
+	FILE *fp;
+
+	fp = fopen(ws->path, "r");
+	if (!fp) {
+		pr_info("no saved state in %s, cold start", ws->path);
+		return;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		key = strtok_r(line, " \t\n", &save);
+		value = strtok_r(NULL, "\n", &save);
+		if (!key || !value) {
+			continue;
+		}
+		if (warmstart_store(ws, key, value)) {
+			pr_err("low memory");
+			break;
+		}
+	}
+	fclose(fp);
+}
+
+struct warmstart *warmstart_create(const char *path)
+{
+	struct warmstart *ws;
+
+	ws = calloc(1, sizeof(*ws));
+	if (!ws) {
+		return NULL;
+	}
+	STAILQ_INIT(&ws->entries);
+	ws->path = strdup(path);
+	if (!ws->path) {
+		free(ws);
+		return NULL;
+	}
+	warmstart_load(ws);
+	return ws;
+}
+
+void warmstart_destroy(struct warmstart *ws)
+{
+	struct warmstart_entry *e;
+
+	while ((e = STAILQ_FIRST(&ws->entries))) {
+		STAILQ_REMOVE_HEAD(&ws->entries, list);
+		free(e->key);
+		free(e->value);
+		free(e);
+	}
+	free(ws->path);
+	free(ws);
+}
+
+const char *warmstart_get(struct warmstart *ws, const char *key)
+{
+	struct warmstart_entry *e = warmstart_find(ws, key);
+
+	return e ? e->value : NULL;
+}
+
+int warmstart_set(struct warmstart *ws, const char *key, const char *fmt, ...)
+{
+	char value[WARMSTART_LINE];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(value, sizeof(value), fmt, ap);
+	va_end(ap);
+
+	return warmstart_store(ws, key, value);
+}
+
+int warmstart_save(struct warmstart *ws)
+{
+	char tmp[strlen(ws->path) + 5];
+	struct warmstart_entry *e;
+	FILE *fp;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", ws->path);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		pr_err("failed to open %s: %m", tmp);
+		return -1;
+	}
+	STAILQ_FOREACH(e, &ws->entries, list) {
+		fprintf(fp, "%s %s\n", e->key, e->value);
+	}
+	if (fclose(fp) || rename(tmp, ws->path)) {
+		pr_err("failed to write %s: %m", ws->path);
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
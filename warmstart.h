@@ -0,0 +1,53 @@
+/**
+ * @file warmstart.h
+ * @brief Keeps the synchronization state across restarts in a file.
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#ifndef HAVE_WARMSTART_H
+#define HAVE_WARMSTART_H
+
+/** Seconds between the periodic checkpoints of the state. */
+#define WARMSTART_INTERVAL	60
+
+/** Opaque type */
+struct warmstart;
+
+/**
+ * Creates a state store, loading the state saved in a file, if any.
+ * @param path	Name of the file holding the state.
+ * @return	A pointer to a new store on success, NULL otherwise.
+ */
+struct warmstart *warmstart_create(const char *path);
+
+/**
+ * Destroys a state store. The state is not saved.
+ * @param ws	A pointer obtained via warmstart_create().
+ */
+void warmstart_destroy(struct warmstart *ws);
+
+/**
+ * Looks up a value of the state.
+ * @param ws	A pointer obtained via warmstart_create().
+ * @param key	The name of the value.
+ * @return	The value as a string, or NULL if it is not known.
+ */
+const char *warmstart_get(struct warmstart *ws, const char *key);
+
+/**
+ * Sets a value of the state, to be written by the next save.
+ * @param ws	A pointer obtained via warmstart_create().
+ * @param key	The name of the value, without white space.
+ * @param fmt	A printf(3) format for the value.
+ * @return	Zero on success, non-zero otherwise.
+ */
+int warmstart_set(struct warmstart *ws, const char *key, const char *fmt, ...)
+	__attribute__ ((format (printf, 3, 4)));
+
+/**
+ * Writes the state to the file, replacing it atomically.
+ * @param ws	A pointer obtained via warmstart_create().
+ * @return	Zero on success, non-zero otherwise.
+ */
+int warmstart_save(struct warmstart *ws);
+
+#endif
@@ -0,0 +1,218 @@
+/**
+ * @file workers.c
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "print.h"
+#include "workers.h"
+
+struct worker {
+	struct workers *pool;
+	pthread_t thread;
+	int index;
+};
+
+struct workers {
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned int generation;
+	int pending;
+	int stop;
+	int count;
+	int started;
+	workers_fn_t *fn;
+	char *jobs;
+	size_t job_size;
+	int n_jobs;
+	struct worker worker[WORKERS_MAX];
+};
+
+static void *worker_main(void *arg)
+{
+	struct worker *wk = arg;
+	struct workers *w = wk->pool;
+	unsigned int generation = 0;
+	int i;
+
+	pthread_mutex_lock(&w->lock);
+	while (1) {
+		while (!w->stop && w->generation == generation) {
+			pthread_cond_wait(&w->start, &w->lock);
+		}
+		if (w->stop) {
+			break;
+		}
+		generation = w->generation;
+		pthread_mutex_unlock(&w->lock);
+
+		for (i = wk->index; i < w->n_jobs; i += w->count) {
+			w->fn(w->jobs + i * w->job_size);
+		}
+
+		pthread_mutex_lock(&w->lock);
+		if (--w->pending == 0) {
+			pthread_cond_signal(&w->done);
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+/* Parse a list like "0,2-3" into an array, returning the number of CPUs. */
+static int parse_cpus(const char *str, int *cpus, int max)
+{
+	int first, last, n = 0;
+	char *end;
+
+	while (*str) {
+		first = strtol(str, &end, 10);
+		if (end == str || first < 0) {
+			return -1;
+		}
+		last = first;
+		str = end;
+		if (*str == '-') {
+			str++;
+			last = strtol(str, &end, 10);
+			if (end == str || last < first) {
+				return -1;
+			}
+			str = end;
+		}
+		for (; first <= last; first++) {
+			if (n == max || first >= CPU_SETSIZE) {
+				return -1;
+			}
+			cpus[n++] = first;
+		}
+		if (*str == ',') {
+			str++;
+		} else if (*str) {
+			return -1;
+		}
+	}
+	return n;
+}
+
+static int worker_setup(struct worker *wk, const int *cpus, int n_cpus,
+			int priority)
+{
+	struct sched_param param;
+	cpu_set_t set;
+	int err;
+
+	if (n_cpus > 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpus[wk->index % n_cpus], &set);
+		err = pthread_setaffinity_np(wk->thread, sizeof(set), &set);
+		if (err) {
+			pr_err("failed to pin worker to CPU %d: %s",
+			       cpus[wk->index % n_cpus], strerror(err));
+			return -1;
+		}
+	}
+	if (priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = priority;
+		err = pthread_setschedparam(wk->thread, SCHED_FIFO, &param);
+		if (err) {
+			pr_err("failed to set SCHED_FIFO priority %d: %s",
+			       priority, strerror(err));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+struct workers *workers_create(int count, const char *cpus, int priority)
+{
+	int i, n_cpus, cpu_list[WORKERS_MAX];
+	sigset_t mask, old_mask;
+	struct workers *w;
+
+	if (count < 1 || count > WORKERS_MAX) {
+		pr_err("bad number of workers %d", count);
+		return NULL;
+	}
+	n_cpus = parse_cpus(cpus, cpu_list, WORKERS_MAX);
+	if (n_cpus < 0) {
+		pr_err("bad CPU list '%s'", cpus);
+		return NULL;
+	}
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		return NULL;
+	}
+	w->count = count;
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->start, NULL);
+	pthread_cond_init(&w->done, NULL);
+
+	/* Leave the signals to the main thread. */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	for (i = 0; i < count; i++) {
+		w->worker[i].pool = w;
+		w->worker[i].index = i;
+		if (pthread_create(&w->worker[i].thread, NULL, worker_main,
+				   &w->worker[i])) {
+			pr_err("failed to create worker thread");
+			break;
+		}
+		w->started++;
+		if (worker_setup(&w->worker[i], cpu_list, n_cpus, priority)) {
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (w->started < count || i < count) {
+		workers_destroy(w);
+		return NULL;
+	}
+	return w;
+}
+
+void workers_destroy(struct workers *w)
+{
+	int i;
+
+	pthread_mutex_lock(&w->lock);
+	w->stop = 1;
+	pthread_cond_broadcast(&w->start);
+	pthread_mutex_unlock(&w->lock);
+
+	for (i = 0; i < w->started; i++) {
+		pthread_join(w->worker[i].thread, NULL);
+	}
+	pthread_cond_destroy(&w->done);
+	pthread_cond_destroy(&w->start);
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+}
+
+void workers_run(struct workers *w, workers_fn_t *fn, void *jobs,
+		 size_t job_size, int n_jobs)
+{
+	if (n_jobs < 1) {
+		return;
+	}
+	pthread_mutex_lock(&w->lock);
+	w->fn = fn;
+	w->jobs = jobs;
+	w->job_size = job_size;
+	w->n_jobs = n_jobs;
+	w->pending = w->count;
+	w->generation++;
+	pthread_cond_broadcast(&w->start);
+	while (w->pending) {
+		pthread_cond_wait(&w->done, &w->lock);
+	}
+	pthread_mutex_unlock(&w->lock);
+}
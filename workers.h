@@ -0,0 +1,52 @@
+/**
+ * @file workers.h
+ * @brief Runs batches of independent jobs on a pool of threads.
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+#ifndef HAVE_WORKERS_H
+#define HAVE_WORKERS_H
+
+#include <stddef.h>
+
+#define WORKERS_MAX 64
+
+struct workers;
+
+/**
+ * The function applied to each job of a batch.
+ * @param job  Pointer to the job.
+ */
+typedef void workers_fn_t(void *job);
+
+/**
+ * Create a pool of worker threads.
+ * @param count     The number of threads, at most WORKERS_MAX.
+ * @param cpus      A list of CPUs like "2,4-5" to which the threads are
+ *                  pinned in turn, or an empty string for no pinning.
+ * @param priority  The SCHED_FIFO priority of the threads, or zero to
+ *                  keep the default scheduling policy.
+ * @return          A pointer to a new pool on success, NULL otherwise.
+ */
+struct workers *workers_create(int count, const char *cpus, int priority);
+
+/**
+ * Stop the threads and destroy a pool.
+ * @param w  A pool obtained via @ref workers_create().
+ */
+void workers_destroy(struct workers *w);
+
+/**
+ * Run a batch of jobs and wait for all of them to complete. Job i
+ * always runs on thread i modulo the number of threads, so a caller
+ * which keeps each of its items at a fixed index, leaving a job empty
+ * when the item has nothing to do, keeps the item on the same CPU.
+ * @param w         A pool obtained via @ref workers_create().
+ * @param fn        The function to apply to every job.
+ * @param jobs      Array of jobs.
+ * @param job_size  The size of one element of 'jobs'.
+ * @param n_jobs    The number of elements in 'jobs'.
+ */
+void workers_run(struct workers *w, workers_fn_t *fn, void *jobs,
+		 size_t job_size, int n_jobs);
+
+#endif